@@ -20,30 +20,23 @@
 using namespace std;
 
 string Attributes::atNames[NUM_ATR];
-int Attributes::numAttrs = 0;
+int Attributes::namesReady = 0;
 //Attributes::staticInit Attributes::staticInitializer;
 
 // Default constructor
 Attributes::Attributes(void) {
-   numAttrs++;
-   if (numAttrs == 1)
+   if (!namesReady)
       Setup();
    attributes = 0;
 } // constructor
 
 // Alternate constructor
 Attributes::Attributes(const uint64_t a) {
-   numAttrs++;
-   if (numAttrs == 1)
+   if (!namesReady)
       Setup();
    attributes = a;
 } // alternate constructor
 
-// Destructor.
-Attributes::~Attributes(void) {
-   numAttrs--;
-} // Attributes destructor
-
 void Attributes::Setup(void) {
    ostringstream temp;
 
@@ -62,6 +55,7 @@ void Attributes::Setup(void) {
    atNames[60] = "read-only";
    atNames[62] = "hidden";
    atNames[63] = "do not automount";
+   namesReady = 1;
 }  // Attributes::Setup()
 
 // Display current attributes to user
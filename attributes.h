@@ -13,14 +13,13 @@
 class Attributes {
 protected:
    static std::string atNames[NUM_ATR];
-   static int numAttrs;
-   void Setup(void);
+   static int namesReady; // 1 once Setup() has filled in atNames
+   static void Setup(void);
    uint64_t attributes;
 
 public:
    Attributes(void);
    Attributes(const uint64_t a);
-   ~Attributes(void);
    void operator=(uint64_t a) {attributes = a;}
 
    uint64_t GetAttributes(void) const {return attributes;}
@@ -38,38 +38,18 @@ BasicMBRData::BasicMBRData(void) {
    numHeads = MAX_HEADS;
    numSecspTrack = MAX_SECSPERTRACK;
    myDisk = NULL;
-   canDeleteMyDisk = 0;
 //   memset(&EbrLocations, 0, MAX_MBR_PARTS * sizeof(uint32_t));
    EmptyMBR();
 } // BasicMBRData default constructor
 
+// The copy gets its own DiskIO object (ownDisk), open on the original's
+// disk, if any.
 BasicMBRData::BasicMBRData(const BasicMBRData & orig) {
-   int i;
-
    if (&orig != this) {
-      memcpy(code, orig.code, 440);
-      diskSignature = orig.diskSignature;
-      nulls = orig.nulls;
-      MBRSignature = orig.MBRSignature;
-      blockSize = orig.blockSize;
-      diskSize = orig.diskSize;
-      numHeads = orig.numHeads;
-      numSecspTrack = orig.numSecspTrack;
-      canDeleteMyDisk = orig.canDeleteMyDisk;
-      device = orig.device;
-      state = orig.state;
-
-      myDisk = new DiskIO;
-      if (myDisk == NULL) {
-         cerr << "Unable to allocate memory in BasicMBRData copy constructor! Terminating!\n";
-         exit(1);
-      } // if
+      CopyContents(orig);
+      myDisk = &ownDisk;
       if (orig.myDisk != NULL)
          myDisk->OpenForRead(orig.myDisk->GetName());
-
-      for (i = 0; i < MAX_MBR_PARTS; i++) {
-         partitions[i] = orig.partitions[i];
-      } // for
    } // if
 } // BasicMBRData copy constructor
 
@@ -81,7 +61,6 @@ BasicMBRData::BasicMBRData(string filename) {
    numHeads = MAX_HEADS;
    numSecspTrack = MAX_SECSPERTRACK;
    myDisk = NULL;
-   canDeleteMyDisk = 0;
 //   memset(&EbrLocations, 0, MAX_MBR_PARTS * sizeof(uint32_t));
    
    // Try to read the specified partition table, but if it fails....
@@ -91,65 +70,76 @@ BasicMBRData::BasicMBRData(string filename) {
    } // if
 } // BasicMBRData(string filename) constructor
 
-// Free space used by myDisk only if that's OK -- sometimes it will be
-// copied from an outside source, in which case that source should handle
-// it!
+// myDisk is either ownDisk, which is closed along with this object, or
+// comes from an outside source, which should handle it!
 BasicMBRData::~BasicMBRData(void) {
-   if (canDeleteMyDisk)
-      delete myDisk;
 } // BasicMBRData destructor
 
-// Assignment operator -- copy entire set of MBR data.
+// Assignment operator -- copy entire set of MBR data. As with the copy
+// constructor, the disk used from now on is ownDisk.
 BasicMBRData & BasicMBRData::operator=(const BasicMBRData & orig) {
-   int i;
-
    if (&orig != this) {
-      memcpy(code, orig.code, 440);
-      diskSignature = orig.diskSignature;
-      nulls = orig.nulls;
-      MBRSignature = orig.MBRSignature;
-      blockSize = orig.blockSize;
-      diskSize = orig.diskSize;
-      numHeads = orig.numHeads;
-      numSecspTrack = orig.numSecspTrack;
-      canDeleteMyDisk = orig.canDeleteMyDisk;
-      device = orig.device;
-      state = orig.state;
-
-      myDisk = new DiskIO;
-      if (myDisk == NULL) {
-         cerr << "Unable to allocate memory in BasicMBRData::operator=()! Terminating!\n";
-         exit(1);
-      } // if
+      CopyContents(orig);
+      myDisk = &ownDisk;
       if (orig.myDisk != NULL)
          myDisk->OpenForRead(orig.myDisk->GetName());
-
-      for (i = 0; i < MAX_MBR_PARTS; i++) {
-         partitions[i] = orig.partitions[i];
-      } // for
    } // if
    return *this;
 } // BasicMBRData::operator=()
 
+// Copy the MBR's contents (boot code, partitions, and disk geometry) from
+// orig, leaving this object's disk alone. Used by the copy operations and
+// to keep in-memory snapshots of the MBR without opening the disk.
+void BasicMBRData::CopyContents(const BasicMBRData & orig) {
+   int i;
+
+   memcpy(code, orig.code, 440);
+   diskSignature = orig.diskSignature;
+   nulls = orig.nulls;
+   MBRSignature = orig.MBRSignature;
+   blockSize = orig.blockSize;
+   diskSize = orig.diskSize;
+   numHeads = orig.numHeads;
+   numSecspTrack = orig.numSecspTrack;
+   device = orig.device;
+   state = orig.state;
+   for (i = 0; i < MAX_MBR_PARTS; i++) {
+      partitions[i] = orig.partitions[i];
+   } // for
+} // BasicMBRData::CopyContents()
+
+// Returns 1 if other holds the same boot code, disk signature, and
+// partitions as this MBR, 0 if anything differs.
+int BasicMBRData::SameContents(BasicMBRData & other) {
+   struct MBRRecord mine, theirs;
+   int i, same;
+
+   same = (memcmp(code, other.code, 440) == 0) && (diskSignature == other.diskSignature) &&
+          (nulls == other.nulls) && (MBRSignature == other.MBRSignature) &&
+          (state == other.state);
+   for (i = 0; same && (i < MAX_MBR_PARTS); i++) {
+      partitions[i].StoreInStruct(&mine);
+      other.partitions[i].StoreInStruct(&theirs);
+      same = (memcmp(&mine, &theirs, sizeof(mine)) == 0) &&
+             (partitions[i].GetInclusion() == other.partitions[i].GetInclusion());
+   } // for
+   return same;
+} // BasicMBRData::SameContents()
+
 /**********************
  *                    *
  * Disk I/O functions *
  *                    *
  **********************/
 
-// Read data from MBR. Returns 1 if read was successful (even if the
-// data isn't a valid MBR), 0 if the read failed.
+// Read data from MBR, using ownDisk if no disk has been set. Returns 1 if
+// read was successful (even if the data isn't a valid MBR), 0 if the read
+// failed.
 int BasicMBRData::ReadMBRData(const string & deviceFilename) {
    int allOK;
 
-   if (myDisk == NULL) {
-      myDisk = new DiskIO;
-      if (myDisk == NULL) {
-         cerr << "Unable to allocate memory in BasicMBRData::ReadMBRData()! Terminating!\n";
-         exit(1);
-      } // if
-      canDeleteMyDisk = 1;
-   } // if
+   if (myDisk == NULL)
+      myDisk = &ownDisk;
    if (myDisk->OpenForRead(deviceFilename)) {
       allOK = ReadMBRData(myDisk);
    } else {
@@ -172,10 +162,8 @@ int BasicMBRData::ReadMBRData(DiskIO * theDisk, int checkBlockSize) {
    int err = 1;
    TempMBR tempMBR;
 
-   if ((myDisk != NULL) && (myDisk != theDisk) && (canDeleteMyDisk)) {
-      delete myDisk;
-      canDeleteMyDisk = 0;
-   } // if
+   if ((myDisk == &ownDisk) && (theDisk != &ownDisk))
+      ownDisk.Close();
 
    myDisk = theDisk;
 
@@ -489,9 +477,10 @@ int BasicMBRData::WriteMBRData(struct TempMBR & mbr, DiskIO *theDisk, uint64_t s
 void BasicMBRData::SetDisk(DiskIO *theDisk) {
    int err;
 
+   if ((myDisk == &ownDisk) && (theDisk != &ownDisk))
+      ownDisk.Close();
    myDisk = theDisk;
    diskSize = theDisk->DiskSize(&err);
-   canDeleteMyDisk = 0;
    ReadCHSGeom();
 } // BasicMBRData::SetDisk()
 
@@ -734,38 +723,75 @@ int BasicMBRData::LBAtoCHS(uint64_t lba, uint8_t * chs) {
    return (retval);
 } // BasicMBRData::LBAtoCHS()
 
+// Fill extents with the sectors used by each defined partition, for use
+// in overlap checks. If includedOnly is non-zero, partitions whose
+// inclusion status is NONE are skipped.
+void BasicMBRData::GetExtents(vector<Extent> & extents, int includedOnly) {
+   int i;
+   Extent extent;
+
+   extents.clear();
+   for (i = 0; i < MAX_MBR_PARTS; i++) {
+      if ((partitions[i].GetLengthLBA() > 0) &&
+          (!includedOnly || (partitions[i].GetInclusion() != NONE))) {
+         extent.firstLBA = partitions[i].GetStartLBA();
+         extent.lastLBA = partitions[i].GetLastLBA();
+         extent.index = i;
+         extents.push_back(extent);
+      } // if
+   } // for
+} // BasicMBRData::GetExtents()
+
 // Look for overlapping partitions. Also looks for a couple of non-error
 // conditions that the user should be told about.
 // Returns the number of problems found
 int BasicMBRData::FindOverlaps(void) {
-   int i, j, numProbs = 0, numEE = 0, ProtectiveOnOne = 0;
-
-   for (i = 0; i < MAX_MBR_PARTS; i++) {
-      for (j = i + 1; j < MAX_MBR_PARTS; j++) {
-         if ((partitions[i].GetInclusion() != NONE) && (partitions[j].GetInclusion() != NONE) &&
-             (partitions[i].DoTheyOverlap(partitions[j]))) {
-            numProbs++;
-            cout << "\nProblem: MBR partitions " << i + 1 << " and " << j + 1
-                 << " overlap!\n";
-         } // if
-      } // for (j...)
-      if (partitions[i].GetType() == 0xEE) {
-         numEE++;
-         if (partitions[i].GetStartLBA() == 1)
-            ProtectiveOnOne = 1;
-      } // if
-   } // for (i...)
+   int numProbs = 0, numEE, protectiveOnOne;
+   size_t k;
+   vector<ExtentOverlap> overlaps;
+
+   GetOverlaps(overlaps);
+   for (k = 0; k < overlaps.size(); k++) {
+      numProbs++;
+      cout << "\nProblem: MBR partitions " << overlaps[k].low + 1 << " and "
+           << overlaps[k].high + 1 << " overlap!\n";
+   } // for
+   numEE = CountEEParts(&protectiveOnOne);
 
    if (numEE > 1)
       cout << "\nCaution: More than one 0xEE MBR partition found. This can cause problems\n"
            << "in some OSes.\n";
-   if (!ProtectiveOnOne && (numEE > 0))
+   if (!protectiveOnOne && (numEE > 0))
       cout << "\nWarning: 0xEE partition doesn't start on sector 1. This can cause "
            << "problems\nin some OSes.\n";
 
    return numProbs;
 } // BasicMBRData::FindOverlaps()
 
+// Find the pairs of partitions that overlap, without reporting them.
+void BasicMBRData::GetOverlaps(vector<ExtentOverlap> & overlaps) {
+   vector<Extent> extents;
+
+   GetExtents(extents, 1);
+   FindExtentOverlaps(extents, overlaps);
+} // BasicMBRData::GetOverlaps()
+
+// Returns the number of 0xEE partitions, setting *onSectorOne to 1 if one
+// of them starts on sector 1 (0 if not).
+int BasicMBRData::CountEEParts(int *onSectorOne) {
+   int i, numEE = 0;
+
+   *onSectorOne = 0;
+   for (i = 0; i < MAX_MBR_PARTS; i++) {
+      if (partitions[i].GetType() == 0xEE) {
+         numEE++;
+         if (partitions[i].GetStartLBA() == 1)
+            *onSectorOne = 1;
+      } // if
+   } // for (i...)
+   return numEE;
+} // BasicMBRData::CountEEParts()
+
 // Returns the number of primary partitions, including the extended partition
 // required to hold any logical partitions found.
 int BasicMBRData::NumPrimaries(void) {
@@ -1202,18 +1228,25 @@ int BasicMBRData::DeleteExtendedParts() {
 // Finds any overlapping partitions and omits the smaller of the two.
 void BasicMBRData::OmitOverlaps() {
    int i, j;
-
-   for (i = 0; i < MAX_MBR_PARTS; i++) {
-      for (j = i + 1; j < MAX_MBR_PARTS; j++) {
-         if ((partitions[i].GetInclusion() != NONE) &&
-             partitions[i].DoTheyOverlap(partitions[j])) {
-            if (partitions[i].GetLengthLBA() < partitions[j].GetLengthLBA())
-               partitions[i].SetInclusion(NONE);
-            else
-               partitions[j].SetInclusion(NONE);
-         } // if
-      } // for (j...)
-   } // for (i...)
+   size_t k;
+   vector<Extent> extents;
+   vector<ExtentOverlap> overlaps;
+
+   // Overlaps come back in the order that a nested loop over i and j would
+   // find them. Which partition gets omitted depends on earlier decisions,
+   // so the lower-numbered partition's inclusion must be checked as we go.
+   GetExtents(extents, 0);
+   FindExtentOverlaps(extents, overlaps);
+   for (k = 0; k < overlaps.size(); k++) {
+      i = overlaps[k].low;
+      j = overlaps[k].high;
+      if (partitions[i].GetInclusion() != NONE) {
+         if (partitions[i].GetLengthLBA() < partitions[j].GetLengthLBA())
+            partitions[i].SetInclusion(NONE);
+         else
+            partitions[j].SetInclusion(NONE);
+      } // if
+   } // for
 } // BasicMBRData::OmitOverlaps()
 
 // Convert as many partitions into logicals as possible, except for
@@ -10,6 +10,7 @@
 #include <sys/types.h>
 #include "diskio.h"
 #include "mbrpart.h"
+#include "extents.h"
 
 #define MBR_SIGNATURE UINT16_C(0xAA55)
 
@@ -53,17 +54,20 @@ protected:
    uint64_t diskSize; // size in blocks
    uint32_t numHeads; // number of heads, in CHS scheme
    uint32_t numSecspTrack; // number of sectors per track, in CHS scheme
-   DiskIO* myDisk;
-   int canDeleteMyDisk;
+   DiskIO* myDisk; // ownDisk, or one that belongs to someone else
+   DiskIO ownDisk;
    std::string device;
    MBRValidity state;
    MBRPart* GetPartition(int i); // Return primary or logical partition
+   void GetExtents(std::vector<Extent> & extents, int includedOnly);
 public:
    BasicMBRData(void);
    BasicMBRData(std::string deviceFilename);
    BasicMBRData(const BasicMBRData &);
    ~BasicMBRData(void);
    BasicMBRData & operator=(const BasicMBRData & orig);
+   void CopyContents(const BasicMBRData & orig);
+   int SameContents(BasicMBRData & other);
 
    // File I/O functions...
    int ReadMBRData(const std::string & deviceFilename);
@@ -93,6 +97,8 @@ public:
    int GetPartRange(uint32_t* low, uint32_t* high);
    int LBAtoCHS(uint64_t lba, uint8_t * chs); // Convert LBA to CHS
    int FindOverlaps(void);
+   void GetOverlaps(std::vector<ExtentOverlap> & overlaps);
+   int CountEEParts(int *onSectorOne);
    int NumPrimaries(void);
    int NumLogicals(void);
    int CountParts(void);
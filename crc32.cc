@@ -13,16 +13,298 @@
 
 /* based on implementation by Finn Yannick Jacobs */
 
+/* Slice-by-8 and hardware-assisted (PCLMULQDQ on x86, CRC32 instructions
+ * on ARMv8) engines added for gptfdisk by Roderick W. Smith, 2024. */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include "crc32.h"
 
-/* crc_tab[] -- this crcTable is being build by chksum_crc32GenTab().
- *		so make sure, you call it before using the other
- *		functions!
+#if __cplusplus >= 201103L
+#define CRC32_USE_THREADS
+#include <thread>
+#include <vector>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_USE_CLMUL
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#define CRC32_CLMUL_TARGET __attribute__((target("sse2,pclmul")))
+#endif
+
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__AARCH64EL__)
+#define CRC32_USE_ARMV8
+#include <arm_acle.h>
+#if defined(__ARM_FEATURE_CRC32)
+#define CRC32_ARMV8_TARGET
+#elif defined(__clang__)
+#define CRC32_ARMV8_TARGET __attribute__((target("crc")))
+#else
+#define CRC32_ARMV8_TARGET __attribute__((target("+crc")))
+#endif
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+/* The CRC of a single byte is eight shifts of the byte through the
+ * polynomial; feeding in n more zero bytes is another 8 * n shifts. So the
+ * slice-by-8 tables, which give the effect of a byte followed by 0-7 zero
+ * bytes, can all be built from this one function. When the compiler
+ * supports constexpr the tables are built at compile time; otherwise they
+ * are filled in during static initialization. */
+#if __cplusplus >= 201103L
+#define CRC32_CONSTEXPR constexpr
+#else
+#define CRC32_CONSTEXPR
+#endif
+
+static CRC32_CONSTEXPR uint32_t crc32_shift(uint32_t crc, int bits)
+{
+   return (bits == 0) ? crc :
+          crc32_shift((crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1))), bits - 1);
+}
+
+#define CRC32_ENTRY(k, i) crc32_shift((i), 8 * ((k) + 1))
+#define CRC32_ROW4(k, i) CRC32_ENTRY(k, (i)), CRC32_ENTRY(k, (i) + 1), \
+                         CRC32_ENTRY(k, (i) + 2), CRC32_ENTRY(k, (i) + 3)
+#define CRC32_ROW16(k, i) CRC32_ROW4(k, (i)), CRC32_ROW4(k, (i) + 4), \
+                          CRC32_ROW4(k, (i) + 8), CRC32_ROW4(k, (i) + 12)
+#define CRC32_ROW64(k, i) CRC32_ROW16(k, (i)), CRC32_ROW16(k, (i) + 16), \
+                          CRC32_ROW16(k, (i) + 32), CRC32_ROW16(k, (i) + 48)
+#define CRC32_TABLE(k) { CRC32_ROW64(k, 0), CRC32_ROW64(k, 64), \
+                         CRC32_ROW64(k, 128), CRC32_ROW64(k, 192) }
+
+/* crc_tab[] -- the classic byte-at-a-time table; kept for anybody who
+ *		uses it directly.
+ */
+uint32_t crc_tab[256] = CRC32_TABLE(0);
+
+/* crc_slice[k][] -- the CRC of byte i followed by k zero bytes. */
+static const uint32_t crc_slice[8][256] = {
+   CRC32_TABLE(0), CRC32_TABLE(1), CRC32_TABLE(2), CRC32_TABLE(3),
+   CRC32_TABLE(4), CRC32_TABLE(5), CRC32_TABLE(6), CRC32_TABLE(7)
+};
+
+/* All of the engines below work on the running (pre-inverted) CRC value,
+ * so they can be chained; chksum_crc32() does the inversions. */
+
+static uint32_t crc32_bytes(uint32_t crc, const unsigned char *block, size_t length)
+{
+   while (length--)
+      crc = (crc >> 8) ^ crc_slice[0][(crc ^ *block++) & 0xFF];
+   return crc;
+}
+
+/* crc32_slice8() -- fold eight bytes per iteration, one table lookup per
+ *		byte but with no dependency between the lookups. The bytes
+ *		are assembled explicitly so this works on any byte order.
+ */
+static uint32_t crc32_slice8(uint32_t crc, const unsigned char *block, size_t length)
+{
+   while (length >= 8)
+   {
+      crc ^= (uint32_t) block[0] | ((uint32_t) block[1] << 8) |
+             ((uint32_t) block[2] << 16) | ((uint32_t) block[3] << 24);
+      crc = crc_slice[7][crc & 0xFF] ^ crc_slice[6][(crc >> 8) & 0xFF] ^
+            crc_slice[5][(crc >> 16) & 0xFF] ^ crc_slice[4][crc >> 24] ^
+            crc_slice[3][block[4]] ^ crc_slice[2][block[5]] ^
+            crc_slice[1][block[6]] ^ crc_slice[0][block[7]];
+      block += 8;
+      length -= 8;
+   }
+   return crc32_bytes(crc, block, length);
+}
+
+#ifdef CRC32_USE_CLMUL
+/* crc32_clmul() -- carry-less multiplication folding, as described in
+ *		Intel's "Fast CRC Computation for Generic Polynomials Using
+ *		PCLMULQDQ Instruction". Four 128-bit lanes are folded in
+ *		parallel, then reduced to one lane, then Barrett-reduced to
+ *		32 bits. Needs at least 64 bytes; anything past the last full
+ *		16-byte block is handed to the slice-by-8 code.
+ */
+static CRC32_CLMUL_TARGET uint32_t crc32_clmul(uint32_t crc, const unsigned char *block, size_t length)
+{
+   /* Bit-reflected folding constants and polynomials for 0x04C11DB7. */
+   static const uint64_t k1k2[2] __attribute__((aligned(16))) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+   static const uint64_t k3k4[2] __attribute__((aligned(16))) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+   static const uint64_t k5k0[2] __attribute__((aligned(16))) = { 0x0163cd6124ULL, 0x0000000000ULL };
+   static const uint64_t poly[2] __attribute__((aligned(16))) = { 0x01db710641ULL, 0x01f7011641ULL };
+   __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+   if (length < 64)
+      return crc32_slice8(crc, block, length);
+
+   x1 = _mm_loadu_si128((const __m128i *) (block + 0x00));
+   x2 = _mm_loadu_si128((const __m128i *) (block + 0x10));
+   x3 = _mm_loadu_si128((const __m128i *) (block + 0x20));
+   x4 = _mm_loadu_si128((const __m128i *) (block + 0x30));
+   x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc));
+   x0 = _mm_load_si128((const __m128i *) k1k2);
+   block += 64;
+   length -= 64;
+
+   /* Fold 64 bytes at a time */
+   while (length >= 64)
+   {
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+      y5 = _mm_loadu_si128((const __m128i *) (block + 0x00));
+      y6 = _mm_loadu_si128((const __m128i *) (block + 0x10));
+      y7 = _mm_loadu_si128((const __m128i *) (block + 0x20));
+      y8 = _mm_loadu_si128((const __m128i *) (block + 0x30));
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+      block += 64;
+      length -= 64;
+   }
+
+   /* Fold the four lanes into one */
+   x0 = _mm_load_si128((const __m128i *) k3k4);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+   /* Fold any remaining 16-byte blocks */
+   while (length >= 16)
+   {
+      x2 = _mm_loadu_si128((const __m128i *) block);
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+      block += 16;
+      length -= 16;
+   }
+
+   /* Fold 128 bits down to 64 */
+   x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+   x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+   x1 = _mm_srli_si128(x1, 8);
+   x1 = _mm_xor_si128(x1, x2);
+   x0 = _mm_loadl_epi64((const __m128i *) k5k0);
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_and_si128(x1, x3);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   /* Barrett reduction to 32 bits */
+   x0 = _mm_load_si128((const __m128i *) poly);
+   x2 = _mm_and_si128(x1, x3);
+   x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+   x2 = _mm_and_si128(x2, x3);
+   x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+   crc = (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+
+   return crc32_slice8(crc, block, length);
+}
+
+static int crc32_have_clmul(void)
+{
+   unsigned int eax, ebx, ecx, edx;
+
+   if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+      return 0;
+   return ((ecx & bit_PCLMUL) != 0) && ((edx & bit_SSE2) != 0);
+}
+#endif
+
+#ifdef CRC32_USE_ARMV8
+/* crc32_armv8() -- the ARMv8 CRC32 instructions (as opposed to CRC32C)
+ *		use the same polynomial as GPT, so this is a straight loop.
  */
-uint32_t crc_tab[256];
+static CRC32_ARMV8_TARGET uint32_t crc32_armv8(uint32_t crc, const unsigned char *block, size_t length)
+{
+   uint64_t word;
+
+   while ((length > 0) && (((uintptr_t) block & 7) != 0))
+   {
+      crc = __crc32b(crc, *block++);
+      length--;
+   }
+   while (length >= 8)
+   {
+      memcpy(&word, block, 8);
+      crc = __crc32d(crc, word);
+      block += 8;
+      length -= 8;
+   }
+   while (length--)
+      crc = __crc32b(crc, *block++);
+   return crc;
+}
+
+static int crc32_have_armv8(void)
+{
+#if defined(__ARM_FEATURE_CRC32) || defined(__APPLE__)
+   return 1;
+#elif defined(__linux__) && defined(HWCAP_CRC32)
+   return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+   return 0;
+#endif
+}
+#endif
+
+typedef uint32_t (*crc32_function)(uint32_t crc, const unsigned char *block, size_t length);
+
+static int crc32_have_hardware(void)
+{
+#if defined(CRC32_USE_CLMUL)
+   return crc32_have_clmul();
+#elif defined(CRC32_USE_ARMV8)
+   return crc32_have_armv8();
+#else
+   return 0;
+#endif
+}
+
+static crc32_function crc32_lookup(crc32_engine engine)
+{
+   switch (engine)
+   {
+      case crc32_bytewise:
+         return crc32_bytes;
+      case crc32_hardware:
+#if defined(CRC32_USE_CLMUL)
+         return crc32_clmul;
+#elif defined(CRC32_USE_ARMV8)
+         return crc32_armv8;
+#endif
+      default:
+         return crc32_slice8;
+   }
+}
+
+/* The engine is picked once, during static initialization, so there's no
+ * race if checksums are later computed from several threads. */
+static crc32_engine crc32_choose(void)
+{
+   return crc32_have_hardware() ? crc32_hardware : crc32_slice_by_8;
+}
+
+static crc32_engine crc_engine = crc32_choose();
+static crc32_function crc_function = crc32_lookup(crc_engine);
 
 /* chksum_crc() -- to a given block, this one calculates the
  *				crc32-checksum until the length is
@@ -31,42 +313,150 @@ uint32_t crc_tab[256];
  */
 uint32_t chksum_crc32 (unsigned char *block, unsigned int length)
 {
-   unsigned long crc;
-   unsigned long i;
+   return crc_function(0xFFFFFFFF, block, length) ^ 0xFFFFFFFF;
+}
+
+/* chksum_crc32gentab() --      the tables are now built when the program
+ *				is compiled (or, failing that, loaded), so
+ *				this does nothing; it's kept so that
+ *				existing callers still work.
+ */
+void chksum_crc32gentab ()
+{
+}
+
+int chksum_crc32_has_engine (crc32_engine engine)
+{
+   if (engine == crc32_hardware)
+      return crc32_have_hardware();
+   return (engine == crc32_bytewise) || (engine == crc32_slice_by_8);
+}
+
+crc32_engine chksum_crc32_engine ()
+{
+   return crc_engine;
+}
+
+/* crc32_multmodp() -- multiply a by b modulo the polynomial, with both
+ *		in the reflected bit order that the CRC uses (so 1 << 31 is
+ *		x^0). The combination code below is adapted from zlib.
+ */
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+   uint32_t m = (uint32_t) 1 << 31, p = 0;
+
+   for (;;)
+   {
+      if (a & m)
+      {
+         p ^= b;
+         if ((a & (m - 1)) == 0)
+            break;
+      }
+      m >>= 1;
+      b = (b & 1) ? (b >> 1) ^ 0xEDB88320 : b >> 1;
+   }
+   return p;
+}
+
+/* crc_x2n[k] -- x^(2^k) modulo the polynomial. */
+static uint32_t crc_x2n[32];
+
+static int crc32_fill_x2n(void)
+{
+   uint32_t p = (uint32_t) 1 << 30;   /* x^1 */
+   int n;
+
+   crc_x2n[0] = p;
+   for (n = 1; n < 32; n++)
+      crc_x2n[n] = p = crc32_multmodp(p, p);
+   return 1;
+}
+
+static int crc_x2n_filled = crc32_fill_x2n();
+
+/* chksum_crc32_combine() -- shift crc1 along by len2 bytes' worth of
+ *		zeroes, which takes O(log len2) multiplications, and fold in
+ *		crc2.
+ */
+uint32_t chksum_crc32_combine (uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+   uint32_t p = (uint32_t) 1 << 31;   /* x^0 */
+   int k = 3;   /* 2^3 bits per byte */
 
-   crc = 0xFFFFFFFF;
-   for (i = 0; i < length; i++)
+   (void) crc_x2n_filled;
+   while (len2)
    {
-      crc = ((crc >> 8) & 0x00FFFFFF) ^ crc_tab[(crc ^ *block++) & 0xFF];
+      if (len2 & 1)
+         p = crc32_multmodp(crc_x2n[k & 31], p);
+      len2 >>= 1;
+      k++;
    }
-   return (crc ^ 0xFFFFFFFF);
+   return crc32_multmodp(p, crc1) ^ crc2;
 }
 
-/* chksum_crc32gentab() --      to a global crc_tab[256], this one will
- *				calculate the crcTable for crc32-checksums.
- *				it is generated to the polynom [..]
+uint32_t chksum_crc32_using (crc32_engine engine, const unsigned char *block, size_t length)
+{
+   if (!chksum_crc32_has_engine(engine))
+      engine = crc32_slice_by_8;
+   return crc32_lookup(engine)(0xFFFFFFFF, block, length) ^ 0xFFFFFFFF;
+}
+
+/* chksum_crc32_max_threads() -- how many blocks chksum_crc32_blocks() can
+ *		usefully work on at once.
  */
+unsigned int chksum_crc32_max_threads ()
+{
+#ifdef CRC32_USE_THREADS
+   unsigned int threads = std::thread::hardware_concurrency();
 
-void chksum_crc32gentab ()
+   if (threads > 8)
+      threads = 8;
+   if (threads > 0)
+      return threads;
+#endif
+   return 1;
+}
+
+#ifdef CRC32_USE_THREADS
+static void crc32_block_worker(const unsigned char *block, size_t length, uint32_t *crc)
 {
-   unsigned long crc, poly;
-   int i, j;
+   *crc = crc_function(0xFFFFFFFF, block, length) ^ 0xFFFFFFFF;
+}
+#endif
+
+/* chksum_crc32_blocks() -- compute the CRCs of count separate blocks,
+ *		giving each its own thread when there's enough data to make
+ *		that worthwhile. Falls back on doing them one at a time if
+ *		threads aren't available.
+ */
+void chksum_crc32_blocks (unsigned char **blocks, const size_t *lengths, uint32_t *crcs, unsigned int count)
+{
+   unsigned int i = 0;
+#ifdef CRC32_USE_THREADS
+   std::vector<std::thread> workers;
+   size_t total = 0, j;
 
-   poly = 0xEDB88320L;
-   for (i = 0; i < 256; i++)
+   for (i = 0; i < count; i++)
+      total += lengths[i];
+   i = 0;
+   if ((count > 1) && (total >= CRC32_THREAD_MIN))
    {
-      crc = i;
-      for (j = 8; j > 0; j--)
+      workers.reserve(count);
+      try
+      {
+         for (i = 1; i < count; i++)
+            workers.push_back(std::thread(crc32_block_worker, blocks[i], lengths[i], &crcs[i]));
+      }
+      catch (...)
       {
-	 if (crc & 1)
-	 {
-	    crc = (crc >> 1) ^ poly;
-	 }
-	 else
-	 {
-	    crc >>= 1;
-	 }
+         /* Couldn't start a thread; whatever's left is done below */
       }
-      crc_tab[i] = crc;
+      crcs[0] = crc_function(0xFFFFFFFF, blocks[0], lengths[0]) ^ 0xFFFFFFFF;
+      for (j = 0; j < workers.size(); j++)
+         workers[j].join();
    }
+#endif
+   for ( ; i < count; i++)
+      crcs[i] = crc_function(0xFFFFFFFF, blocks[i], lengths[i]) ^ 0xFFFFFFFF;
 }
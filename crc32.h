@@ -13,8 +13,33 @@
 
 /* based on implementation by Finn Yannick Jacobs. */
 
+#ifndef __CRC32_H
+#define __CRC32_H
+
+#include <stddef.h>
 #include <stdint.h>
 
 void chksum_crc32gentab ();
 uint32_t chksum_crc32 (unsigned char *block, unsigned int length);
 extern unsigned int crc_tab[256];
+
+/* Given the CRCs of two blocks, return the CRC of the first block followed
+ * by the second, which is len2 bytes long. */
+uint32_t chksum_crc32_combine (uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+/* Compute the CRCs of several blocks at once, in parallel when threads are
+ * available and there's at least CRC32_THREAD_MIN bytes to go around. */
+#define CRC32_THREAD_MIN (512 * 1024)
+unsigned int chksum_crc32_max_threads ();
+void chksum_crc32_blocks (unsigned char **blocks, const size_t *lengths, uint32_t *crcs, unsigned int count);
+
+/* chksum_crc32() uses the fastest engine the CPU supports, chosen when the
+ * program starts. The functions below let the engines be compared against
+ * one another (see crc32_test.cc). */
+typedef enum {crc32_bytewise, crc32_slice_by_8, crc32_hardware} crc32_engine;
+
+int chksum_crc32_has_engine (crc32_engine engine);
+crc32_engine chksum_crc32_engine ();
+uint32_t chksum_crc32_using (crc32_engine engine, const unsigned char *block, size_t length);
+
+#endif // __CRC32_H
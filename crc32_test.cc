@@ -0,0 +1,105 @@
+// crc32_test.cc
+// Checks each of the CRC32 engines in crc32.cc against a plain bit-at-a-time
+// implementation of the polynomial, over a range of lengths and buffer
+// alignments. Run by "make test".
+
+/* This program is copyright (c) 2026 by agent <agent@local>. It is distributed
+  under the terms of the GNU GPL version 2, as detailed in the COPYING file. */
+
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include "crc32.h"
+
+using namespace std;
+
+static uint32_t ReferenceCRC(const unsigned char *block, size_t length) {
+   uint32_t crc = 0xFFFFFFFF;
+   size_t i;
+   int bit;
+
+   for (i = 0; i < length; i++) {
+      crc ^= block[i];
+      for (bit = 0; bit < 8; bit++) {
+         if (crc & 1)
+            crc = (crc >> 1) ^ 0xEDB88320;
+         else
+            crc >>= 1;
+      } // for
+   } // for
+   return ~crc;
+} // ReferenceCRC()
+
+int main(void) {
+   const char* names[] = {"byte-at-a-time", "slice-by-8", "hardware"};
+   const crc32_engine engines[] = {crc32_bytewise, crc32_slice_by_8, crc32_hardware};
+   vector<unsigned char> buffer(70000);
+   size_t i, offset, length, e;
+   uint32_t expected;
+   int errors = 0;
+
+   srand(1);
+   for (i = 0; i < buffer.size(); i++)
+      buffer[i] = (unsigned char) rand();
+
+   // Known answer: the standard CRC32 check value
+   if (chksum_crc32((unsigned char*) "123456789", 9) != 0xCBF43926) {
+      cerr << "CRC32 of \"123456789\" is wrong!\n";
+      errors++;
+   } // if
+
+   for (e = 0; e < 3; e++) {
+      if (!chksum_crc32_has_engine(engines[e])) {
+         cout << "CRC32 " << names[e] << " engine not available; skipping\n";
+         continue;
+      } // if
+      for (length = 0; length < 1100; length++) {
+         for (offset = 0; offset < 16; offset++) {
+            expected = ReferenceCRC(&buffer[offset], length);
+            if (chksum_crc32_using(engines[e], &buffer[offset], length) != expected) {
+               cerr << "CRC32 " << names[e] << " engine is wrong for length " << length
+                    << " at offset " << offset << "\n";
+               errors++;
+            } // if
+         } // for
+      } // for
+      // A few big, partition-array-sized blocks
+      for (length = 16384; length < buffer.size() - 16; length += 16381) {
+         expected = ReferenceCRC(&buffer[3], length);
+         if (chksum_crc32_using(engines[e], &buffer[3], length) != expected) {
+            cerr << "CRC32 " << names[e] << " engine is wrong for length " << length << "\n";
+            errors++;
+         } // if
+      } // for
+      cout << "CRC32 " << names[e] << " engine checked\n";
+   } // for
+   cout << "CRC32 engine in use: " << names[chksum_crc32_engine()] << "\n";
+
+   // Split a big buffer (big enough that the blocks get their own threads)
+   // into uneven blocks, CRC them all at once, and combine the results; the
+   // answer must match the CRC of the whole buffer.
+   {
+      vector<unsigned char> big(1234567);
+      unsigned char *blocks[4];
+      size_t lengths[4] = {1, 16383, 700000, big.size() - 716384};
+      uint32_t crcs[4], combined = 0;
+
+      for (i = 0; i < big.size(); i++)
+         big[i] = (unsigned char) rand();
+      for (i = 0, offset = 0; i < 4; offset += lengths[i++])
+         blocks[i] = &big[offset];
+      chksum_crc32_blocks(blocks, lengths, crcs, 4);
+      for (i = 0; i < 4; i++)
+         combined = chksum_crc32_combine(combined, crcs[i], lengths[i]);
+      if (combined != ReferenceCRC(&big[0], big.size())) {
+         cerr << "Combined CRC32 of blocks is wrong!\n";
+         errors++;
+      } else {
+         cout << "CRC32 block combination checked\n";
+      } // if/else
+   }
+
+   if (errors)
+      cerr << errors << " CRC32 errors found!\n";
+   return errors != 0;
+} // main()
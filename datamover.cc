@@ -0,0 +1,352 @@
+/*
+    datamover.cc -- Copies a run of sectors to a new location on the same
+    disk, as when a partition is moved.
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define __STDC_LIMIT_MACROS
+#define __STDC_CONSTANT_MACROS
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <iostream>
+#include <fstream>
+#if __cplusplus >= 201103L
+#define MOVE_USE_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+#include "datamover.h"
+#include "support.h"
+
+using namespace std;
+
+DataMover::DataMover(const string & deviceName) {
+   device = deviceName;
+   checkpointFile = "";
+   directIO = 0;
+   beQuiet = 0;
+   blockSize = SECTOR_SIZE;
+   source = dest = count = start = 0;
+   chunkSize = numChunks = 0;
+   backwards = overlapping = 0;
+   lastPercent = -1;
+} // DataMover constructor
+
+// Find the chunk'th chunk still to be copied (numbered from 0, in the order
+// they're copied). Returns its first sector, as an offset from the start of
+// the data, and sets *length to its length in sectors.
+uint64_t DataMover::ChunkAt(uint64_t chunk, uint64_t *length) {
+   uint64_t offset, end;
+
+   if (backwards) {
+      end = count - start - chunk * chunkSize;
+      *length = (end < chunkSize) ? end : chunkSize;
+      offset = end - *length;
+   } else {
+      offset = start + chunk * chunkSize;
+      *length = ((count - offset) < chunkSize) ? (count - offset) : chunkSize;
+   } // if/else
+   return offset;
+} // DataMover::ChunkAt()
+
+// Read a chunk from its old location into buffer.
+// Returns 1 on success, 0 on failure.
+int DataMover::ReadChunk(DiskIO & disk, uint64_t chunk, unsigned char *buffer) {
+   uint64_t offset, length;
+   int numBytes, allOK = 0;
+
+   offset = ChunkAt(chunk, &length);
+   numBytes = (int) (length * blockSize);
+   if (disk.Seek(source + offset))
+      allOK = (disk.Read(buffer, numBytes) == numBytes);
+   if (!allOK)
+      cerr << "\nError " << errno << " reading sectors " << source + offset << " to "
+           << source + offset + length - 1 << "!\n";
+   return allOK;
+} // DataMover::ReadChunk()
+
+// Write a chunk from buffer to its new location.
+// Returns 1 on success, 0 on failure.
+int DataMover::WriteChunk(DiskIO & disk, uint64_t chunk, unsigned char *buffer) {
+   uint64_t offset, length;
+   int numBytes, allOK = 0;
+
+   offset = ChunkAt(chunk, &length);
+   numBytes = (int) (length * blockSize);
+   if (disk.Seek(dest + offset))
+      allOK = (disk.Write(buffer, numBytes) == numBytes);
+   if (!allOK)
+      cerr << "\nError " << errno << " writing sectors " << dest + offset << " to "
+           << dest + offset + length - 1 << "!\n";
+   return allOK;
+} // DataMover::WriteChunk()
+
+// Account for a chunk that's just been written: show the progress made,
+// and bring the checkpoint up to date if it's due. The data have to be
+// flushed to the disk first, or a crash could leave the checkpoint
+// claiming more than was really copied.
+// Returns 1 on success, 0 if the flush or the checkpoint failed.
+int DataMover::ChunkWritten(DiskIO & disk, uint64_t chunk, uint64_t *sinceCheckpoint) {
+   uint64_t offset, length, done;
+   int allOK = 1;
+
+   offset = ChunkAt(chunk, &length);
+   done = backwards ? (count - offset) : (offset + length);
+   *sinceCheckpoint += length;
+   if ((checkpointFile != "") &&
+       (overlapping || (chunk == numChunks - 1) ||
+        (*sinceCheckpoint * blockSize >= MOVE_CHECKPOINT_INTERVAL))) {
+      if (disk.Flush()) {
+         allOK = SaveCheckpoint(done);
+      } else {
+         cerr << "\nError " << errno << " flushing data to " << device << "!\n";
+         allOK = 0;
+      } // if/else
+      *sinceCheckpoint = 0;
+   } // if
+   ShowProgress(done);
+   return allOK;
+} // DataMover::ChunkWritten()
+
+// Read the checkpoint file into *cp.
+// Returns 1 if it holds a checkpoint, 0 if it doesn't exist or is empty
+// (so a new move may start), or -1 if it holds anything else.
+int DataMover::LoadCheckpoint(MoveCheckpoint *cp) {
+   ifstream file(checkpointFile.c_str(), ios::in | ios::binary);
+   int retval = 0;
+
+   if (file.is_open()) {
+      file.seekg(0, ios::end);
+      if (file.tellg() > 0) {
+         file.seekg(0, ios::beg);
+         if (file.read((char*) cp, sizeof(MoveCheckpoint)) &&
+             (cp->signature == MOVE_CHECKPOINT_SIGNATURE))
+            retval = 1;
+         else
+            retval = -1;
+      } // if
+   } // if
+   return retval;
+} // DataMover::LoadCheckpoint()
+
+// Record that done sectors have been copied, and make sure the record
+// reaches the disk.
+// Returns 1 on success, 0 on failure.
+int DataMover::SaveCheckpoint(uint64_t done) {
+   MoveCheckpoint cp;
+   DiskIO file;
+   int allOK = 0;
+
+   memset(&cp, 0, sizeof(cp));
+   cp.signature = MOVE_CHECKPOINT_SIGNATURE;
+   cp.source = source;
+   cp.dest = dest;
+   cp.count = count;
+   cp.done = done;
+   cp.blockSize = blockSize;
+   if (file.OpenForWrite(checkpointFile) && file.Seek(0))
+      allOK = (file.Write(&cp, sizeof(cp)) == (int) sizeof(cp)) && file.Flush();
+   if (!allOK)
+      cerr << "\nUnable to save checkpoint to " << checkpointFile << "! Errno is "
+           << errno << "!\n";
+   file.Close();
+   return allOK;
+} // DataMover::SaveCheckpoint()
+
+// Show how far the move has got, whenever that's another whole percent.
+void DataMover::ShowProgress(uint64_t done) {
+   int percent = (int) (done * 100 / count);
+
+   if (!beQuiet && (percent != lastPercent)) {
+      cout << "\rMoving data: " << percent << "% (" << BytesToIeee(done, blockSize)
+           << " of " << BytesToIeee(count, blockSize) << ")" << flush;
+      lastPercent = percent;
+   } // if
+} // DataMover::ShowProgress()
+
+// Copy numSectors sectors from sector from to sector to. If a checkpoint
+// file has been set and holds a checkpoint for this same move, the copy
+// picks up where that one left off; a checkpoint for a different move is
+// an error, as is a checkpoint file that holds something else. The
+// checkpoint file is left in place (with the move marked as complete), so
+// that the caller can record the data's new location and only then call
+// RemoveCheckpoint(); if that doesn't happen, repeating the move is safe.
+// Returns 1 on success, 0 on failure.
+int DataMover::Move(uint64_t from, uint64_t to, uint64_t numSectors) {
+   DiskIO reader, writer;
+   MoveCheckpoint saved;
+   unsigned char *slots[2];
+   uint64_t distance, chunk, sinceCheckpoint = 0;
+   uintptr_t address;
+   int i, allOK = 1, threaded = 0;
+
+   if ((from == to) || (numSectors == 0))
+      return 1;
+
+   if (!reader.OpenForRead(device) || !writer.OpenForWrite(device)) {
+      cerr << "Unable to open " << device << " to move data! Errno is " << errno << "!\n";
+      return 0;
+   } // if
+   blockSize = reader.GetBlockSize();
+   source = from;
+   dest = to;
+   count = numSectors;
+   start = 0;
+
+   if (checkpointFile != "") {
+      switch (LoadCheckpoint(&saved)) {
+         case 1:
+            if ((saved.source == source) && (saved.dest == dest) && (saved.count == count) &&
+                (saved.blockSize == blockSize) && (saved.done <= count)) {
+               start = saved.done;
+               if (!beQuiet)
+                  cout << "Resuming the move recorded in " << checkpointFile << ", with "
+                       << BytesToIeee(start, blockSize) << " already done.\n";
+            } else {
+               cerr << checkpointFile << " is the checkpoint of a different move!\n";
+               allOK = 0;
+            } // if/else
+            break;
+         case -1:
+            cerr << checkpointFile << " isn't a checkpoint file!\n";
+            allOK = 0;
+            break;
+      } // switch
+   } // if
+
+   // Copy from the end if the new location is later on the disk, so that
+   // any overlap is overwritten only once it's been read. Each chunk is
+   // then written beyond the old location of every chunk after it, so any
+   // chunk size is safe, even with the next chunk being read at the same
+   // time. A chunk can overwrite its own old location, though, so if an
+   // overlapping move is to be resumable, each chunk must be kept within
+   // the distance moved; otherwise one that was only partly written when
+   // the move was interrupted couldn't be copied again.
+   backwards = (dest > source);
+   distance = backwards ? (dest - source) : (source - dest);
+   overlapping = (distance < count);
+   chunkSize = MOVE_CHUNK_SIZE / blockSize;
+   if (chunkSize == 0)
+      chunkSize = 1;
+   if (overlapping && (checkpointFile != "") && (distance < chunkSize))
+      chunkSize = distance;
+   numChunks = (count - start + chunkSize - 1) / chunkSize;
+   lastPercent = -1;
+
+   // Direct I/O has to be used for both reads and writes or for neither,
+   // or the reader could see stale cached data
+   if (allOK && directIO && !(reader.SetDirectIO(1) && writer.SetDirectIO(1))) {
+      reader.SetDirectIO(0);
+      writer.SetDirectIO(0);
+   } // if
+
+   for (i = 0; i < 2; i++) {
+      address = (uintptr_t) buffers.Allocate(chunkSize * blockSize + MOVE_BUFFER_ALIGNMENT);
+      address = (address + MOVE_BUFFER_ALIGNMENT - 1) & ~((uintptr_t) MOVE_BUFFER_ALIGNMENT - 1);
+      slots[i] = (unsigned char*) address;
+   } // for
+
+#ifdef MOVE_USE_THREADS
+   // The reader fills each of the two slots in turn, as the writer (this
+   // thread) empties them.
+   mutex lock;
+   condition_variable changed;
+   int full[2] = {0, 0}, readFailed = 0, stop = 0;
+   thread readerThread;
+   auto readAll = [&]() {
+      uint64_t r;
+      int ok;
+
+      for (r = 0; r < numChunks; r++) {
+         {
+            unique_lock<mutex> guard(lock);
+            while (full[r % 2] && !stop)
+               changed.wait(guard);
+            if (stop)
+               return;
+         }
+         ok = ReadChunk(reader, r, slots[r % 2]);
+         {
+            lock_guard<mutex> guard(lock);
+            if (ok)
+               full[r % 2] = 1;
+            else
+               readFailed = 1;
+         }
+         changed.notify_all();
+         if (!ok)
+            return;
+      } // for
+   };
+
+   if (allOK && (numChunks > 1)) {
+      try {
+         readerThread = thread(readAll);
+         threaded = 1;
+      } catch (...) {
+         // Couldn't start the thread; copy one chunk at a time, below
+      } // try/catch
+   } // if
+   if (threaded) {
+      for (chunk = 0; allOK && (chunk < numChunks); chunk++) {
+         {
+            unique_lock<mutex> guard(lock);
+            while (!full[chunk % 2] && !readFailed)
+               changed.wait(guard);
+            allOK = full[chunk % 2];
+         }
+         if (allOK)
+            allOK = WriteChunk(writer, chunk, slots[chunk % 2]) &&
+                    ChunkWritten(writer, chunk, &sinceCheckpoint);
+         {
+            lock_guard<mutex> guard(lock);
+            full[chunk % 2] = 0;
+            if (!allOK)
+               stop = 1;
+         }
+         changed.notify_all();
+      } // for
+      readerThread.join();
+   } // if
+#endif
+   if (!threaded) {
+      for (chunk = 0; allOK && (chunk < numChunks); chunk++)
+         allOK = ReadChunk(reader, chunk, slots[0]) && WriteChunk(writer, chunk, slots[0]) &&
+                 ChunkWritten(writer, chunk, &sinceCheckpoint);
+   } // if
+
+   if (allOK && !writer.Flush()) {
+      cerr << "\nError " << errno << " flushing data to " << device << "!\n";
+      allOK = 0;
+   } // if
+   if (!beQuiet && (lastPercent >= 0))
+      cout << "\n";
+   reader.Close();
+   writer.Close();
+   buffers.Release();
+   return allOK;
+} // DataMover::Move()
+
+// Delete the checkpoint file, once the moved data's new location has been
+// recorded.
+void DataMover::RemoveCheckpoint(void) {
+   if (checkpointFile != "")
+      remove(checkpointFile.c_str());
+} // DataMover::RemoveCheckpoint()
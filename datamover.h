@@ -0,0 +1,96 @@
+/*
+    datamover.h -- Copies a run of sectors to a new location on the same
+    disk, as when a partition is moved.
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef __DATAMOVER_H
+#define __DATAMOVER_H
+
+#include <stdint.h>
+#include <string>
+#include "diskio.h"
+
+// Data are copied in chunks of up to MOVE_CHUNK_SIZE bytes, one chunk
+// being read while the one before it is written, in buffers aligned on
+// MOVE_BUFFER_ALIGNMENT bytes (enough for direct I/O)
+#define MOVE_CHUNK_SIZE (8 * 1024 * 1024)
+#define MOVE_BUFFER_ALIGNMENT 4096
+
+// When the old and new locations don't overlap, the checkpoint is brought
+// up to date about every MOVE_CHECKPOINT_INTERVAL bytes; when they do, it
+// has to be after every chunk
+#define MOVE_CHECKPOINT_INTERVAL (256 * 1024 * 1024)
+
+#define MOVE_CHECKPOINT_SIGNATURE UINT64_C(0x544E494F504B4843) // "CHKPOINT"
+
+// How far a move has got, as kept in a checkpoint file (in the host's byte
+// order) so that an interrupted move can pick up where it left off.
+struct MoveCheckpoint {
+   uint64_t signature;
+   uint64_t source; // first sector of the old location
+   uint64_t dest; // first sector of the new location
+   uint64_t count; // number of sectors being moved
+   uint64_t done; // number already copied, counted from the end the copy started at
+   uint32_t blockSize;
+   uint32_t reserved;
+};
+
+// Copies count sectors from source to dest on one disk. When the two
+// overlap, the copy runs from whichever end keeps it from overwriting
+// data that it has yet to read, so a partition can be slid along the disk
+// by any distance. Reads and writes go through separate file descriptors
+// (and, in C++11 and later, separate threads), so that the next chunk is
+// being read while the last one is written. If a checkpoint file is given,
+// progress is recorded in it only once the data it covers are safely on
+// the disk, and a later Move() of the same sectors resumes from there.
+class DataMover {
+   protected:
+      std::string device;
+      std::string checkpointFile;
+      int directIO; // 1 to bypass the OS's caches, if possible
+      int beQuiet;
+      IOArena buffers;
+
+      // The move under way....
+      uint32_t blockSize;
+      uint64_t source, dest, count;
+      uint64_t start; // sectors already done when the move (or resumption) began
+      uint64_t chunkSize; // in sectors
+      uint64_t numChunks; // still to go, from start
+      int backwards; // 1 if copying from the end, 0 if from the beginning
+      int overlapping; // 1 if the old and new locations overlap
+      int lastPercent;
+
+      uint64_t ChunkAt(uint64_t chunk, uint64_t *length);
+      int ReadChunk(DiskIO & disk, uint64_t chunk, unsigned char *buffer);
+      int WriteChunk(DiskIO & disk, uint64_t chunk, unsigned char *buffer);
+      int ChunkWritten(DiskIO & disk, uint64_t chunk, uint64_t *sinceCheckpoint);
+      int LoadCheckpoint(MoveCheckpoint *cp);
+      int SaveCheckpoint(uint64_t done);
+      void ShowProgress(uint64_t done);
+   public:
+      DataMover(const std::string & deviceName);
+
+      void SetCheckpointFile(const std::string & filename) {checkpointFile = filename;}
+      void UseDirectIO(int on = 1) {directIO = on;}
+      void BeQuiet(int i = 1) {beQuiet = i;}
+      int Move(uint64_t from, uint64_t to, uint64_t numSectors);
+      void RemoveCheckpoint(void);
+}; // class DataMover
+
+#endif // __DATAMOVER_H
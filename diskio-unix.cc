@@ -27,6 +27,7 @@
 
 #ifdef __linux__
 #include "linux/hdreg.h"
+#include <linux/blkpg.h>
 #endif
 
 #include <iostream>
@@ -260,7 +261,8 @@ uint32_t DiskIO::GetNumSecsPerTrack(void) {
 // Returns 1 on success, 0 if the kernel continues to use the old partition table.
 // (Note that for most OSes, the default of 0 is returned because I've not yet
 // looked into how to test for success in the underlying system calls...)
-int DiskIO::DiskSync(void) {
+// If quiet is set, warnings are left to the caller.
+int DiskIO::DiskSync(int quiet) {
    int i, retval = 0, platformFound = 0;
 
    // If disk isn't open, try to open it....
@@ -271,8 +273,9 @@ int DiskIO::DiskSync(void) {
    if (isOpen) {
       sync();
 #if defined(__APPLE__) || defined(__sun__)
-      cout << "Warning: The kernel may continue to use old or deleted partitions.\n"
-           << "You should reboot or remove the drive.\n";
+      if (!quiet)
+         cout << "Warning: The kernel may continue to use old or deleted partitions.\n"
+              << "You should reboot or remove the drive.\n";
                /* don't know if this helps
                * it definitely will get things on disk though:
                * http://topiks.org/mac-os-x/0321278542/ch12lev1sec8.html */
@@ -286,8 +289,9 @@ int DiskIO::DiskSync(void) {
 #if defined (__FreeBSD__) || defined (__FreeBSD_kernel__)
       sleep(2);
       i = ioctl(fd, DIOCGFLUSH);
-      cout << "Warning: The kernel may continue to use old or deleted partitions.\n"
-           << "You should reboot or remove the drive.\n";
+      if (!quiet)
+         cout << "Warning: The kernel may continue to use old or deleted partitions.\n"
+              << "You should reboot or remove the drive.\n";
       platformFound++;
 #endif
 #ifdef __linux__
@@ -295,15 +299,16 @@ int DiskIO::DiskSync(void) {
       fsync(fd);
       i = ioctl(fd, BLKRRPART);
       if (i) {
-         cout << "Warning: The kernel is still using the old partition table.\n"
-              << "The new table will be used at the next reboot or after you\n"
-              << "run partprobe(8) or kpartx(8)\n";
+         if (!quiet)
+            cout << "Warning: The kernel is still using the old partition table.\n"
+                 << "The new table will be used at the next reboot or after you\n"
+                 << "run partprobe(8) or kpartx(8)\n";
       } else {
          retval = 1;
       } // if/else
       platformFound++;
 #endif
-      if (platformFound == 0)
+      if ((platformFound == 0) && !quiet)
          cerr << "Warning: Platform not recognized!\n";
       if (platformFound > 1)
          cerr << "\nWarning: We seem to be running on multiple platforms!\n";
@@ -311,6 +316,121 @@ int DiskIO::DiskSync(void) {
    return retval;
 } // DiskIO::DiskSync()
 
+// Tell the kernel that partition partNum (numbered from 1) now covers
+// numSectors sectors from startSector. Unlike DiskSync(), this works while
+// the disk is in use, but only for a partition the kernel already knows
+// about and whose start hasn't moved -- one that's simply grown, say.
+// Returns 1 on success, 0 on failure or if the platform can't do this
+// (in which case DiskSync() is the caller's fallback).
+int DiskIO::ResizePartition(int partNum, uint64_t startSector, uint64_t numSectors) {
+   int retval = 0;
+#if defined(__linux__) && defined(BLKPG_RESIZE_PARTITION)
+   struct blkpg_partition part;
+   struct blkpg_ioctl_arg arg;
+
+   // If disk isn't open, try to open it....
+   if (!isOpen) {
+      OpenForRead();
+   } // if
+
+   if (isOpen) {
+      sync();
+      fsync(fd);
+      memset(&part, 0, sizeof(part));
+      part.start = (long long) (startSector * (uint64_t) GetBlockSize());
+      part.length = (long long) (numSectors * (uint64_t) GetBlockSize());
+      part.pno = partNum;
+      arg.op = BLKPG_RESIZE_PARTITION;
+      arg.flags = 0;
+      arg.datalen = sizeof(part);
+      arg.data = &part;
+      retval = (ioctl(fd, BLKPG, &arg) == 0);
+   } // if
+#else
+   (void) partNum;
+   (void) startSector;
+   (void) numSectors;
+#endif
+   return retval;
+} // DiskIO::ResizePartition()
+
+// Make sure that everything written so far has reached the disk, rather
+// than sitting in the OS's caches.
+// Returns 1 on success, 0 on failure (or if the disk isn't open).
+int DiskIO::Flush(void) {
+   int retval = 0;
+
+   if (isOpen)
+      retval = (fsync(fd) == 0);
+   return retval;
+} // DiskIO::Flush()
+
+// Turn direct I/O (bypassing the OS's caches) on or off, for big copies
+// that would otherwise flush everything else out of the cache. While it's
+// on, buffers, lengths, and offsets should all be aligned on the disk's
+// block size.
+// Returns 1 if direct I/O is now on, 0 if it's off (including if the
+// platform or the file can't do it).
+int DiskIO::SetDirectIO(int on) {
+   int retval = 0;
+#if defined(__linux__) && defined(O_DIRECT)
+   int flags;
+
+   if (isOpen) {
+      flags = fcntl(fd, F_GETFL);
+      if (flags != -1) {
+         if (on)
+            flags |= O_DIRECT;
+         else
+            flags &= ~O_DIRECT;
+         retval = (fcntl(fd, F_SETFL, flags) == 0) && on;
+      } // if
+   } // if
+#else
+   (void) on;
+#endif
+   return retval;
+} // DiskIO::SetDirectIO()
+
+// Tell the disk that numSectors sectors from startSector no longer hold
+// anything worth keeping, so that an SSD (or a thinly provisioned volume)
+// can reclaim them. A block device gets a BLKDISCARD; a disk image file
+// has a hole punched in it instead, which is the nearest equivalent and
+// makes this testable without a real SSD. What the sectors read back as
+// afterwards is up to the device.
+// Returns 1 on success, 0 on failure or if the platform can't do this.
+int DiskIO::DiscardSectors(uint64_t startSector, uint64_t numSectors) {
+   int retval = 0;
+#ifdef __linux__
+   uint64_t range[2];
+   struct stat64 st;
+
+   // If disk isn't open, try to open it....
+   if ((!isOpen) || (!openForWrite)) {
+      OpenForWrite();
+   } // if
+
+   if (isOpen) {
+      range[0] = startSector * (uint64_t) GetBlockSize();
+      range[1] = numSectors * (uint64_t) GetBlockSize();
+      if ((fstat64(fd, &st) == 0) && S_ISBLK(st.st_mode)) {
+         retval = (ioctl(fd, BLKDISCARD, range) == 0);
+      } else {
+#ifdef FALLOC_FL_PUNCH_HOLE
+         retval = (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                             (off_t) range[0], (off_t) range[1]) == 0);
+#else
+         errno = EOPNOTSUPP;
+#endif
+      } // if/else
+   } // if
+#else
+   (void) startSector;
+   (void) numSectors;
+#endif
+   return retval;
+} // DiskIO::DiscardSectors()
+
 // Seek to the specified sector. Returns 1 on success, 0 on failure.
 // Note that seeking beyond the end of the file is NOT detected as a failure!
 int DiskIO::Seek(uint64_t sector) {
@@ -334,11 +454,13 @@ int DiskIO::Seek(uint64_t sector) {
 
 // A variant on the standard read() function. Done to work around
 // limitations in FreeBSD concerning the matching of the sector
-// size with the number of bytes read.
+// size with the number of bytes read. Reads of whole sectors go straight
+// into buffer; anything else is staged through the disk's I/O arena.
 // Returns the number of bytes read into buffer.
 int DiskIO::Read(void* buffer, int numBytes) {
    int blockSize, numBlocks, retval = 0;
    char* tempSpace;
+   IOArenaMark mark;
 
    // If disk isn't open, try to open it....
    if (!isOpen) {
@@ -346,21 +468,20 @@ int DiskIO::Read(void* buffer, int numBytes) {
    } // if
 
    if (isOpen) {
-      // Compute required space and allocate memory
       blockSize = GetBlockSize();
+      if ((numBytes > 0) && ((numBytes % blockSize) == 0))
+         return read(fd, buffer, numBytes);
+
+      // Compute required space and allocate it from the arena
       if (numBytes <= blockSize) {
          numBlocks = 1;
-         tempSpace = new char [blockSize];
       } else {
          numBlocks = numBytes / blockSize;
          if ((numBytes % blockSize) != 0)
             numBlocks++;
-         tempSpace = new char [numBlocks * blockSize];
       } // if/else
-      if (tempSpace == NULL) {
-         cerr << "Unable to allocate memory in DiskIO::Read()! Terminating!\n";
-         exit(1);
-      } // if
+      mark = arena.Mark();
+      tempSpace = (char*) arena.Allocate(numBlocks * blockSize);
 
       // Read the data into temporary space, then copy it to buffer
       retval = read(fd, tempSpace, numBlocks * blockSize);
@@ -370,18 +491,20 @@ int DiskIO::Read(void* buffer, int numBytes) {
       if (((numBlocks * blockSize) != numBytes) && (retval > 0))
          retval = numBytes;
 
-      delete[] tempSpace;
+      arena.Rewind(mark);
    } // if (isOpen)
    return retval;
 } // DiskIO::Read()
 
 // A variant on the standard write() function. Done to work around
 // limitations in FreeBSD concerning the matching of the sector
-// size with the number of bytes read.
+// size with the number of bytes read. As with Read(), only partial
+// sectors are staged through the I/O arena.
 // Returns the number of bytes written.
 int DiskIO::Write(void* buffer, int numBytes) {
-   int blockSize, i, numBlocks, retval = 0;
+   int blockSize, numBlocks, retval = 0;
    char* tempSpace;
+   IOArenaMark mark;
 
    // If disk isn't open, try to open it....
    if ((!isOpen) || (!openForWrite)) {
@@ -389,33 +512,30 @@ int DiskIO::Write(void* buffer, int numBytes) {
    } // if
 
    if (isOpen) {
-      // Compute required space and allocate memory
       blockSize = GetBlockSize();
+      if ((numBytes > 0) && ((numBytes % blockSize) == 0))
+         return write(fd, buffer, numBytes);
+
+      // Compute required space and allocate it from the arena
       if (numBytes <= blockSize) {
          numBlocks = 1;
-         tempSpace = new char [blockSize];
       } else {
          numBlocks = numBytes / blockSize;
          if ((numBytes % blockSize) != 0) numBlocks++;
-         tempSpace = new char [numBlocks * blockSize];
       } // if/else
-      if (tempSpace == NULL) {
-         cerr << "Unable to allocate memory in DiskIO::Write()! Terminating!\n";
-         exit(1);
-      } // if
-      
+      mark = arena.Mark();
+      tempSpace = (char*) arena.Allocate(numBlocks * blockSize);
+
       // Copy the data to my own buffer, then write it
       memcpy(tempSpace, buffer, numBytes);
-      for (i = numBytes; i < numBlocks * blockSize; i++) {
-         tempSpace[i] = 0;
-      } // for
+      memset(tempSpace + numBytes, 0, numBlocks * blockSize - numBytes);
       retval = write(fd, tempSpace, numBlocks * blockSize);
 
       // Adjust the return value, if necessary....
       if (((numBlocks * blockSize) != numBytes) && (retval > 0))
          retval = numBytes;
 
-      delete[] tempSpace;
+      arena.Rewind(mark);
    } // if (isOpen)
    return retval;
 } // DiskIO:Write()
@@ -165,7 +165,8 @@ uint32_t DiskIO::GetNumSecsPerTrack(void) {
 // Resync disk caches so the OS uses the new partition table. This code varies
 // a lot from one OS to another.
 // Returns 1 on success, 0 if the kernel continues to use the old partition table.
-int DiskIO::DiskSync(void) {
+// If quiet is set, the outcome is left to the caller to report.
+int DiskIO::DiskSync(int quiet) {
    DWORD i;
    GET_LENGTH_INFORMATION buf;
    int retval = 0;
@@ -177,21 +178,51 @@ int DiskIO::DiskSync(void) {
 
    if (isOpen) {
       if (DeviceIoControl(fd, IOCTL_DISK_UPDATE_PROPERTIES, NULL, 0, &buf, sizeof(buf), &i, NULL) == 0) {
-         cout << "Disk synchronization failed! The computer may use the old partition table\n"
-              << "until you reboot or remove and re-insert the disk!\n";
+         if (!quiet)
+            cout << "Disk synchronization failed! The computer may use the old partition table\n"
+                 << "until you reboot or remove and re-insert the disk!\n";
       } else {
-         cout << "Disk synchronization succeeded! The computer should now use the new\n"
-              << "partition table.\n";
+         if (!quiet)
+            cout << "Disk synchronization succeeded! The computer should now use the new\n"
+                 << "partition table.\n";
          retval = 1;
       } // if/else
    } else {
-      cout << "Unable to open the disk for synchronization operation! The computer will\n"
-           << "continue to use the old partition table until you reboot or remove and\n"
-           << "re-insert the disk!\n";
+      if (!quiet)
+         cout << "Unable to open the disk for synchronization operation! The computer will\n"
+              << "continue to use the old partition table until you reboot or remove and\n"
+              << "re-insert the disk!\n";
    } // if (isOpen)
    return retval;
 } // DiskIO::DiskSync()
 
+// Tell the OS that one partition has been resized in place. Windows has no
+// such call, so this always returns 0 and the caller uses DiskSync().
+int DiskIO::ResizePartition(int partNum, uint64_t startSector, uint64_t numSectors) {
+   return 0;
+} // DiskIO::ResizePartition()
+
+// Discard sectors, as on an SSD. Not supported under Windows.
+int DiskIO::DiscardSectors(uint64_t startSector, uint64_t numSectors) {
+   return 0;
+} // DiskIO::DiscardSectors()
+
+// Make sure that everything written so far has reached the disk.
+// Returns 1 on success, 0 on failure (or if the disk isn't open).
+int DiskIO::Flush(void) {
+   int retval = 0;
+
+   if (isOpen)
+      retval = (FlushFileBuffers(fd) != 0);
+   return retval;
+} // DiskIO::Flush()
+
+// Turn direct (uncached) I/O on or off. The disk isn't opened in a way that
+// allows this under Windows, so this always returns 0 (direct I/O is off).
+int DiskIO::SetDirectIO(int on) {
+   return 0;
+} // DiskIO::SetDirectIO()
+
 // Seek to the specified sector. Returns 1 on success, 0 on failure.
 int DiskIO::Seek(uint64_t sector) {
    int retval = 1;
@@ -216,12 +247,15 @@ int DiskIO::Seek(uint64_t sector) {
 
 // A variant on the standard read() function. Done to work around
 // limitations in FreeBSD concerning the matching of the sector
-// size with the number of bytes read.
+// size with the number of bytes read. The data's staged through the disk's
+// I/O arena, whose allocations are better aligned than the caller's buffer
+// may be.
 // Returns the number of bytes read into buffer.
 int DiskIO::Read(void* buffer, int numBytes) {
    int blockSize = 512, i, numBlocks;
    char* tempSpace;
    DWORD retval = 0;
+   IOArenaMark mark;
 
    // If disk isn't open, try to open it....
    if (!isOpen) {
@@ -229,21 +263,17 @@ int DiskIO::Read(void* buffer, int numBytes) {
    } // if
 
    if (isOpen) {
-      // Compute required space and allocate memory
+      // Compute required space and allocate it from the arena
       blockSize = GetBlockSize();
       if (numBytes <= blockSize) {
          numBlocks = 1;
-         tempSpace = new char [blockSize];
       } else {
          numBlocks = numBytes / blockSize;
          if ((numBytes % blockSize) != 0)
             numBlocks++;
-         tempSpace = new char [numBlocks * blockSize];
       } // if/else
-      if (tempSpace == NULL) {
-         cerr << "Unable to allocate memory in DiskIO::Read()! Terminating!\n";
-         exit(1);
-      } // if
+      mark = arena.Mark();
+      tempSpace = (char*) arena.Allocate(numBlocks * blockSize);
 
       // Read the data into temporary space, then copy it to buffer
       ReadFile(fd, tempSpace, numBlocks * blockSize, &retval, NULL);
@@ -255,17 +285,19 @@ int DiskIO::Read(void* buffer, int numBytes) {
       if (((numBlocks * blockSize) != numBytes) && (retval > 0))
          retval = numBytes;
 
-      delete[] tempSpace;
+      arena.Rewind(mark);
    } // if (isOpen)
    return retval;
 } // DiskIO::Read()
 
-// A variant on the standard write() function.
+// A variant on the standard write() function. As with Read(), the data's
+// staged through the disk's I/O arena.
 // Returns the number of bytes written.
 int DiskIO::Write(void* buffer, int numBytes) {
    int blockSize = 512, i, numBlocks, retval = 0;
    char* tempSpace;
    DWORD numWritten;
+   IOArenaMark mark;
 
    // If disk isn't open, try to open it....
    if ((!isOpen) || (!openForWrite)) {
@@ -273,20 +305,16 @@ int DiskIO::Write(void* buffer, int numBytes) {
    } // if
 
    if (isOpen) {
-      // Compute required space and allocate memory
+      // Compute required space and allocate it from the arena
       blockSize = GetBlockSize();
       if (numBytes <= blockSize) {
          numBlocks = 1;
-         tempSpace = new char [blockSize];
       } else {
          numBlocks = numBytes / blockSize;
          if ((numBytes % blockSize) != 0) numBlocks++;
-         tempSpace = new char [numBlocks * blockSize];
       } // if/else
-      if (tempSpace == NULL) {
-         cerr << "Unable to allocate memory in DiskIO::Write()! Terminating!\n";
-         exit(1);
-      } // if
+      mark = arena.Mark();
+      tempSpace = (char*) arena.Allocate(numBlocks * blockSize);
 
       // Copy the data to my own buffer, then write it
       for (i = 0; i < numBytes; i++) {
@@ -302,7 +330,7 @@ int DiskIO::Write(void* buffer, int numBytes) {
       if (((numBlocks * blockSize) != numBytes) && (retval > 0))
          retval = numBytes;
 
-      delete[] tempSpace;
+      arena.Rewind(mark);
    } // if (isOpen)
    return retval;
 } // DiskIO:Write()
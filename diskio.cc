@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <iostream>
+#include <algorithm>
 
 #include "support.h"
 #include "diskio.h"
@@ -38,6 +39,100 @@
 
 using namespace std;
 
+/****************************************
+ *                                      *
+ * IOArena: staging space for disk I/O  *
+ *                                      *
+ ****************************************/
+
+IOArena::IOArena(void) {
+   current = used = 0;
+} // IOArena constructor
+
+// Staging space isn't shared, so a copy gets its own, empty, arena.
+IOArena::IOArena(const IOArena &) {
+   current = used = 0;
+} // IOArena copy constructor
+
+IOArena::~IOArena(void) {
+   size_t i;
+
+   for (i = 0; i < blocks.size(); i++)
+      delete[] blocks[i];
+} // IOArena destructor
+
+// As with the copy constructor, the arena's own blocks are kept.
+IOArena & IOArena::operator=(const IOArena &) {
+   return *this;
+} // IOArena::operator=()
+
+// Returns the first aligned byte of the specified block.
+unsigned char* IOArena::BlockStart(size_t block) {
+   uintptr_t start = (uintptr_t) blocks[block];
+
+   start = (start + IO_ARENA_ALIGNMENT - 1) & ~((uintptr_t) IO_ARENA_ALIGNMENT - 1);
+   return (unsigned char*) start;
+} // IOArena::BlockStart()
+
+// Returns numBytes of uninitialized, aligned space, which remains valid until
+// the arena is rewound past it or released. If the current block is full,
+// moves on to the next one, replacing it with a bigger one if it's too small;
+// new blocks are only allocated when the arena has never needed so much.
+void* IOArena::Allocate(size_t numBytes) {
+   size_t size;
+
+   used = (used + IO_ARENA_ALIGNMENT - 1) & ~((size_t) IO_ARENA_ALIGNMENT - 1);
+   if (blocks.empty() || (used + numBytes > sizes[current])) {
+      // Nothing's in use in the current block if used == 0, so reuse it
+      if (!blocks.empty() && (used > 0))
+         current++;
+      if (current == blocks.size()) {
+         blocks.push_back(NULL);
+         sizes.push_back(0);
+      } // if
+      if (sizes[current] < numBytes) {
+         delete[] blocks[current];
+         size = max(numBytes, (size_t) IO_ARENA_BLOCK_SIZE);
+         blocks[current] = new unsigned char[size + IO_ARENA_ALIGNMENT];
+         if (blocks[current] == NULL) {
+            cerr << "Unable to allocate memory in IOArena::Allocate()! Terminating!\n";
+            exit(1);
+         } // if
+         sizes[current] = size;
+      } // if
+      used = 0;
+   } // if
+   used += numBytes;
+   return BlockStart(current) + used - numBytes;
+} // IOArena::Allocate()
+
+// Returns the arena's current position, to be passed to Rewind() once the
+// space allocated after it is no longer needed.
+IOArenaMark IOArena::Mark(void) const {
+   IOArenaMark mark;
+
+   mark.block = current;
+   mark.used = used;
+   return mark;
+} // IOArena::Mark()
+
+// Free everything allocated since mark was taken.
+void IOArena::Rewind(const IOArenaMark & mark) {
+   current = mark.block;
+   used = mark.used;
+} // IOArena::Rewind()
+
+// Free everything allocated from the arena. Its blocks are kept for reuse.
+void IOArena::Release(void) {
+   current = used = 0;
+} // IOArena::Release()
+
+/****************************************
+ *                                      *
+ * DiskIO: platform-independent methods *
+ *                                      *
+ ****************************************/
+
 DiskIO::DiskIO(void) {
    userFilename = "";
    realFilename = "";
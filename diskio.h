@@ -16,6 +16,7 @@
 #define __DISKIO_H
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include <sys/types.h>
 #ifdef _WIN32
@@ -43,6 +44,42 @@
  *                                     *
  ***************************************/
 
+// Allocations from an IOArena are aligned to this many bytes, and its
+// blocks are at least IO_ARENA_BLOCK_SIZE bytes
+#define IO_ARENA_ALIGNMENT 64
+#define IO_ARENA_BLOCK_SIZE (1024 * 1024)
+
+// How far into an IOArena its allocations had got; see IOArena::Mark()
+struct IOArenaMark {
+   size_t block;
+   size_t used;
+};
+
+// A bump allocator for the temporary buffers that disk I/O is staged
+// through. It hands out raw, aligned bytes (no objects are constructed)
+// from a few big blocks, and takes them back all at once, either by
+// rewinding to a Mark() or with Release() at the end of a load or save.
+// The blocks are kept for reuse, so once they've grown big enough, staging
+// I/O doesn't touch the heap. A copy starts out empty.
+class IOArena {
+   protected:
+      std::vector<unsigned char*> blocks;
+      std::vector<size_t> sizes; // usable bytes in each of blocks
+      size_t current; // block now being allocated from
+      size_t used; // bytes of it in use
+      unsigned char* BlockStart(size_t block);
+   public:
+      IOArena(void);
+      IOArena(const IOArena & orig);
+      ~IOArena(void);
+      IOArena & operator=(const IOArena & orig);
+
+      void* Allocate(size_t numBytes);
+      IOArenaMark Mark(void) const;
+      void Rewind(const IOArenaMark & mark);
+      void Release(void);
+}; // class IOArena
+
 class DiskIO {
    protected:
       std::string userFilename;
@@ -50,6 +87,7 @@ class DiskIO {
       std::string modelName;
       int isOpen;
       int openForWrite;
+      IOArena arena;
 #ifdef _WIN32
       HANDLE fd;
 #else
@@ -68,7 +106,11 @@ class DiskIO {
       int Seek(uint64_t sector);
       int Read(void* buffer, int numBytes);
       int Write(void* buffer, int numBytes);
-      int DiskSync(void); // resync disk caches to use new partitions
+      int DiskSync(int quiet = 0); // resync disk caches to use new partitions
+      int ResizePartition(int partNum, uint64_t startSector, uint64_t numSectors);
+      int Flush(void); // push written data out of the OS's caches
+      int SetDirectIO(int on);
+      int DiscardSectors(uint64_t startSector, uint64_t numSectors);
       int GetBlockSize(void);
       int GetPhysBlockSize(void);
       std::string GetModel(void) {return modelName;}
@@ -77,6 +119,7 @@ class DiskIO {
       int IsOpen(void) {return isOpen;}
       int IsOpenForWrite(void) {return openForWrite;}
       std::string GetName(void) const {return realFilename;}
+      IOArena & Arena(void) {return arena;}
 
       uint64_t DiskSize(int* err);
 }; // class DiskIO
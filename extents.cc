@@ -0,0 +1,144 @@
+/*
+    extents.cc -- Helpers for reasoning about ranges of sectors on a disk,
+    shared by the GPT and MBR code.
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#define __STDC_LIMIT_MACROS
+#define __STDC_CONSTANT_MACROS
+
+#include <algorithm>
+#include "extents.h"
+
+using namespace std;
+
+// Sort extents by starting sector, breaking ties on the index so that the
+// results don't depend on the input order.
+static bool StartsBefore(const Extent & a, const Extent & b) {
+   if (a.firstLBA != b.firstLBA)
+      return a.firstLBA < b.firstLBA;
+   return a.index < b.index;
+} // StartsBefore()
+
+// Heap comparison; puts the extent that ends first at the top of the heap.
+static bool EndsAfter(const Extent & a, const Extent & b) {
+   return a.lastLBA > b.lastLBA;
+} // EndsAfter()
+
+static bool OverlapBefore(const ExtentOverlap & a, const ExtentOverlap & b) {
+   if (a.low != b.low)
+      return a.low < b.low;
+   return a.high < b.high;
+} // OverlapBefore()
+
+// Sweep across the disk in order of starting sector, keeping a heap of the
+// extents that are still "open" (that haven't yet ended). Before each extent
+// is added, any open extents that end before it begins are dropped; every
+// extent that remains open at that point overlaps the new one.
+void FindExtentOverlaps(vector<Extent> & extents, vector<ExtentOverlap> & overlaps) {
+   vector<Extent> open;
+   ExtentOverlap overlap;
+   size_t i, j;
+
+   overlaps.clear();
+   sort(extents.begin(), extents.end(), StartsBefore);
+   for (i = 0; i < extents.size(); i++) {
+      while ((!open.empty()) && (open.front().lastLBA < extents[i].firstLBA)) {
+         pop_heap(open.begin(), open.end(), EndsAfter);
+         open.pop_back();
+      } // while
+      for (j = 0; j < open.size(); j++) {
+         overlap.low = min(open[j].index, extents[i].index);
+         overlap.high = max(open[j].index, extents[i].index);
+         overlaps.push_back(overlap);
+      } // for
+      open.push_back(extents[i]);
+      push_heap(open.begin(), open.end(), EndsAfter);
+   } // for
+   sort(overlaps.begin(), overlaps.end(), OverlapBefore);
+} // FindExtentOverlaps()
+
+// Walk the used extents in order of starting sector, recording any gap
+// between the end of the space covered so far and the start of the next
+// used extent.
+void FindFreeExtents(vector<Extent> & used, uint64_t first, uint64_t last,
+                     vector<Extent> & freeSpace) {
+   Extent gap;
+   uint64_t next = first; // first sector not yet known to be used
+   size_t i = 0;
+   int done = (first > last);
+
+   freeSpace.clear();
+   sort(used.begin(), used.end(), StartsBefore);
+   while ((!done) && (i < used.size()) && (used[i].firstLBA <= last)) {
+      if (used[i].lastLBA >= next) {
+         if (used[i].firstLBA > next) {
+            gap.firstLBA = next;
+            gap.lastLBA = used[i].firstLBA - 1;
+            gap.index = freeSpace.size();
+            freeSpace.push_back(gap);
+         } // if
+         if (used[i].lastLBA >= last)
+            done = 1;
+         else
+            next = used[i].lastLBA + 1;
+      } // if
+      i++;
+   } // while
+   if (!done) {
+      gap.firstLBA = next;
+      gap.lastLBA = last;
+      gap.index = freeSpace.size();
+      freeSpace.push_back(gap);
+   } // if
+} // FindFreeExtents()
+
+int FindExtent(const vector<Extent> & extents, uint64_t sector) {
+   size_t low = 0, high = extents.size(), mid;
+
+   // Find the first extent that begins after sector; the one before it
+   // is the only one that can hold sector.
+   while (low < high) {
+      mid = low + (high - low) / 2;
+      if (extents[mid].firstLBA <= sector)
+         low = mid + 1;
+      else
+         high = mid;
+   } // while
+   if ((low > 0) && (extents[low - 1].lastLBA >= sector))
+      return (int) (low - 1);
+   return -1;
+} // FindExtent()
+
+void MergeExtents(vector<Extent> & extents) {
+   size_t i, last = 0;
+
+   if (extents.empty())
+      return;
+   sort(extents.begin(), extents.end(), StartsBefore);
+   for (i = 1; i < extents.size(); i++) {
+      if ((extents[last].lastLBA == UINT64_MAX) ||
+          (extents[i].firstLBA <= extents[last].lastLBA + 1)) {
+         extents[last].lastLBA = max(extents[last].lastLBA, extents[i].lastLBA);
+      } else {
+         extents[++last] = extents[i];
+      } // if/else
+   } // for
+   extents.resize(last + 1);
+   for (i = 0; i < extents.size(); i++)
+      extents[i].index = i;
+} // MergeExtents()
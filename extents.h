@@ -0,0 +1,66 @@
+/*
+    extents.h -- Helpers for reasoning about ranges of sectors on a disk,
+    shared by the GPT and MBR code.
+    Copyright (C) 2026 agent <agent@local>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef __EXTENTS_H
+#define __EXTENTS_H
+
+#include <stdint.h>
+#include <vector>
+
+// An inclusive range of sectors (firstLBA through lastLBA), tagged with
+// the index of the partition (or other object) it describes. Callers
+// must ensure that firstLBA <= lastLBA.
+struct Extent {
+   uint64_t firstLBA;
+   uint64_t lastLBA;
+   uint32_t index;
+};
+
+// A pair of overlapping extents, identified by their index values. The
+// lower index is always stored in "low".
+struct ExtentOverlap {
+   uint32_t low;
+   uint32_t high;
+};
+
+// Find all pairs of overlapping extents in the input. Uses a sort-and-sweep
+// algorithm, so the cost is O(n log n) plus the number of overlaps found,
+// rather than the O(n^2) of comparing every pair. The input vector is
+// reordered. The output is sorted by low index, then by high index.
+void FindExtentOverlaps(std::vector<Extent> & extents, std::vector<ExtentOverlap> & overlaps);
+
+// Find the gaps between the used extents that lie within the range from
+// first to last, inclusive. The free extents come back sorted, with their
+// index values set to their positions in freeSpace. The used vector is
+// reordered, and its extents may overlap one another.
+void FindFreeExtents(std::vector<Extent> & used, uint64_t first, uint64_t last,
+                     std::vector<Extent> & freeSpace);
+
+// Return the position of the extent that holds sector, or -1 if there is
+// none. The extents must be sorted and non-overlapping, as returned by
+// FindFreeExtents(); a binary search is used.
+int FindExtent(const std::vector<Extent> & extents, uint64_t sector);
+
+// Sort the extents and combine any that overlap or abut one another, so
+// that each run of sectors they cover is described by one extent. The
+// merged extents' index values are set to their positions in the vector.
+void MergeExtents(std::vector<Extent> & extents);
+
+#endif // __EXTENTS_H
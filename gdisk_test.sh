@@ -17,7 +17,7 @@
 # 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 #
 #
-# Requires: coreutils (mktemp, dd) and 64M of disk space in /tmp (temp dd disk)
+# Requires: coreutils (mktemp, dd, md5sum, stat) and 64M of disk space in /tmp (temp dd disk)
 #
 # This script test gdisk commands through the following scenario:
 # - Initialize a new GPT table
@@ -28,6 +28,12 @@
 # - Delete the single partition
 # - Restore from backup file the GPT table
 # - Wipe the GPT table
+# - Grow a partition into added disk space (sgdisk -X)
+# - Move a partition by a small and a large offset (sgdisk -M)
+# - Wipe old signatures from a new partition (sgdisk -W)
+# - Discard the free space of the temp disk (sgdisk -K free)
+# - Replicate the GPT table to a list of disks (sgdisk -R)
+# - Rename a partition by its unique GUID after -r (sgdisk -c)
 
 # TODO
 # Try to generate a wrong GPT table to detect problems (test --verify)
@@ -363,6 +369,244 @@ EOF
 	pretty_print "SUCCESS" "EOF successfully exit gdisk"
 }
 
+#####################################
+# Print the first or last sector ($2)
+# of partition $3 on disk image $1
+#####################################
+get_part_sector() {
+	$SGDISK_BIN -i $3 $1 | awk -v field="$2" '$1 == field { print $3 }'
+}
+
+#####################################
+# Grow the last partition into space
+# added at the end of the disk
+#####################################
+grow_partition() {
+	GROW_DISK=$(mktemp)
+	dd if=/dev/zero of=$GROW_DISK bs=1024 count=$((TEMP_DISK_SIZE / 2)) > /dev/null 2>&1
+	$SGDISK_BIN $GROW_DISK -${OPT_CLEAR} -${OPT_NEW} 1:0:0 > /dev/null
+	OLD_LAST=$(get_part_sector $GROW_DISK Last 1)
+
+	# extend the "disk" to 64 MiB, as when a virtual disk is resized
+	dd if=/dev/zero of=$GROW_DISK bs=1024 seek=$((TEMP_DISK_SIZE / 2)) count=$((TEMP_DISK_SIZE / 2)) > /dev/null 2>&1
+	$SGDISK_BIN $GROW_DISK -X 1 > /dev/null
+	NEW_LAST=$(get_part_sector $GROW_DISK Last 1)
+
+	# the partition must reach the last usable sector (before the
+	# 33 sectors of the backup table) and the table must verify cleanly
+	if [ "$NEW_LAST" = "$((TEMP_DISK_SIZE * 2 - 34))" ] && \
+	   $SGDISK_BIN $GROW_DISK -v | grep -q "No problems found"
+	then
+		pretty_print "SUCCESS" "Partition 1 grown from sector $OLD_LAST to $NEW_LAST"
+	else
+		pretty_print "FAILED" "Unable to grow partition 1 (last sector $OLD_LAST -> $NEW_LAST)"
+		exit 1
+	fi
+	rm -f $GROW_DISK
+}
+
+#####################################
+# Print the MD5 sum of $3 sectors
+# of disk image $1 from sector $2
+#####################################
+get_sectors_md5() {
+	dd if=$1 bs=512 skip=$2 count=$3 2> /dev/null | md5sum | cut -d' ' -f1
+}
+
+#####################################
+# Move a partition's data by a small
+# (overlapping) and a large offset
+#####################################
+move_partition() {
+	MOVE_DISK=$(mktemp)
+	dd if=/dev/zero of=$MOVE_DISK bs=1024 count=$TEMP_DISK_SIZE > /dev/null 2>&1
+	# a 16 MiB partition, filled with random data
+	$SGDISK_BIN $MOVE_DISK -${OPT_CLEAR} -${OPT_NEW} 1:2048:+16M > /dev/null
+	dd if=/dev/urandom of=$MOVE_DISK bs=512 seek=2048 count=32768 conv=notrunc > /dev/null 2>&1
+	MD5_BEFORE=$(get_sectors_md5 $MOVE_DISK 2048 32768)
+
+	for NEW_START in 2056 40960 2048
+	do
+		$SGDISK_BIN $MOVE_DISK -M 1:$NEW_START > /dev/null
+		if [ "$(get_part_sector $MOVE_DISK First 1)" = "$NEW_START" ] && \
+		   [ "$(get_sectors_md5 $MOVE_DISK $NEW_START 32768)" = "$MD5_BEFORE" ]
+		then
+			pretty_print "SUCCESS" "Partition 1 and its data moved to sector $NEW_START"
+		else
+			pretty_print "FAILED" "Partition 1 data damaged by moving it to sector $NEW_START"
+			exit 1
+		fi
+	done
+	rm -f $MOVE_DISK
+}
+
+#####################################
+# Print the number of non-zero bytes in
+# $3 sectors of disk image $1 from sector $2
+#####################################
+count_nonzero_bytes() {
+	dd if=$1 bs=512 skip=$2 count=$3 2> /dev/null | tr -d '\000' | wc -c | tr -d ' '
+}
+
+#####################################
+# Check that -W zeroes the head and tail
+# of new partitions only
+#####################################
+wipe_signatures() {
+	WIPE_DISK=$(mktemp)
+	dd if=/dev/urandom of=$WIPE_DISK bs=1024 count=$TEMP_DISK_SIZE > /dev/null 2>&1
+	# partition 1 exists beforehand and must be left alone
+	$SGDISK_BIN $WIPE_DISK -${OPT_CLEAR} -${OPT_NEW} 1:2048:+4M > /dev/null
+	MD5_PART1=$(get_sectors_md5 $WIPE_DISK 2048 8192)
+	MD5_MIDDLE=$(get_sectors_md5 $WIPE_DISK 12288 12288)
+
+	# partition 2 covers sectors 10240-34815; only its first
+	# and last 2048 sectors (1 MiB each) should be zeroed
+	$SGDISK_BIN $WIPE_DISK -W -${OPT_NEW} 2:10240:+12M > /dev/null
+	if [ "$(count_nonzero_bytes $WIPE_DISK 10240 2048)" = "0" ] && \
+	   [ "$(count_nonzero_bytes $WIPE_DISK 32768 2048)" = "0" ] && \
+	   [ "$(get_sectors_md5 $WIPE_DISK 12288 12288)" = "$MD5_MIDDLE" ] && \
+	   [ "$(get_sectors_md5 $WIPE_DISK 2048 8192)" = "$MD5_PART1" ]
+	then
+		pretty_print "SUCCESS" "First and last MiB of new partition 2 wiped"
+	else
+		pretty_print "FAILED" "Wrong data wiped when creating partition 2 with -W"
+		exit 1
+	fi
+	rm -f $WIPE_DISK
+}
+
+#####################################
+# Discard (punch holes in) the free
+# space of an image file, and only that
+#####################################
+discard_free_space() {
+	DISCARD_DISK=$(mktemp)
+	dd if=/dev/urandom of=$DISCARD_DISK bs=1024 count=$TEMP_DISK_SIZE > /dev/null 2>&1
+	# free space: sectors 34-2047, 18432-40959 and 57344 to the backup table
+	$SGDISK_BIN $DISCARD_DISK -${OPT_CLEAR} -${OPT_NEW} 1:2048:+8M -${OPT_NEW} 2:40960:+8M > /dev/null
+	MD5_PART1=$(get_sectors_md5 $DISCARD_DISK 2048 16384)
+	MD5_PART2=$(get_sectors_md5 $DISCARD_DISK 40960 16384)
+	MD5_DISK=$(get_sectors_md5 $DISCARD_DISK 0 $((TEMP_DISK_SIZE * 2)))
+	BLOCKS_BEFORE=$(stat -c %b $DISCARD_DISK)
+
+	# with -P, the free space must only be listed
+	$SGDISK_BIN $DISCARD_DISK -P -K free > /dev/null
+	if [ "$(get_sectors_md5 $DISCARD_DISK 0 $((TEMP_DISK_SIZE * 2)))" = "$MD5_DISK" ]
+	then
+		pretty_print "SUCCESS" "Free space left alone by -P -K free"
+	else
+		pretty_print "FAILED" "Free space discarded by -P -K free"
+		exit 1
+	fi
+
+	$SGDISK_BIN $DISCARD_DISK -K free > /dev/null
+	if [ "$(count_nonzero_bytes $DISCARD_DISK 18432 22528)" = "0" ] && \
+	   [ "$(count_nonzero_bytes $DISCARD_DISK 57344 73695)" = "0" ] && \
+	   [ "$(stat -c %b $DISCARD_DISK)" -lt "$BLOCKS_BEFORE" ] && \
+	   [ "$(get_sectors_md5 $DISCARD_DISK 2048 16384)" = "$MD5_PART1" ] && \
+	   [ "$(get_sectors_md5 $DISCARD_DISK 40960 16384)" = "$MD5_PART2" ] && \
+	   $SGDISK_BIN $DISCARD_DISK -v | grep -q "No problems found"
+	then
+		pretty_print "SUCCESS" "Holes punched in free space only"
+	else
+		pretty_print "FAILED" "Unable to discard free space, or partition data damaged"
+		exit 1
+	fi
+	rm -f $DISCARD_DISK
+}
+
+#####################################
+# Print the disk GUID and partitions
+# of disk image $1
+#####################################
+get_table() {
+	$SGDISK_BIN -p $1 | sed -n '/^Disk identifier/p;/^Number/,$p'
+}
+
+#####################################
+# Replicate the partition table to a
+# comma-separated list of disks: a
+# larger one, a too-small one, and one
+# that can't be opened
+#####################################
+replicate_table() {
+	SOURCE_DISK=$(mktemp)
+	REPLICA_DISK_1=$(mktemp)
+	REPLICA_DISK_2=$(mktemp)
+	MISSING_DISK=${REPLICA_DISK_1}.d/missing
+	dd if=/dev/zero of=$SOURCE_DISK bs=1024 count=$TEMP_DISK_SIZE > /dev/null 2>&1
+	dd if=/dev/zero of=$REPLICA_DISK_1 bs=1024 count=$((TEMP_DISK_SIZE * 2)) > /dev/null 2>&1
+	dd if=/dev/zero of=$REPLICA_DISK_2 bs=1024 count=$((TEMP_DISK_SIZE / 8)) > /dev/null 2>&1
+	$SGDISK_BIN $SOURCE_DISK -${OPT_CLEAR} -${OPT_NEW} 1:0:+8M -${OPT_CHANGE_NAME} 1:${TEST_PART_NEWNAME} \
+		-${OPT_NEW} 2:0:+4M -${OPT_CHANGE_TYPE} 2:${TEST_PART_NEWTYPE} > /dev/null
+
+	REPORT=$($SGDISK_BIN $SOURCE_DISK -R ${REPLICA_DISK_1},${REPLICA_DISK_2},${MISSING_DISK} 2> /dev/null)
+	RETURN=$?
+	if [ $RETURN -eq 8 ] && \
+	   echo "$REPORT" | grep -q "^${REPLICA_DISK_1}: OK" && \
+	   echo "$REPORT" | grep -q "^${REPLICA_DISK_2}: too small .*; skipped" && \
+	   echo "$REPORT" | grep -q "^${MISSING_DISK}: unable to open; skipped" && \
+	   echo "$REPORT" | grep -q "to 1 of 3 devices"
+	then
+		pretty_print "SUCCESS" "Each replica's outcome reported"
+	else
+		pretty_print "FAILED" "Wrong report (or return value $RETURN) from replicating to three disks"
+		exit 1
+	fi
+
+	# the larger replica gets the partitions, with its backup header in
+	# its own last sector and its last usable sector to match
+	if [ "$(get_table $REPLICA_DISK_1)" = "$(get_table $SOURCE_DISK)" ] && \
+	   [ "$(dd if=$REPLICA_DISK_1 bs=512 skip=$((TEMP_DISK_SIZE * 4 - 1)) count=1 2> /dev/null | head -c 8)" = "EFI PART" ] && \
+	   $SGDISK_BIN -p $REPLICA_DISK_1 | grep -q "last usable sector is $((TEMP_DISK_SIZE * 4 - 34))$" && \
+	   $SGDISK_BIN $REPLICA_DISK_1 -v | grep -q "No problems found" && \
+	   [ "$(count_nonzero_bytes $REPLICA_DISK_2 0 $((TEMP_DISK_SIZE / 4)))" = "0" ]
+	then
+		pretty_print "SUCCESS" "Partition table replicated to the larger disk only"
+	else
+		pretty_print "FAILED" "Partition table not replicated properly"
+		exit 1
+	fi
+	rm -f $SOURCE_DISK $REPLICA_DISK_1 $REPLICA_DISK_2
+}
+
+#####################################
+# Rename a partition by its unique
+# GUID after moving it with -r
+#####################################
+rename_by_guid() {
+	GUID_DISK=$(mktemp)
+	PART_GUID="00000000-0000-0000-0000-000000000001"
+	dd if=/dev/zero of=$GUID_DISK bs=1024 count=$TEMP_DISK_SIZE > /dev/null 2>&1
+	$SGDISK_BIN $GUID_DISK -${OPT_CLEAR} -${OPT_NEW} 1:0:+1M -u 1:$PART_GUID -${OPT_CHANGE_NAME} 1:p0 \
+		-${OPT_NEW} 2:0:+1M -${OPT_CHANGE_NAME} 2:p1 > /dev/null
+
+	# the GUID is in entry 2 by the time -c looks for it
+	$SGDISK_BIN $GUID_DISK -r 1:2 -${OPT_CHANGE_NAME} ${PART_GUID}:${TEST_PART_NEWNAME} > /dev/null
+	if $SGDISK_BIN $GUID_DISK -i 2 | grep -q "unique GUID: $PART_GUID" && \
+	   $SGDISK_BIN $GUID_DISK -i 2 | grep -q "name: '$TEST_PART_NEWNAME'" && \
+	   $SGDISK_BIN $GUID_DISK -i 1 | grep -q "name: 'p1'"
+	then
+		pretty_print "SUCCESS" "Partition renamed by unique GUID after -r"
+	else
+		pretty_print "FAILED" "Wrong partition renamed by unique GUID after -r"
+		exit 1
+	fi
+
+	# a GUID that matches nothing must stop the other changes being saved
+	$SGDISK_BIN $GUID_DISK -${OPT_CHANGE_NAME} 11111111-0000-0000-0000-000000000001:x \
+		-${OPT_CHANGE_TYPE} 1:${TEST_PART_NEWTYPE} > /dev/null 2>&1
+	if [ $? -eq 4 ] && $SGDISK_BIN $GUID_DISK -i 1 | grep -q "Linux filesystem"
+	then
+		pretty_print "SUCCESS" "Changes not saved when no partition has the unique GUID"
+	else
+		pretty_print "FAILED" "Changes saved although no partition has the unique GUID"
+		exit 1
+	fi
+	rm -f $GUID_DISK
+}
+
 ###################################
 # Main
 ###################################
@@ -396,6 +640,17 @@ do
 	eof_stdin             # only with gdisk
 done
 
+# test the sgdisk-only options
+echo ""
+printf "\033[0;34m**Testing sgdisk-only options**\033[m\n"
+echo ""
+grow_partition
+move_partition
+wipe_signatures
+discard_free_space
+replicate_table
+rename_by_guid
+
 # remove temp files
 rm -f $TEMP_DISK $GPT_BACKUP_FILENAME
 
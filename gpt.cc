@@ -20,12 +20,20 @@
 #include <errno.h>
 #include <iostream>
 #include <algorithm>
+#include <utility>
+#include <sstream>
+#if __cplusplus >= 201103L
+#define GPT_USE_THREADS
+#include <thread>
+#include <atomic>
+#endif
 #include "crc32.h"
 #include "gpt.h"
 #include "bsd.h"
 #include "support.h"
 #include "parttypes.h"
 #include "attributes.h"
+#include "datamover.h"
 #include "diskio.h"
 
 using namespace std;
@@ -55,6 +63,36 @@ static inline uint32_t log2_32(uint32_t v) {
 }
 #endif
 
+// Return the position of the lowest or highest set bit in a non-zero word;
+// used to search the bitmap of used partition entries.
+static inline uint32_t LowestSetBit(uint64_t word) {
+#if defined(__GNUC__)
+   return __builtin_ctzll(word);
+#else
+   uint32_t bit = 0;
+
+   while ((word & 1) == 0) {
+      word >>= 1;
+      bit++;
+   } // while
+   return bit;
+#endif
+} // LowestSetBit()
+
+static inline uint32_t HighestSetBit(uint64_t word) {
+#if defined(__GNUC__)
+   return 63 - __builtin_clzll(word);
+#else
+   uint32_t bit = 63;
+
+   while ((word & (UINT64_C(1) << 63)) == 0) {
+      word <<= 1;
+      bit--;
+   } // while
+   return bit;
+#endif
+} // HighestSetBit()
+
 /****************************************
  *                                      *
  * GPTData class and related structures *
@@ -67,6 +105,7 @@ GPTData::GPTData(void) {
    physBlockSize = 0; // 0 = can't be determined
    diskSize = 0;
    partitions = NULL;
+   partsRefs = NULL;
    state = gpt_valid;
    device = "";
    justLooking = 0;
@@ -79,59 +118,70 @@ GPTData::GPTData(void) {
    sectorAlignment = MIN_AF_ALIGNMENT; // Align partitions on 4096-byte boundaries by default
    beQuiet = 0;
    whichWasUsed = use_new;
+   tablesPending = 0;
+   grownPart = UINT32_MAX;
+   wipeNew = 0;
+   discardNew = 0;
+   undoPointOpen = 0;
+   diskImage = NULL;
+   diskTables[0].partitions = diskTables[1].partitions = NULL;
+   diskTables[0].partsRefs = diskTables[1].partsRefs = NULL;
    mainHeader.numParts = 0;
    mainHeader.firstUsableLBA = 0;
    mainHeader.lastUsableLBA = 0;
    numParts = 0;
+   numUsed = 0;
+   crcLeaves = 0;
+   freeExtentsStale = 1;
    SetGPTSize(NUM_GPT_ENTRIES);
    // Initialize CRC functions...
    chksum_crc32gentab();
 } // GPTData default constructor
 
 GPTData::GPTData(const GPTData & orig) {
-   uint32_t i;
-
-   if (&orig != this) {
-      mainHeader = orig.mainHeader;
-      numParts = orig.numParts;
-      secondHeader = orig.secondHeader;
-      protectiveMBR = orig.protectiveMBR;
-      device = orig.device;
-      blockSize = orig.blockSize;
-      physBlockSize = orig.physBlockSize;
-      diskSize = orig.diskSize;
-      state = orig.state;
-      justLooking = orig.justLooking;
-      mainCrcOk = orig.mainCrcOk;
-      secondCrcOk = orig.secondCrcOk;
-      mainPartsCrcOk = orig.mainPartsCrcOk;
-      secondPartsCrcOk = orig.secondPartsCrcOk;
-      apmFound = orig.apmFound;
-      bsdFound = orig.bsdFound;
-      sectorAlignment = orig.sectorAlignment;
-      beQuiet = orig.beQuiet;
-      whichWasUsed = orig.whichWasUsed;
-
-      myDisk.OpenForRead(orig.myDisk.GetName());
-
-      delete[] partitions;
-      partitions = new GPTPart [numParts];
-      if (partitions == NULL) {
-         cerr << "Error! Could not allocate memory for partitions in GPTData::operator=()!\n"
-              << "Terminating!\n";
-         exit(1);
-      } // if
-      for (i = 0; i < numParts; i++) {
-         partitions[i] = orig.partitions[i];
-      } // for
-   } // if
+   undoPointOpen = 0;
+   diskImage = NULL;
+   diskTables[0].partitions = diskTables[1].partitions = NULL;
+   diskTables[0].partsRefs = diskTables[1].partsRefs = NULL;
+   CopySettings(orig);
+
+   // Share the partition array; it's copied only if and when one of the
+   // two objects changes it (see UnsharePartitions()).
+   partitions = orig.partitions;
+   partsRefs = orig.partsRefs;
+   if (partsRefs != NULL)
+      (*partsRefs)++;
+   usedSlots = orig.usedSlots;
+   numUsed = orig.numUsed;
+   entryCRCs = orig.entryCRCs;
+   crcLeaves = orig.crcLeaves;
+   firstLBAs = orig.firstLBAs;
+   lastLBAs = orig.lastLBAs;
+   guidIndex = orig.guidIndex;
+   guidBuckets = orig.guidBuckets;
+   freeExtentsStale = 1;
 } // GPTData copy constructor
 
+#if __cplusplus >= 201103L
+// Move constructor; takes over orig's partition array, leaving orig empty.
+GPTData::GPTData(GPTData && orig) {
+   undoPointOpen = 0;
+   diskImage = NULL;
+   diskTables[0].partitions = diskTables[1].partitions = NULL;
+   diskTables[0].partsRefs = diskTables[1].partsRefs = NULL;
+   partitions = NULL;
+   partsRefs = NULL;
+   numParts = 0;
+   *this = std::move(orig);
+} // GPTData move constructor
+#endif
+
 // The following constructor loads GPT data from a device file
 GPTData::GPTData(string filename) {
    blockSize = SECTOR_SIZE; // set a default
    diskSize = 0;
    partitions = NULL;
+   partsRefs = NULL;
    state = gpt_invalid;
    device = "";
    justLooking = 0;
@@ -144,9 +194,20 @@ GPTData::GPTData(string filename) {
    sectorAlignment = MIN_AF_ALIGNMENT; // Align partitions on 4096-byte boundaries by default
    beQuiet = 0;
    whichWasUsed = use_new;
+   tablesPending = 0;
+   grownPart = UINT32_MAX;
+   wipeNew = 0;
+   discardNew = 0;
+   undoPointOpen = 0;
+   diskImage = NULL;
+   diskTables[0].partitions = diskTables[1].partitions = NULL;
+   diskTables[0].partsRefs = diskTables[1].partsRefs = NULL;
    mainHeader.numParts = 0;
    mainHeader.lastUsableLBA = 0;
    numParts = 0;
+   numUsed = 0;
+   crcLeaves = 0;
+   freeExtentsStale = 1;
    // Initialize CRC functions...
    chksum_crc32gentab();
    if (!LoadPartitions(filename))
@@ -155,50 +216,139 @@ GPTData::GPTData(string filename) {
 
 // Destructor
 GPTData::~GPTData(void) {
-   delete[] partitions;
+   ClearUndoHistory();
+   ForgetDiskImage();
+   ForgetDiskTables();
+   ReleasePartitions();
 } // GPTData destructor
 
 // Assignment operator
 GPTData & GPTData::operator=(const GPTData & orig) {
-   uint32_t i;
+   if (&orig != this) {
+      ClearUndoHistory();
+      ForgetDiskImage();
+      ForgetDiskTables();
+      CopySettings(orig);
+
+      // Share orig's partition array (copy-on-write); take the new
+      // reference before dropping the old one, in case they're the same.
+      if (orig.partsRefs != NULL)
+         (*orig.partsRefs)++;
+      ReleasePartitions();
+      partitions = orig.partitions;
+      partsRefs = orig.partsRefs;
+      usedSlots = orig.usedSlots;
+      numUsed = orig.numUsed;
+      entryCRCs = orig.entryCRCs;
+      crcLeaves = orig.crcLeaves;
+      firstLBAs = orig.firstLBAs;
+      lastLBAs = orig.lastLBAs;
+      guidIndex = orig.guidIndex;
+      guidBuckets = orig.guidBuckets;
+      freeExtentsStale = 1;
+   } // if
 
+   return *this;
+} // GPTData::operator=()
+
+#if __cplusplus >= 201103L
+// Move assignment operator; takes over orig's partition array and derived
+// data without copying them, leaving orig with an empty table.
+GPTData & GPTData::operator=(GPTData && orig) {
    if (&orig != this) {
-      mainHeader = orig.mainHeader;
-      numParts = orig.numParts;
-      secondHeader = orig.secondHeader;
-      protectiveMBR = orig.protectiveMBR;
-      device = orig.device;
-      blockSize = orig.blockSize;
-      physBlockSize = orig.physBlockSize;
-      diskSize = orig.diskSize;
-      state = orig.state;
-      justLooking = orig.justLooking;
-      mainCrcOk = orig.mainCrcOk;
-      secondCrcOk = orig.secondCrcOk;
-      mainPartsCrcOk = orig.mainPartsCrcOk;
-      secondPartsCrcOk = orig.secondPartsCrcOk;
-      apmFound = orig.apmFound;
-      bsdFound = orig.bsdFound;
-      sectorAlignment = orig.sectorAlignment;
-      beQuiet = orig.beQuiet;
-      whichWasUsed = orig.whichWasUsed;
-
-      myDisk.OpenForRead(orig.myDisk.GetName());
-
-      delete[] partitions;
-      partitions = new GPTPart [numParts];
-      if (partitions == NULL) {
-         cerr << "Error! Could not allocate memory for partitions in GPTData::operator=()!\n"
+      ClearUndoHistory();
+      ForgetDiskImage();
+      ForgetDiskTables();
+      CopySettings(orig);
+
+      ReleasePartitions();
+      partitions = orig.partitions;
+      partsRefs = orig.partsRefs;
+      usedSlots.swap(orig.usedSlots);
+      numUsed = orig.numUsed;
+      entryCRCs.swap(orig.entryCRCs);
+      crcLeaves = orig.crcLeaves;
+      firstLBAs.swap(orig.firstLBAs);
+      lastLBAs.swap(orig.lastLBAs);
+      guidIndex.swap(orig.guidIndex);
+      guidBuckets.swap(orig.guidBuckets);
+      freeExtentsStale = 1;
+
+      orig.partitions = NULL;
+      orig.partsRefs = NULL;
+      orig.numParts = 0;
+      orig.TableChanged();
+   } // if
+
+   return *this;
+} // GPTData::operator=(GPTData &&)
+#endif
+
+// Copy everything but the partition array and the data derived from it
+// (which the copy and move operations handle in their own ways) from orig.
+void GPTData::CopySettings(const GPTData & orig) {
+   mainHeader = orig.mainHeader;
+   numParts = orig.numParts;
+   secondHeader = orig.secondHeader;
+   protectiveMBR = orig.protectiveMBR;
+   device = orig.device;
+   blockSize = orig.blockSize;
+   physBlockSize = orig.physBlockSize;
+   diskSize = orig.diskSize;
+   state = orig.state;
+   justLooking = orig.justLooking;
+   mainCrcOk = orig.mainCrcOk;
+   secondCrcOk = orig.secondCrcOk;
+   mainPartsCrcOk = orig.mainPartsCrcOk;
+   secondPartsCrcOk = orig.secondPartsCrcOk;
+   apmFound = orig.apmFound;
+   bsdFound = orig.bsdFound;
+   sectorAlignment = orig.sectorAlignment;
+   beQuiet = orig.beQuiet;
+   whichWasUsed = orig.whichWasUsed;
+   tablesPending = orig.tablesPending;
+   grownPart = orig.grownPart;
+   wipeNew = orig.wipeNew;
+   discardNew = orig.discardNew;
+
+   myDisk.OpenForRead(orig.myDisk.GetName());
+} // GPTData::CopySettings()
+
+// Give this object a private copy of its partition array if it's currently
+// shared with another GPTData object.
+void GPTData::UnsharePartitions(void) {
+   GPTPart *newParts;
+
+   if ((partsRefs != NULL) && (*partsRefs > 1)) {
+      newParts = new GPTPart [numParts];
+      if (newParts == NULL) {
+         cerr << "Error! Could not allocate memory for partitions in GPTData::UnsharePartitions()!\n"
               << "Terminating!\n";
          exit(1);
       } // if
-      for (i = 0; i < numParts; i++) {
-         partitions[i] = orig.partitions[i];
-      } // for
+      memcpy(newParts, partitions, numParts * sizeof(GPTPart));
+      (*partsRefs)--;
+      partitions = newParts;
+      partsRefs = new uint32_t(1);
+   } // if
+} // GPTData::UnsharePartitions()
+
+// Drop one reference to a shared partition array, deleting the array if
+// that was the last one.
+static void ReleaseSharedArray(GPTPart *parts, uint32_t *refs) {
+   if ((refs != NULL) && (--(*refs) == 0)) {
+      delete[] parts;
+      delete refs;
    } // if
+} // ReleaseSharedArray()
 
-   return *this;
-} // GPTData::operator=()
+// Drop this object's hold on its partition array, deleting the array if
+// no other GPTData object shares it.
+void GPTData::ReleasePartitions(void) {
+   ReleaseSharedArray(partitions, partsRefs);
+   partitions = NULL;
+   partsRefs = NULL;
+} // GPTData::ReleasePartitions()
 
 /*********************************************************************
  *                                                                   *
@@ -208,295 +358,522 @@ GPTData & GPTData::operator=(const GPTData & orig) {
  *********************************************************************/
 
 // Perform detailed verification, reporting on any problems found, but
-// do *NOT* recover from these problems. Returns the total number of
+// do *NOT* recover from these problems (apart from the main header's
+// self-pointer; see CorrectProblems()). Returns the total number of
 // problems identified.
 int GPTData::Verify(void) {
-   int problems = 0, alignProbs = 0;
-   uint32_t i, numSegments, testAlignment = sectorAlignment;
-   uint64_t totalFree, largestSegment;
+   vector<GPTProblem> problems;
+   vector<Extent> freeSpace;
+   uint64_t totalFree = 0, largestSegment = 0;
+   size_t i;
+   int numProblems;
+
+   numProblems = FindProblems(problems, &freeSpace);
+   ShowProblems(problems);
+   CorrectProblems(problems);
+
+   // Available space is only computed if no problems were found, since
+   // problems could affect the results
+   if (numProblems == 0) {
+      for (i = 0; i < freeSpace.size(); i++) {
+         totalFree += freeSpace[i].lastLBA - freeSpace[i].firstLBA + 1;
+         largestSegment = max(largestSegment, freeSpace[i].lastLBA - freeSpace[i].firstLBA + 1);
+      } // for
+      cout << "\nNo problems found. " << totalFree << " free sectors ("
+           << BytesToIeee(totalFree, blockSize) << ") available in "
+           << freeSpace.size() << "\nsegments, the largest of which is "
+           << largestSegment << " (" << BytesToIeee(largestSegment, blockSize)
+           << ") in size.\n";
+   } else {
+      cout << "\nIdentified " << numProblems << " problems!\n";
+   } // if/else
+
+   return (numProblems);
+} // GPTData::Verify()
+
+// Add a problem to the end of problems.
+static void AddProblem(vector<GPTProblem> & problems, ProblemCode code,
+                       ProblemSeverity severity = severity_problem, uint32_t part1 = 0,
+                       uint32_t part2 = 0, uint64_t value1 = 0, uint64_t value2 = 0,
+                       uint64_t value3 = 0) {
+   GPTProblem problem;
+
+   problem.code = code;
+   problem.severity = severity;
+   problem.part1 = part1;
+   problem.part2 = part2;
+   problem.value1 = value1;
+   problem.value2 = value2;
+   problem.value3 = value3;
+   problems.push_back(problem);
+} // AddProblem()
+
+// Check the GPT data for problems, recording each one found in problems
+// (in the order in which Verify() reports them) but printing nothing and
+// changing nothing. The header checks come first; then the partitions are
+// checked in one pass over the table and one sweep over their extents (see
+// SweepPartitions()), and the protective MBR is checked. If no problems
+// are found and freeSpace isn't NULL, it's set to the free blocks between
+// the first and last usable sectors, found from the same sweep.
+// Returns the number of problems found, not counting warnings.
+int GPTData::FindProblems(vector<GPTProblem> & problems, vector<Extent> *freeSpace) {
+   PartitionSweep sweep;
+   vector<ExtentOverlap> mbrOverlaps;
+   uint64_t tableSize = GetTableSizeInSectors(), mainCurrentLBA = mainHeader.currentLBA;
+   size_t k;
+   int numEE, protectiveOnOne, numProblems = 0;
+
+   problems.clear();
+   if (freeSpace != NULL)
+      freeSpace->clear();
 
    // First, check for CRC errors in the GPT data....
-   if (!mainCrcOk) {
-      problems++;
-      cout << "\nProblem: The CRC for the main GPT header is invalid. The main GPT header may\n"
-           << "be corrupt. Consider loading the backup GPT header to rebuild the main GPT\n"
-           << "header ('b' on the recovery & transformation menu). This report may be a false\n"
-           << "alarm if you've already corrected other problems.\n";
-   } // if
-   if (!mainPartsCrcOk) {
-      problems++;
-      cout << "\nProblem: The CRC for the main partition table is invalid. This table may be\n"
-           << "corrupt. Consider loading the backup partition table ('c' on the recovery &\n"
-           << "transformation menu). This report may be a false alarm if you've already\n"
-           << "corrected other problems.\n";
-   } // if
-   if (!secondCrcOk) {
-      problems++;
-      cout << "\nProblem: The CRC for the backup GPT header is invalid. The backup GPT header\n"
-           << "may be corrupt. Consider using the main GPT header to rebuild the backup GPT\n"
-           << "header ('d' on the recovery & transformation menu). This report may be a false\n"
-           << "alarm if you've already corrected other problems.\n";
-   } // if
-   if (!secondPartsCrcOk) {
-      problems++;
-      cout << "\nCaution: The CRC for the backup partition table is invalid. This table may\n"
-           << "be corrupt. This program will automatically create a new backup partition\n"
-           << "table when you save your partitions.\n";
-   } // if
-
-   // Now check that the main and backup headers both point to themselves....
-   if (mainHeader.currentLBA != 1) {
-      problems++;
-      cout << "\nProblem: The main header's self-pointer doesn't point to itself. This problem\n"
-           << "is being automatically corrected, but it may be a symptom of more serious\n"
-           << "problems. Think carefully before saving changes with 'w' or using this disk.\n";
-      mainHeader.currentLBA = 1;
-   } // if
-   if (secondHeader.currentLBA != (diskSize - UINT64_C(1))) {
-      problems++;
-      cout << "\nProblem: The secondary header's self-pointer indicates that it doesn't reside\n"
-           << "at the end of the disk. If you've added a disk to a RAID array, use the 'e'\n"
-           << "option on the experts' menu to adjust the secondary header's and partition\n"
-           << "table's locations.\n";
+   if (!mainCrcOk)
+      AddProblem(problems, problem_main_header_crc);
+   if (!mainPartsCrcOk)
+      AddProblem(problems, problem_main_table_crc);
+   if (!secondCrcOk)
+      AddProblem(problems, problem_second_header_crc);
+   if (!secondPartsCrcOk)
+      AddProblem(problems, problem_second_table_crc);
+
+   // Now check that the main and backup headers both point to themselves.
+   // (Verify() corrects the main header's pointer, so the checks that
+   // follow use the corrected value.)
+   if (mainCurrentLBA != 1) {
+      AddProblem(problems, problem_main_self_pointer, severity_problem, 0, 0, mainCurrentLBA);
+      mainCurrentLBA = 1;
    } // if
+   if (secondHeader.currentLBA != (diskSize - UINT64_C(1)))
+      AddProblem(problems, problem_second_self_pointer, severity_problem, 0, 0,
+                 secondHeader.currentLBA);
 
    // Now check that critical main and backup GPT entries match each other
-   if (mainHeader.currentLBA != secondHeader.backupLBA) {
-      problems++;
-      cout << "\nProblem: main GPT header's current LBA pointer (" << mainHeader.currentLBA
-           << ") doesn't\nmatch the backup GPT header's alternate LBA pointer("
-           << secondHeader.backupLBA << ").\n";
-   } // if
-   if (mainHeader.backupLBA != secondHeader.currentLBA) {
-      problems++;
-      cout << "\nProblem: main GPT header's backup LBA pointer (" << mainHeader.backupLBA
-           << ") doesn't\nmatch the backup GPT header's current LBA pointer ("
-           << secondHeader.currentLBA << ").\n"
-           << "The 'e' option on the experts' menu may fix this problem.\n";
-   } // if
-   if (mainHeader.firstUsableLBA != secondHeader.firstUsableLBA) {
-      problems++;
-      cout << "\nProblem: main GPT header's first usable LBA pointer (" << mainHeader.firstUsableLBA
-           << ") doesn't\nmatch the backup GPT header's first usable LBA pointer ("
-           << secondHeader.firstUsableLBA << ")\n";
-   } // if
-   if (mainHeader.lastUsableLBA != secondHeader.lastUsableLBA) {
-      problems++;
-      cout << "\nProblem: main GPT header's last usable LBA pointer (" << mainHeader.lastUsableLBA
-           << ") doesn't\nmatch the backup GPT header's last usable LBA pointer ("
-           << secondHeader.lastUsableLBA << ")\n"
-           << "The 'e' option on the experts' menu can probably fix this problem.\n";
-   } // if
-   if ((mainHeader.diskGUID != secondHeader.diskGUID)) {
-      problems++;
-      cout << "\nProblem: main header's disk GUID (" << mainHeader.diskGUID
-           << ") doesn't\nmatch the backup GPT header's disk GUID ("
-           << secondHeader.diskGUID << ")\n"
-           << "You should use the 'b' or 'd' option on the recovery & transformation menu to\n"
-           << "select one or the other header.\n";
-   } // if
-   if (mainHeader.numParts != secondHeader.numParts) {
-      problems++;
-      cout << "\nProblem: main GPT header's number of partitions (" << mainHeader.numParts
-           << ") doesn't\nmatch the backup GPT header's number of partitions ("
-           << secondHeader.numParts << ")\n"
-           << "Resizing the partition table ('s' on the experts' menu) may help.\n";
-   } // if
-   if (mainHeader.sizeOfPartitionEntries != secondHeader.sizeOfPartitionEntries) {
-      problems++;
-      cout << "\nProblem: main GPT header's size of partition entries ("
-           << mainHeader.sizeOfPartitionEntries << ") doesn't\n"
-           << "match the backup GPT header's size of partition entries ("
-           << secondHeader.sizeOfPartitionEntries << ")\n"
-           << "You should use the 'b' or 'd' option on the recovery & transformation menu to\n"
-           << "select one or the other header.\n";
-   } // if
+   if (mainCurrentLBA != secondHeader.backupLBA)
+      AddProblem(problems, problem_current_lba_mismatch, severity_problem, 0, 0,
+                 mainCurrentLBA, secondHeader.backupLBA);
+   if (mainHeader.backupLBA != secondHeader.currentLBA)
+      AddProblem(problems, problem_backup_lba_mismatch, severity_problem, 0, 0,
+                 mainHeader.backupLBA, secondHeader.currentLBA);
+   if (mainHeader.firstUsableLBA != secondHeader.firstUsableLBA)
+      AddProblem(problems, problem_first_usable_mismatch, severity_problem, 0, 0,
+                 mainHeader.firstUsableLBA, secondHeader.firstUsableLBA);
+   if (mainHeader.lastUsableLBA != secondHeader.lastUsableLBA)
+      AddProblem(problems, problem_last_usable_mismatch, severity_problem, 0, 0,
+                 mainHeader.lastUsableLBA, secondHeader.lastUsableLBA);
+   if ((mainHeader.diskGUID != secondHeader.diskGUID))
+      AddProblem(problems, problem_disk_guid_mismatch);
+   if (mainHeader.numParts != secondHeader.numParts)
+      AddProblem(problems, problem_num_parts_mismatch, severity_problem, 0, 0,
+                 mainHeader.numParts, secondHeader.numParts);
+   if (mainHeader.sizeOfPartitionEntries != secondHeader.sizeOfPartitionEntries)
+      AddProblem(problems, problem_entry_size_mismatch, severity_problem, 0, 0,
+                 mainHeader.sizeOfPartitionEntries, secondHeader.sizeOfPartitionEntries);
 
    // Now check for a few other miscellaneous problems...
    // Check that the disk size will hold the data...
-   if (mainHeader.backupLBA >= diskSize) {
-      problems++;
-      cout << "\nProblem: Disk is too small to hold all the data!\n"
-           << "(Disk size is " << diskSize << " sectors, needs to be "
-           << mainHeader.backupLBA + UINT64_C(1) << " sectors.)\n"
-           << "The 'e' option on the experts' menu may fix this problem.\n";
-   } // if
+   if (mainHeader.backupLBA >= diskSize)
+      AddProblem(problems, problem_disk_too_small, severity_problem, 0, 0,
+                 diskSize, mainHeader.backupLBA + UINT64_C(1));
 
    // Check the main and backup partition tables for overlap with things and unusual gaps
-   if (mainHeader.partitionEntriesLBA + GetTableSizeInSectors() > mainHeader.firstUsableLBA) {
-       problems++;
-       cout << "\nProblem: Main partition table extends past the first usable LBA.\n"
-            << "Using 'j' on the experts' menu may enable fixing this problem.\n";
-   } // if
-   if (mainHeader.partitionEntriesLBA < 2) {
-       problems++;
-       cout << "\nProblem: Main partition table appears impossibly early on the disk.\n"
-            << "Using 'j' on the experts' menu may enable fixing this problem.\n";
-   } // if
-   if (secondHeader.partitionEntriesLBA + GetTableSizeInSectors() > secondHeader.currentLBA) {
-       problems++;
-       cout << "\nProblem: The backup partition table overlaps the backup header.\n"
-            << "Using 'e' on the experts' menu may fix this problem.\n";
-   } // if
-   if (mainHeader.partitionEntriesLBA != 2) {
-       cout << "\nWarning: There is a gap between the main metadata (sector 1) and the main\n"
-            << "partition table (sector " << mainHeader.partitionEntriesLBA
-            << "). This is helpful in some exotic configurations,\n"
-            << "but is generally ill-advised. Using 'j' on the experts' menu can adjust this\n"
-            << "gap.\n";
-   } // if
-   if (secondHeader.partitionEntriesLBA != diskSize - GetTableSizeInSectors() - 1) {
-       cout << "\nWarning: There is a gap between the secondary partition table (ending at sector\n"
-            << secondHeader.partitionEntriesLBA + GetTableSizeInSectors() - 1
-            << ") and the secondary metadata (sector " << mainHeader.backupLBA << ").\n"
-            << "This is helpful in some exotic configurations, but is generally ill-advised.\n"
-            << "Using 'k' on the experts' menu can adjust this gap.\n";
-   } // if
-   if (mainHeader.partitionEntriesLBA + GetTableSizeInSectors() != mainHeader.firstUsableLBA) {
-       cout << "\nWarning: There is a gap between the main partition table (ending sector "
-            << mainHeader.partitionEntriesLBA + GetTableSizeInSectors() - 1 << ")\n"
-            << "and the first usable sector (" << mainHeader.firstUsableLBA << "). This is helpful in some exotic configurations,\n"
-            << "but is unusual. The util-linux fdisk program often creates disks like this.\n"
-            << "Using 'j' on the experts' menu can adjust this gap.\n";
-   } // if
-
-   if (mainHeader.sizeOfPartitionEntries * mainHeader.numParts < 16384) {
-      cout << "\nWarning: The size of the partition table (" << mainHeader.sizeOfPartitionEntries * mainHeader.numParts
-           << " bytes) is less than the minimum\n"
-           << "required by the GPT specification. Most OSes and tools seem to work fine on\n"
-           << "such disks, but this is a violation of the GPT specification and so may cause\n"
-           << "problems.\n";
-   } // if
-
-   if ((mainHeader.lastUsableLBA >= diskSize) || (mainHeader.lastUsableLBA > mainHeader.backupLBA)) {
-      problems++;
-      cout << "\nProblem: GPT claims the disk is larger than it is! (Claimed last usable\n"
-           << "sector is " << mainHeader.lastUsableLBA << ", but backup header is at\n"
-           << mainHeader.backupLBA << " and disk size is " << diskSize << " sectors.\n"
-           << "The 'e' option on the experts' menu will probably fix this problem\n";
-   }
-
-   // Check for overlapping partitions....
-   problems += FindOverlaps();
-
-   // Check for insane partitions (start after end, hugely big, etc.)
-   problems += FindInsanePartitions();
-
-   // Check for mismatched MBR and GPT partitions...
-   problems += FindHybridMismatches();
+   if (mainHeader.partitionEntriesLBA + tableSize > mainHeader.firstUsableLBA)
+      AddProblem(problems, problem_main_table_past_first_usable);
+   if (mainHeader.partitionEntriesLBA < 2)
+      AddProblem(problems, problem_main_table_too_early);
+   if (secondHeader.partitionEntriesLBA + tableSize > secondHeader.currentLBA)
+      AddProblem(problems, problem_second_table_overlaps_header);
+   if (mainHeader.partitionEntriesLBA != 2)
+      AddProblem(problems, problem_main_table_gap, severity_warning, 0, 0,
+                 mainHeader.partitionEntriesLBA);
+   if (secondHeader.partitionEntriesLBA != diskSize - tableSize - 1)
+      AddProblem(problems, problem_second_table_gap, severity_warning, 0, 0,
+                 secondHeader.partitionEntriesLBA + tableSize - 1, mainHeader.backupLBA);
+   if (mainHeader.partitionEntriesLBA + tableSize != mainHeader.firstUsableLBA)
+      AddProblem(problems, problem_first_usable_gap, severity_warning, 0, 0,
+                 mainHeader.partitionEntriesLBA + tableSize - 1, mainHeader.firstUsableLBA);
+   if (mainHeader.sizeOfPartitionEntries * mainHeader.numParts < 16384)
+      AddProblem(problems, problem_table_too_small, severity_warning, 0, 0,
+                 mainHeader.sizeOfPartitionEntries * mainHeader.numParts);
+   if ((mainHeader.lastUsableLBA >= diskSize) || (mainHeader.lastUsableLBA > mainHeader.backupLBA))
+      AddProblem(problems, problem_last_usable_too_big, severity_problem, 0, 0,
+                 mainHeader.lastUsableLBA, mainHeader.backupLBA, diskSize);
+
+   // Check the partitions: overlaps, insane partitions (start after end,
+   // hugely big, etc.), duplicate GUIDs, and mismatched MBR partitions....
+   SweepPartitions(sweep);
+   problems.insert(problems.end(), sweep.overlaps.begin(), sweep.overlaps.end());
+   problems.insert(problems.end(), sweep.insane.begin(), sweep.insane.end());
+   GetDuplicateGUIDs(problems);
+   GetHybridMismatches(problems);
 
    // Check for MBR-specific problems....
-   problems += VerifyMBR();
-
-   // Check for a 0xEE protective partition that's marked as active....
-   if (protectiveMBR.IsEEActive()) {
-      cout << "\nWarning: The 0xEE protective partition in the MBR is marked as active. This is\n"
-           << "technically a violation of the GPT specification, and can cause some EFIs to\n"
-           << "ignore the disk, but it is required to boot from a GPT disk on some BIOS-based\n"
-           << "computers. You can clear this flag by creating a fresh protective MBR using\n"
-           << "the 'n' option on the experts' menu.\n";
-   }
-
-   // Verify that partitions don't run into GPT data areas....
-   problems += CheckGPTSize();
-
-   if (!protectiveMBR.DoTheyFit()) {
-      cout << "\nPartition(s) in the protective MBR are too big for the disk! Creating a\n"
-           << "fresh protective or hybrid MBR is recommended.\n";
-      problems++;
-   }
+   protectiveMBR.GetOverlaps(mbrOverlaps);
+   for (k = 0; k < mbrOverlaps.size(); k++)
+      AddProblem(problems, problem_mbr_overlap, severity_problem, mbrOverlaps[k].low,
+                 mbrOverlaps[k].high);
+   numEE = protectiveMBR.CountEEParts(&protectiveOnOne);
+   if (numEE > 1)
+      AddProblem(problems, problem_mbr_multiple_ee, severity_warning);
+   if (!protectiveOnOne && (numEE > 0))
+      AddProblem(problems, problem_mbr_ee_not_on_1, severity_warning);
+   if (protectiveMBR.IsEEActive())
+      AddProblem(problems, problem_ee_active, severity_warning);
+
+   // Verify that partitions don't run into GPT data areas, that the MBR
+   // fits, and that partitions are aligned on proper boundaries (for WD
+   // Advanced Format and similar disks)....
+   problems.insert(problems.end(), sweep.size.begin(), sweep.size.end());
+   if (!protectiveMBR.DoTheyFit())
+      AddProblem(problems, problem_mbr_too_big);
+   problems.insert(problems.end(), sweep.alignment.begin(), sweep.alignment.end());
+
+   for (k = 0; k < problems.size(); k++) {
+      if (problems[k].severity == severity_problem)
+         numProblems++;
+   } // for
+   if ((numProblems == 0) && (freeSpace != NULL) && (diskSize > 0))
+      FindFreeExtents(sweep.extents, mainHeader.firstUsableLBA, mainHeader.lastUsableLBA,
+                      *freeSpace);
+   return numProblems;
+} // GPTData::FindProblems()
+
+// Orders overlap reports by the higher-numbered partition, then by the
+// lower-numbered one; used by SweepPartitions().
+static bool HighIndexFirst(const GPTProblem & a, const GPTProblem & b) {
+   if (a.part1 != b.part1)
+      return a.part1 < b.part1;
+   return a.part2 < b.part2;
+} // HighIndexFirst()
+
+// Check the partitions for the problems that FindOverlaps(),
+// FindInsanePartitions(), and CheckGPTSize() report, and for misalignment,
+// in one pass over the used entries and one sorted sweep over their
+// extents. The results go into sweep (which should be empty), each kind in
+// partition order.
+void GPTData::SweepPartitions(PartitionSweep & sweep) {
+   uint32_t i, j, testAlignment = sectorAlignment;
+   uint64_t firstUsedBlock = UINT64_MAX, lastUsedBlock = 0;
+   size_t k, m, numSane;
+   Extent extent;
+   vector<ExtentOverlap> overlaps;
+   vector<uint32_t> insane;
 
-   // Check that partitions are aligned on proper boundaries (for WD Advanced
-   // Format and similar disks)....
    if ((physBlockSize != 0) && (blockSize != 0))
       testAlignment = physBlockSize / blockSize;
    testAlignment = max(testAlignment, sectorAlignment);
    if (testAlignment == 0) // Should not happen; just being paranoid.
       testAlignment = sectorAlignment;
-   for (i = 0; i < numParts; i++) {
-      if ((partitions[i].IsUsed()) && (partitions[i].GetFirstLBA() % testAlignment) != 0) {
-         cout << "\nCaution: Partition " << i + 1 << " doesn't begin on a "
-              << testAlignment << "-sector boundary. This may\nresult "
-              << "in degraded performance on some modern (2009 and later) hard disks.\n";
-         alignProbs++;
-      } // if
-      if ((partitions[i].IsUsed()) && ((partitions[i].GetLastLBA() + 1) % testAlignment) != 0) {
-         cout << "\nCaution: Partition " << i + 1 << " doesn't end on a "
-              << testAlignment << "-sector boundary. This may\nresult "
-              << "in problems with some disk encryption tools.\n";
+
+   for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1)) {
+      if (firstLBAs[i] > lastLBAs[i])
+         AddProblem(sweep.insane, problem_ends_before_start, severity_problem, i);
+      if (lastLBAs[i] >= diskSize)
+         AddProblem(sweep.insane, problem_too_big, severity_problem, i);
+      if ((firstLBAs[i] % testAlignment) != 0)
+         AddProblem(sweep.alignment, problem_start_unaligned, severity_warning, i, 0, testAlignment);
+      if (((lastLBAs[i] + 1) % testAlignment) != 0)
+         AddProblem(sweep.alignment, problem_end_unaligned, severity_warning, i, 0, testAlignment);
+      firstUsedBlock = min(firstUsedBlock, firstLBAs[i]);
+      lastUsedBlock = max(lastUsedBlock, lastLBAs[i]);
+      if (firstLBAs[i] != 0) {
+         if (firstLBAs[i] <= lastLBAs[i]) {
+            extent.firstLBA = firstLBAs[i];
+            extent.lastLBA = lastLBAs[i];
+            extent.index = i;
+            sweep.extents.push_back(extent);
+         } else {
+            insane.push_back(i);
+         } // if/else
       } // if
    } // for
+
+   // Partitions that end before they begin can't take part in the sweep,
+   // so compare them against everything else the slow way. (These are
+   // rare, and are reported as insane, too.)
+   FindExtentOverlaps(sweep.extents, overlaps);
+   for (k = 0; k < overlaps.size(); k++)
+      AddProblem(sweep.overlaps, problem_overlap, severity_problem, overlaps[k].high, overlaps[k].low);
+   numSane = sweep.extents.size();
+   for (k = 0; k < insane.size(); k++) {
+      i = insane[k];
+      for (m = 0; m < numSane; m++) {
+         j = sweep.extents[m].index;
+         if (partitions[max(i, j)].DoTheyOverlap(partitions[min(i, j)]))
+            AddProblem(sweep.overlaps, problem_overlap, severity_problem, max(i, j), min(i, j));
+      } // for m
+      for (m = 0; m < k; m++) {
+         j = insane[m];
+         if (partitions[i].DoTheyOverlap(partitions[j]))
+            AddProblem(sweep.overlaps, problem_overlap, severity_problem, i, j);
+      } // for m
+   } // for k
+   // Report in the order the old all-pairs scan did: by the higher-numbered
+   // partition first, then by the lower-numbered one.
+   sort(sweep.overlaps.begin(), sweep.overlaps.end(), HighIndexFirst);
+
+   // If the disk size is 0 (the default), then it means that various
+   // variables aren't yet set, so the GPT size tests would be useless
+   if (diskSize != 0) {
+      if (mainHeader.firstUsableLBA > firstUsedBlock)
+         AddProblem(sweep.size, problem_main_table_overlaps_part, severity_problem, 0, 0,
+                    mainHeader.firstUsableLBA - firstUsedBlock, firstUsedBlock);
+      if (mainHeader.lastUsableLBA < lastUsedBlock)
+         AddProblem(sweep.size, problem_second_table_overlaps_part, severity_problem, 0, 0,
+                    lastUsedBlock - mainHeader.lastUsableLBA, lastUsedBlock, diskSize);
+   } // if
+} // GPTData::SweepPartitions()
+
+// Make the one correction that verification has always made on its own:
+// pointing a main header that doesn't point to itself back at sector 1.
+void GPTData::CorrectProblems(const vector<GPTProblem> & problems) {
+   size_t i;
+
+   for (i = 0; i < problems.size(); i++) {
+      if (problems[i].code == problem_main_self_pointer)
+         mainHeader.currentLBA = 1;
+   } // for
+} // GPTData::CorrectProblems()
+
+// Describe the problems found by FindProblems() (or by one of the functions
+// that check for particular problems), in the order given.
+void GPTData::ShowProblems(const vector<GPTProblem> & problems) {
+   size_t i;
+   int alignProbs = 0;
+   uint32_t p1, p2;
+
+   for (i = 0; i < problems.size(); i++) {
+      p1 = problems[i].part1;
+      p2 = problems[i].part2;
+      switch (problems[i].code) {
+         case problem_main_header_crc:
+            cout << "\nProblem: The CRC for the main GPT header is invalid. The main GPT header may\n"
+                 << "be corrupt. Consider loading the backup GPT header to rebuild the main GPT\n"
+                 << "header ('b' on the recovery & transformation menu). This report may be a false\n"
+                 << "alarm if you've already corrected other problems.\n";
+            break;
+         case problem_main_table_crc:
+            cout << "\nProblem: The CRC for the main partition table is invalid. This table may be\n"
+                 << "corrupt. Consider loading the backup partition table ('c' on the recovery &\n"
+                 << "transformation menu). This report may be a false alarm if you've already\n"
+                 << "corrected other problems.\n";
+            break;
+         case problem_second_header_crc:
+            cout << "\nProblem: The CRC for the backup GPT header is invalid. The backup GPT header\n"
+                 << "may be corrupt. Consider using the main GPT header to rebuild the backup GPT\n"
+                 << "header ('d' on the recovery & transformation menu). This report may be a false\n"
+                 << "alarm if you've already corrected other problems.\n";
+            break;
+         case problem_second_table_crc:
+            cout << "\nCaution: The CRC for the backup partition table is invalid. This table may\n"
+                 << "be corrupt. This program will automatically create a new backup partition\n"
+                 << "table when you save your partitions.\n";
+            break;
+         case problem_main_self_pointer:
+            cout << "\nProblem: The main header's self-pointer doesn't point to itself. This problem\n"
+                 << "is being automatically corrected, but it may be a symptom of more serious\n"
+                 << "problems. Think carefully before saving changes with 'w' or using this disk.\n";
+            break;
+         case problem_second_self_pointer:
+            cout << "\nProblem: The secondary header's self-pointer indicates that it doesn't reside\n"
+                 << "at the end of the disk. If you've added a disk to a RAID array, use the 'e'\n"
+                 << "option on the experts' menu to adjust the secondary header's and partition\n"
+                 << "table's locations.\n";
+            break;
+         case problem_current_lba_mismatch:
+            cout << "\nProblem: main GPT header's current LBA pointer (" << problems[i].value1
+                 << ") doesn't\nmatch the backup GPT header's alternate LBA pointer("
+                 << problems[i].value2 << ").\n";
+            break;
+         case problem_backup_lba_mismatch:
+            cout << "\nProblem: main GPT header's backup LBA pointer (" << problems[i].value1
+                 << ") doesn't\nmatch the backup GPT header's current LBA pointer ("
+                 << problems[i].value2 << ").\n"
+                 << "The 'e' option on the experts' menu may fix this problem.\n";
+            break;
+         case problem_first_usable_mismatch:
+            cout << "\nProblem: main GPT header's first usable LBA pointer (" << problems[i].value1
+                 << ") doesn't\nmatch the backup GPT header's first usable LBA pointer ("
+                 << problems[i].value2 << ")\n";
+            break;
+         case problem_last_usable_mismatch:
+            cout << "\nProblem: main GPT header's last usable LBA pointer (" << problems[i].value1
+                 << ") doesn't\nmatch the backup GPT header's last usable LBA pointer ("
+                 << problems[i].value2 << ")\n"
+                 << "The 'e' option on the experts' menu can probably fix this problem.\n";
+            break;
+         case problem_disk_guid_mismatch:
+            cout << "\nProblem: main header's disk GUID (" << mainHeader.diskGUID
+                 << ") doesn't\nmatch the backup GPT header's disk GUID ("
+                 << secondHeader.diskGUID << ")\n"
+                 << "You should use the 'b' or 'd' option on the recovery & transformation menu to\n"
+                 << "select one or the other header.\n";
+            break;
+         case problem_num_parts_mismatch:
+            cout << "\nProblem: main GPT header's number of partitions (" << problems[i].value1
+                 << ") doesn't\nmatch the backup GPT header's number of partitions ("
+                 << problems[i].value2 << ")\n"
+                 << "Resizing the partition table ('s' on the experts' menu) may help.\n";
+            break;
+         case problem_entry_size_mismatch:
+            cout << "\nProblem: main GPT header's size of partition entries ("
+                 << problems[i].value1 << ") doesn't\n"
+                 << "match the backup GPT header's size of partition entries ("
+                 << problems[i].value2 << ")\n"
+                 << "You should use the 'b' or 'd' option on the recovery & transformation menu to\n"
+                 << "select one or the other header.\n";
+            break;
+         case problem_disk_too_small:
+            cout << "\nProblem: Disk is too small to hold all the data!\n"
+                 << "(Disk size is " << problems[i].value1 << " sectors, needs to be "
+                 << problems[i].value2 << " sectors.)\n"
+                 << "The 'e' option on the experts' menu may fix this problem.\n";
+            break;
+         case problem_main_table_past_first_usable:
+            cout << "\nProblem: Main partition table extends past the first usable LBA.\n"
+                 << "Using 'j' on the experts' menu may enable fixing this problem.\n";
+            break;
+         case problem_main_table_too_early:
+            cout << "\nProblem: Main partition table appears impossibly early on the disk.\n"
+                 << "Using 'j' on the experts' menu may enable fixing this problem.\n";
+            break;
+         case problem_second_table_overlaps_header:
+            cout << "\nProblem: The backup partition table overlaps the backup header.\n"
+                 << "Using 'e' on the experts' menu may fix this problem.\n";
+            break;
+         case problem_main_table_gap:
+            cout << "\nWarning: There is a gap between the main metadata (sector 1) and the main\n"
+                 << "partition table (sector " << problems[i].value1
+                 << "). This is helpful in some exotic configurations,\n"
+                 << "but is generally ill-advised. Using 'j' on the experts' menu can adjust this\n"
+                 << "gap.\n";
+            break;
+         case problem_second_table_gap:
+            cout << "\nWarning: There is a gap between the secondary partition table (ending at sector\n"
+                 << problems[i].value1
+                 << ") and the secondary metadata (sector " << problems[i].value2 << ").\n"
+                 << "This is helpful in some exotic configurations, but is generally ill-advised.\n"
+                 << "Using 'k' on the experts' menu can adjust this gap.\n";
+            break;
+         case problem_first_usable_gap:
+            cout << "\nWarning: There is a gap between the main partition table (ending sector "
+                 << problems[i].value1 << ")\n"
+                 << "and the first usable sector (" << problems[i].value2 << "). This is helpful in some exotic configurations,\n"
+                 << "but is unusual. The util-linux fdisk program often creates disks like this.\n"
+                 << "Using 'j' on the experts' menu can adjust this gap.\n";
+            break;
+         case problem_table_too_small:
+            cout << "\nWarning: The size of the partition table (" << problems[i].value1
+                 << " bytes) is less than the minimum\n"
+                 << "required by the GPT specification. Most OSes and tools seem to work fine on\n"
+                 << "such disks, but this is a violation of the GPT specification and so may cause\n"
+                 << "problems.\n";
+            break;
+         case problem_last_usable_too_big:
+            cout << "\nProblem: GPT claims the disk is larger than it is! (Claimed last usable\n"
+                 << "sector is " << problems[i].value1 << ", but backup header is at\n"
+                 << problems[i].value2 << " and disk size is " << problems[i].value3 << " sectors.\n"
+                 << "The 'e' option on the experts' menu will probably fix this problem\n";
+            break;
+         case problem_overlap:
+            cout << "\nProblem: partitions " << p1 + 1 << " and " << p2 + 1 << " overlap:\n";
+            cout << "  Partition " << p1 + 1 << ": " << partitions[p1].GetFirstLBA()
+                 << " to " << partitions[p1].GetLastLBA() << "\n";
+            cout << "  Partition " << p2 + 1 << ": " << partitions[p2].GetFirstLBA()
+                 << " to " << partitions[p2].GetLastLBA() << "\n";
+            break;
+         case problem_ends_before_start:
+            cout << "\nProblem: partition " << p1 + 1 << " ends before it begins.\n";
+            break;
+         case problem_too_big:
+            cout << "\nProblem: partition " << p1 + 1 << " is too big for the disk.\n";
+            break;
+         case problem_duplicate_guid:
+            cout << "\nProblem: partitions " << p1 + 1 << " and " << p2 + 1
+                 << " have the same unique GUID (" << partitions[p2].GetUniqueGUID()
+                 << ").\nThe 'c' option on the experts' menu can change one of them.\n";
+            break;
+         case problem_hybrid_mismatch:
+            cout << "\nWarning! Mismatched GPT and MBR partition! MBR partition "
+                 << p1 + 1 << ", of type 0x";
+            cout.fill('0');
+            cout.setf(ios::uppercase);
+            cout.width(2);
+            cout << hex << (int) problems[i].value1 << ",\n"
+                 << "has no corresponding GPT partition! You may continue, but this condition\n"
+                 << "might cause data loss in the future!\a\n" << dec;
+            cout.fill(' ');
+            break;
+         case problem_mbr_overlap:
+            cout << "\nProblem: MBR partitions " << p1 + 1 << " and "
+                 << p2 + 1 << " overlap!\n";
+            break;
+         case problem_mbr_multiple_ee:
+            cout << "\nCaution: More than one 0xEE MBR partition found. This can cause problems\n"
+                 << "in some OSes.\n";
+            break;
+         case problem_mbr_ee_not_on_1:
+            cout << "\nWarning: 0xEE partition doesn't start on sector 1. This can cause "
+                 << "problems\nin some OSes.\n";
+            break;
+         case problem_ee_active:
+            cout << "\nWarning: The 0xEE protective partition in the MBR is marked as active. This is\n"
+                 << "technically a violation of the GPT specification, and can cause some EFIs to\n"
+                 << "ignore the disk, but it is required to boot from a GPT disk on some BIOS-based\n"
+                 << "computers. You can clear this flag by creating a fresh protective MBR using\n"
+                 << "the 'n' option on the experts' menu.\n";
+            break;
+         case problem_main_table_overlaps_part:
+            cout << "Warning! Main partition table overlaps the first partition by "
+                 << problems[i].value1 << " blocks!\n";
+            if (problems[i].value2 > 2) {
+               cout << "Try reducing the partition table size by " << problems[i].value1 * 4
+                    << " entries.\n(Use the 's' item on the experts' menu.)\n";
+            } else {
+               cout << "You will need to delete this partition or resize it in another utility.\n";
+            } // if/else
+            break;
+         case problem_second_table_overlaps_part:
+            cout << "\nWarning! Secondary partition table overlaps the last partition by\n"
+                 << problems[i].value1 << " blocks!\n";
+            if (problems[i].value2 > (problems[i].value3 - 2)) {
+               cout << "You will need to delete this partition or resize it in another utility.\n";
+            } else {
+               cout << "Try reducing the partition table size by " << problems[i].value1 * 4
+                    << " entries.\n(Use the 's' item on the experts' menu.)\n";
+            } // if/else
+            break;
+         case problem_mbr_too_big:
+            cout << "\nPartition(s) in the protective MBR are too big for the disk! Creating a\n"
+                 << "fresh protective or hybrid MBR is recommended.\n";
+            break;
+         case problem_start_unaligned:
+            cout << "\nCaution: Partition " << p1 + 1 << " doesn't begin on a "
+                 << problems[i].value1 << "-sector boundary. This may\nresult "
+                 << "in degraded performance on some modern (2009 and later) hard disks.\n";
+            alignProbs++;
+            break;
+         case problem_end_unaligned:
+            cout << "\nCaution: Partition " << p1 + 1 << " doesn't end on a "
+                 << problems[i].value1 << "-sector boundary. This may\nresult "
+                 << "in problems with some disk encryption tools.\n";
+            break;
+      } // switch
+   } // for
    if (alignProbs > 0)
       cout << "\nConsult http://www.ibm.com/developerworks/linux/library/l-4kb-sector-disks/\n"
       << "for information on disk alignment.\n";
-
-   // Now compute available space, but only if no problems found, since
-   // problems could affect the results
-   if (problems == 0) {
-      totalFree = FindFreeBlocks(&numSegments, &largestSegment);
-      cout << "\nNo problems found. " << totalFree << " free sectors ("
-           << BytesToIeee(totalFree, blockSize) << ") available in "
-           << numSegments << "\nsegments, the largest of which is "
-           << largestSegment << " (" << BytesToIeee(largestSegment, blockSize)
-           << ") in size.\n";
-   } else {
-      cout << "\nIdentified " << problems << " problems!\n";
-   } // if/else
-
-   return (problems);
-} // GPTData::Verify()
+} // GPTData::ShowProblems()
 
 // Checks to see if the GPT tables overrun existing partitions; if they
 // do, issues a warning but takes no action. Returns number of problems
 // detected (0 if OK, 1 to 2 if problems).
 int GPTData::CheckGPTSize(void) {
-   uint64_t overlap, firstUsedBlock, lastUsedBlock;
-   uint32_t i;
-   int numProbs = 0;
-
-   // first, locate the first & last used blocks
-   firstUsedBlock = UINT64_MAX;
-   lastUsedBlock = 0;
-   for (i = 0; i < numParts; i++) {
-      if (partitions[i].IsUsed()) {
-         if (partitions[i].GetFirstLBA() < firstUsedBlock)
-            firstUsedBlock = partitions[i].GetFirstLBA();
-         if (partitions[i].GetLastLBA() > lastUsedBlock) {
-            lastUsedBlock = partitions[i].GetLastLBA();
-         } // if
-      } // if
-   } // for
+   PartitionSweep sweep;
 
-   // If the disk size is 0 (the default), then it means that various
-   // variables aren't yet set, so the below tests will be useless;
-   // therefore we should skip everything
-   if (diskSize != 0) {
-      if (mainHeader.firstUsableLBA > firstUsedBlock) {
-         overlap = mainHeader.firstUsableLBA - firstUsedBlock;
-         cout << "Warning! Main partition table overlaps the first partition by "
-              << overlap << " blocks!\n";
-         if (firstUsedBlock > 2) {
-            cout << "Try reducing the partition table size by " << overlap * 4
-                 << " entries.\n(Use the 's' item on the experts' menu.)\n";
-         } else {
-            cout << "You will need to delete this partition or resize it in another utility.\n";
-         } // if/else
-         numProbs++;
-      } // Problem at start of disk
-      if (mainHeader.lastUsableLBA < lastUsedBlock) {
-         overlap = lastUsedBlock - mainHeader.lastUsableLBA;
-         cout << "\nWarning! Secondary partition table overlaps the last partition by\n"
-              << overlap << " blocks!\n";
-         if (lastUsedBlock > (diskSize - 2)) {
-            cout << "You will need to delete this partition or resize it in another utility.\n";
-         } else {
-            cout << "Try reducing the partition table size by " << overlap * 4
-                 << " entries.\n(Use the 's' item on the experts' menu.)\n";
-         } // if/else
-         numProbs++;
-      } // Problem at end of disk
-   } // if (diskSize != 0)
-   return numProbs;
+   SweepPartitions(sweep);
+   ShowProblems(sweep.size);
+   return (int) sweep.size.size();
 } // GPTData::CheckGPTSize()
 
 // Check the validity of the GPT header. Returns 1 if the main header
@@ -548,19 +925,9 @@ int GPTData::CheckHeaderValidity(void) {
 // Returns 1 if header's computed CRC matches the stored value, 0 if the
 // computed and stored values don't match
 int GPTData::CheckHeaderCRC(struct GPTHeader* header, int warn) {
-   uint32_t oldCRC, newCRC, hSize;
-   uint8_t *temp;
-
-   // Back up old header CRC and then blank it, since it must be 0 for
-   // computation to be valid
-   oldCRC = header->headerCRC;
-   header->headerCRC = UINT32_C(0);
+   uint32_t hSize;
 
    hSize = header->headerSize;
-
-   if (IsLittleEndian() == 0)
-      ReverseHeaderBytes(header);
-
    if ((hSize > blockSize) || (hSize < HEADER_SIZE)) {
       if (warn) {
          cerr << "\aWarning! Header size is specified as " << hSize << ", which is invalid.\n";
@@ -572,32 +939,37 @@ int GPTData::CheckHeaderCRC(struct GPTHeader* header, int warn) {
       cout << "If stray data exists after the header on the header sector, it will be ignored,\n"
            << "which may result in a CRC false alarm.\n";
    } // if/elseif
-   temp = new uint8_t[hSize];
-   if (temp != NULL) {
-      memset(temp, 0, hSize);
-      if (hSize < sizeof(GPTHeader))
-         memcpy(temp, header, hSize);
-      else
-         memcpy(temp, header, sizeof(GPTHeader));
-
-      newCRC = chksum_crc32((unsigned char*) temp, hSize);
-      delete[] temp;
-   } else {
-      cerr << "Could not allocate memory in GPTData::CheckHeaderCRC()! Aborting!\n";
-      exit(1);
-   }
-   if (IsLittleEndian() == 0)
-      ReverseHeaderBytes(header);
-   header->headerCRC = oldCRC;
-   return (oldCRC == newCRC);
+   return (header->headerCRC == HeaderCRC(*header, hSize));
 } // GPTData::CheckHeaderCRC()
 
+// Compute the CRC of the first hSize bytes of header's on-disk form, with
+// its headerCRC field zeroed (as the CRC's definition requires). Bytes past
+// the end of the GPTHeader structure count as zeroes; the padded copy is
+// made in myDisk's I/O arena.
+uint32_t GPTData::HeaderCRC(const struct GPTHeader & header, uint32_t hSize) {
+   struct GPTHeader diskHeader;
+   uint8_t *temp;
+   uint32_t crc;
+   IOArenaMark mark;
+
+   EncodeHeader(header, &diskHeader);
+   diskHeader.headerCRC = UINT32_C(0);
+   if (hSize <= sizeof(GPTHeader))
+      return chksum_crc32((unsigned char*) &diskHeader, hSize);
+   mark = myDisk.Arena().Mark();
+   temp = (uint8_t*) myDisk.Arena().Allocate(hSize);
+   memset(temp, 0, hSize);
+   memcpy(temp, &diskHeader, sizeof(GPTHeader));
+   crc = chksum_crc32((unsigned char*) temp, hSize);
+   myDisk.Arena().Rewind(mark);
+   return crc;
+} // GPTData::HeaderCRC()
+
 // Recompute all the CRCs. Must be called before saving if any changes have
-// been made. Must be called on platform-ordered data (this function reverses
-// byte order and then undoes that reversal.)
+// been made. The CRCs are computed over the data's on-disk form, but the
+// data in memory is left in CPU byte order throughout.
 void GPTData::RecomputeCRCs(void) {
    uint32_t crc, hSize;
-   int littleEndian;
 
    // If the header size is bigger than the GPT header data structure, reset it;
    // otherwise, set both header sizes to whatever the main one is....
@@ -606,39 +978,13 @@ void GPTData::RecomputeCRCs(void) {
    else
       hSize = secondHeader.headerSize = mainHeader.headerSize;
 
-   if ((littleEndian = IsLittleEndian()) == 0) {
-      ReversePartitionBytes();
-      ReverseHeaderBytes(&mainHeader);
-      ReverseHeaderBytes(&secondHeader);
-   } // if
-
    // Compute CRC of partition tables & store in main and secondary headers
-   crc = chksum_crc32((unsigned char*) partitions, numParts * GPT_SIZE);
+   crc = PartitionsCRC();
    mainHeader.partitionEntriesCRC = crc;
    secondHeader.partitionEntriesCRC = crc;
-   if (littleEndian == 0) {
-      ReverseBytes(&mainHeader.partitionEntriesCRC, 4);
-      ReverseBytes(&secondHeader.partitionEntriesCRC, 4);
-   } // if
 
-   // Zero out GPT headers' own CRCs (required for correct computation)
-   mainHeader.headerCRC = 0;
-   secondHeader.headerCRC = 0;
-
-   crc = chksum_crc32((unsigned char*) &mainHeader, hSize);
-   if (littleEndian == 0)
-      ReverseBytes(&crc, 4);
-   mainHeader.headerCRC = crc;
-   crc = chksum_crc32((unsigned char*) &secondHeader, hSize);
-   if (littleEndian == 0)
-      ReverseBytes(&crc, 4);
-   secondHeader.headerCRC = crc;
-
-   if (littleEndian == 0) {
-      ReverseHeaderBytes(&mainHeader);
-      ReverseHeaderBytes(&secondHeader);
-      ReversePartitionBytes();
-   } // if
+   mainHeader.headerCRC = HeaderCRC(mainHeader, hSize);
+   secondHeader.headerCRC = HeaderCRC(secondHeader, hSize);
 } // GPTData::RecomputeCRCs()
 
 // Rebuild the main GPT header, using the secondary header as a model.
@@ -687,60 +1033,42 @@ void GPTData::RebuildSecondHeader(void) {
 // Search for hybrid MBR entries that have no corresponding GPT partition.
 // Returns number of such mismatches found
 int GPTData::FindHybridMismatches(void) {
-   int i, found, numFound = 0;
+   vector<GPTProblem> problems;
+
+   GetHybridMismatches(problems);
+   ShowProblems(problems);
+   return (int) problems.size();
+} // GPTData::FindHybridMismatches
+
+// Add the hybrid MBR entries that have no corresponding GPT partition to
+// problems.
+void GPTData::GetHybridMismatches(vector<GPTProblem> & problems) {
+   int i, found;
    uint32_t j;
    uint64_t mbrFirst, mbrLast;
 
    for (i = 0; i < 4; i++) {
       if ((protectiveMBR.GetType(i) != 0xEE) && (protectiveMBR.GetType(i) != 0x00)) {
-         j = 0;
          found = 0;
          mbrFirst = (uint64_t) protectiveMBR.GetFirstSector(i);
          mbrLast = mbrFirst + (uint64_t) protectiveMBR.GetLength(i) - UINT64_C(1);
-         do {
-            if ((j < numParts) && (partitions[j].GetFirstLBA() == mbrFirst) &&
-                (partitions[j].GetLastLBA() == mbrLast) && (partitions[j].IsUsed()))
-               found = 1;
-            j++;
-         } while ((!found) && (j < numParts));
-         if (!found) {
-            numFound++;
-            cout << "\nWarning! Mismatched GPT and MBR partition! MBR partition "
-                 << i + 1 << ", of type 0x";
-            cout.fill('0');
-            cout.setf(ios::uppercase);
-            cout.width(2);
-            cout << hex << (int) protectiveMBR.GetType(i) << ",\n"
-                 << "has no corresponding GPT partition! You may continue, but this condition\n"
-                 << "might cause data loss in the future!\a\n" << dec;
-            cout.fill(' ');
-         } // if
+         for (j = NextUsedPart(0); (!found) && (j < numParts); j = NextUsedPart(j + 1))
+            found = (firstLBAs[j] == mbrFirst) && (lastLBAs[j] == mbrLast);
+         if (!found)
+            AddProblem(problems, problem_hybrid_mismatch, severity_problem, i, 0,
+                       protectiveMBR.GetType(i));
       } // if
    } // for
-   return numFound;
-} // GPTData::FindHybridMismatches
+} // GPTData::GetHybridMismatches()
 
-// Find overlapping partitions and warn user about them. Returns number of
-// overlapping partitions.
+// Find overlapping partitions and warn user about them.
 // Returns number of overlapping segments found.
 int GPTData::FindOverlaps(void) {
-   int problems = 0;
-   uint32_t i, j;
+   PartitionSweep sweep;
 
-   for (i = 1; i < numParts; i++) {
-      for (j = 0; j < i; j++) {
-         if ((partitions[i].IsUsed()) && (partitions[j].IsUsed()) &&
-             (partitions[i].DoTheyOverlap(partitions[j]))) {
-            problems++;
-            cout << "\nProblem: partitions " << i + 1 << " and " << j + 1 << " overlap:\n";
-            cout << "  Partition " << i + 1 << ": " << partitions[i].GetFirstLBA()
-                 << " to " << partitions[i].GetLastLBA() << "\n";
-            cout << "  Partition " << j + 1 << ": " << partitions[j].GetFirstLBA()
-                 << " to " << partitions[j].GetLastLBA() << "\n";
-         } // if
-      } // for j...
-   } // for i...
-   return problems;
+   SweepPartitions(sweep);
+   ShowProblems(sweep.overlaps);
+   return (int) sweep.overlaps.size();
 } // GPTData::FindOverlaps()
 
 // Find partitions that are insane -- they start after they end or are too
@@ -749,24 +1077,36 @@ int GPTData::FindOverlaps(void) {
 // redundant tests than to miss something....)
 // Returns number of problems found.
 int GPTData::FindInsanePartitions(void) {
-   uint32_t i;
-   int problems = 0;
+   PartitionSweep sweep;
 
-   for (i = 0; i < numParts; i++) {
-      if (partitions[i].IsUsed()) {
-         if (partitions[i].GetFirstLBA() > partitions[i].GetLastLBA()) {
-            problems++;
-            cout << "\nProblem: partition " << i + 1 << " ends before it begins.\n";
-         } // if
-         if (partitions[i].GetLastLBA() >= diskSize) {
-            problems++;
-            cout << "\nProblem: partition " << i + 1 << " is too big for the disk.\n";
-         } // if
-      } // if
-   } // for
-   return problems;
+   SweepPartitions(sweep);
+   ShowProblems(sweep.insane);
+   return (int) sweep.insane.size();
 } // GPTData::FindInsanePartitions(void)
 
+// Find partitions whose unique GUIDs duplicate those of lower-numbered
+// partitions, as happens when a disk is cloned without randomizing the
+// GUIDs and the two tables are then merged.
+// Returns number of problems found.
+int GPTData::FindDuplicateGUIDs(void) {
+   vector<GPTProblem> problems;
+
+   GetDuplicateGUIDs(problems);
+   ShowProblems(problems);
+   return (int) problems.size();
+} // GPTData::FindDuplicateGUIDs()
+
+// Add the partitions found by FindDuplicateGUIDs() to problems.
+void GPTData::GetDuplicateGUIDs(vector<GPTProblem> & problems) {
+   uint32_t i, j;
+
+   for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1)) {
+      j = FindPartitionByGUID(partitions[i].GetUniqueGUID());
+      if (j < i)
+         AddProblem(problems, problem_duplicate_guid, severity_problem, j, i);
+   } // for
+} // GPTData::GetDuplicateGUIDs()
+
 
 /******************************************************************
  *                                                                *
@@ -780,6 +1120,8 @@ int GPTData::FindInsanePartitions(void) {
 int GPTData::SetDisk(const string & deviceFilename) {
    int err, allOK = 1;
 
+   ForgetDiskImage();
+   ForgetDiskTables();
    device = deviceFilename;
    if (allOK && myDisk.OpenForRead(deviceFilename)) {
       // store disk information....
@@ -806,6 +1148,16 @@ void GPTData::PartitionScan(void) {
 
    // Load the GPT data, whether or not it's valid
    ForceLoadGPTData();
+   newExtents.clear();
+
+   // If both copies of the GPT data check out, they're known to match what's
+   // in memory, so saving need write only what changes from here on.
+   ForgetDiskImage();
+   if ((state == gpt_valid) && mainCrcOk && secondCrcOk && mainPartsCrcOk && secondPartsCrcOk &&
+       CheckHeaderCRC(&mainHeader) && CheckHeaderCRC(&secondHeader) &&
+       (mainHeader.backupLBA < diskSize) && (mainHeader.numParts == numParts) &&
+       (secondHeader.numParts == numParts))
+      RecordDiskImage();
 
    // Some tools create a 0xEE partition that's too big. If this is detected,
    // normalize it....
@@ -909,6 +1261,7 @@ int GPTData::LoadPartitions(const string & deviceFilename) {
          }
       }
       myDisk.Close();
+      myDisk.Arena().Release();
       ComputeAlignment();
    } else {
       allOK = 0;
@@ -916,11 +1269,115 @@ int GPTData::LoadPartitions(const string & deviceFilename) {
    return (allOK);
 } // GPTData::LoadPartitions()
 
+// A cut-down LoadPartitions() for read-only queries (sgdisk's -D, -E, -f,
+// and -F options) of a healthy disk. Reads only the protective MBR and the
+// two headers; the main partition table is read on first use, by
+// LoadTablesOnDemand(), and the backup table isn't checked at all. If
+// anything about the disk is less than perfect, falls back on a full
+// LoadPartitions(), so that the usual warnings are shown and the usual
+// repairs made. Callers that may change or verify the disk should use
+// LoadPartitions() instead.
+// Returns 1 on success, 0 on failure.
+int GPTData::LoadHeadersOnly(const string & deviceFilename) {
+   GPTHeader quickMain, quickSecond;
+   int err, allOK = 0;
+
+   ForgetDiskTables();
+   if (myDisk.OpenForRead(deviceFilename)) {
+      diskSize = myDisk.DiskSize(&err);
+      blockSize = (uint32_t) myDisk.GetBlockSize();
+      physBlockSize = (uint32_t) myDisk.GetPhysBlockSize();
+      device = deviceFilename;
+      protectiveMBR.ReadMBRData(&myDisk);
+      allOK = (protectiveMBR.GetValidity() == gpt) && protectiveMBR.DoTheyFit() &&
+              QuickLoadHeader(&quickMain, 1) && (quickMain.backupLBA < diskSize) &&
+              QuickLoadHeader(&quickSecond, quickMain.backupLBA) &&
+              (quickMain.numParts == quickSecond.numParts) &&
+              (quickMain.partitionEntriesCRC == quickSecond.partitionEntriesCRC);
+      myDisk.Close();
+      myDisk.Arena().Release();
+   } // if
+   if (!allOK)
+      return LoadPartitions(deviceFilename);
+
+   mainHeader = quickMain;
+   secondHeader = quickSecond;
+   mainCrcOk = secondCrcOk = 1;
+   apmFound = bsdFound = 0;
+   state = gpt_valid;
+   whichWasUsed = use_gpt;
+   tablesPending = 1;
+   return 1;
+} // GPTData::LoadHeadersOnly()
+
+// Read a GPT header for LoadHeadersOnly(). Unlike LoadHeader(), this never
+// prints anything, and it insists on a header that needs no correction.
+// Returns 1 if the header was read and is valid, 0 otherwise.
+int GPTData::QuickLoadHeader(struct GPTHeader *header, uint64_t sector) {
+   if (!myDisk.Seek(sector) || (myDisk.Read(header, 512) != 512))
+      return 0;
+   if (IsLittleEndian() == 0)
+      ReverseHeaderBytes(header);
+   return HeaderLooksValid(header);
+} // GPTData::QuickLoadHeader()
+
+// Check a header (in CPU byte order) for everything that would need
+// correcting before it could be used: its signature, revision, sizes, and
+// CRC. Prints nothing.
+// Returns 1 if the header is valid, 0 if not.
+int GPTData::HeaderLooksValid(struct GPTHeader *header) {
+   return (header->signature == GPT_SIGNATURE) && (header->revision == 0x00010000) &&
+          (header->headerSize >= HEADER_SIZE) && (header->headerSize <= sizeof(GPTHeader)) &&
+          (header->sizeOfPartitionEntries == sizeof(GPTPart)) && (header->numParts > 0) &&
+          CheckHeaderCRC(header, 0);
+} // GPTData::HeaderLooksValid()
+
+// Finish a load begun by LoadHeadersOnly() by reading the main partition
+// table. If that table's CRC doesn't match its header, or if the table
+// doesn't fit on the disk, reloads the whole disk with LoadPartitions() so
+// that the backup table can be used and the problem reported in the usual
+// way. Does nothing if the table has already been read.
+// Returns 1 on success, 0 on failure.
+int GPTData::LoadTablesOnDemand(void) {
+   uint32_t crc;
+   int allOK = 0;
+
+   if (tablesPending != 1)
+      return (tablesPending == 0);
+   tablesPending = 0;
+   if (myDisk.OpenForRead(device) && myDisk.Seek(mainHeader.partitionEntriesLBA) &&
+       SetGPTSize(mainHeader.numParts, 0) && (diskSize > GetTableSizeInSectors() * 2 + 3)) {
+      UnsharePartitions();
+      allOK = ReadPartitionArray(myDisk, numParts, partitions, &crc) &&
+              (crc == mainHeader.partitionEntriesCRC);
+   } // if
+   if (allOK) {
+      if (IsLittleEndian() == 0)
+         ReversePartitionBytes();
+      TableChanged();
+      KeepDiskTable(0, mainHeader.partitionEntriesLBA, crc);
+      // The backup table itself isn't read, but its header has already
+      // been checked and claims the same CRC as the main table.
+      mainPartsCrcOk = secondPartsCrcOk = 1;
+      CheckGPTSize();
+      myDisk.Close();
+      ComputeAlignment();
+   } else {
+      myDisk.Close();
+      allOK = LoadPartitions(device);
+   } // if/else
+   if (!allOK)
+      tablesPending = -1; // so later calls fail, too
+   myDisk.Arena().Release();
+   return allOK;
+} // GPTData::LoadTablesOnDemand()
+
 // Loads the GPT, as much as possible. Returns 1 if this seems to have
 // succeeded, 0 if there are obvious problems....
 int GPTData::ForceLoadGPTData(void) {
    int allOK, validHeaders, loadedTable = 1;
 
+   ForgetDiskTables();
    allOK = LoadHeader(&mainHeader, myDisk, 1, &mainCrcOk);
 
    if (mainCrcOk && (mainHeader.backupLBA < diskSize)) {
@@ -1045,6 +1502,113 @@ int GPTData::LoadSecondTableAsMain(void) {
    return LoadPartitionTable(secondHeader, myDisk);
 } // GPTData::LoadSecondTableAsMain()
 
+// Read sectors first through last of the disk in big sequential chunks,
+// looking for GPT headers that ForceLoadGPTData() wouldn't find, such as a
+// backup header left at the old end of a disk that's been cloned to a
+// bigger one. Since a header always starts a sector, only the first eight
+// bytes of each sector need to be compared with the signature, so the scan
+// goes as fast as the disk can be read. A header counts only if it's valid
+// and lies where it says it does, at sector 1 if it's a main header or with
+// its main header at sector 1 if it's a backup; this weeds out copies of
+// other disks' headers (in disk image files, say). A read error skips the
+// chunk in which it happened, rather than ending the scan, since the disk
+// may well be damaged. The partition tables of the headers found are then
+// checked against their CRCs.
+// Returns 1 if the scan was done (whether or not it found anything), 0 if
+// the disk couldn't be read at all.
+int GPTData::ScanForHeaders(vector<FoundGPTHeader> & found, uint64_t first, uint64_t last) {
+   uint64_t sector, numSectors, chunkSectors, numRead, i, total;
+   unsigned char *buffer;
+   FoundGPTHeader candidate;
+   IOArenaMark mark;
+   uint32_t crc;
+   int percent, lastPercent = -1, bytesRead;
+
+   found.clear();
+   if ((diskSize > 0) && (last >= diskSize))
+      last = diskSize - 1;
+   if ((first > last) || (!myDisk.OpenForRead()))
+      return 0;
+   chunkSectors = max((uint64_t) HEADER_SCAN_CHUNK_SIZE / blockSize, UINT64_C(1));
+   total = last - first + 1;
+   mark = myDisk.Arena().Mark();
+   buffer = (unsigned char*) myDisk.Arena().Allocate((size_t) (chunkSectors * blockSize));
+   for (sector = first; sector <= last; sector += numSectors) {
+      numSectors = min(chunkSectors, last - sector + 1);
+      bytesRead = 0;
+      if (myDisk.Seek(sector))
+         bytesRead = myDisk.Read(buffer, (int) (numSectors * blockSize));
+      if (bytesRead != (int) (numSectors * blockSize)) {
+         cerr << "\nWarning! Read error " << errno << " at or after sector " << sector
+              << "; skipping ahead " << numSectors << " sectors.\n";
+      } // if
+      numRead = (bytesRead > 0) ? (uint64_t) bytesRead / blockSize : 0;
+      for (i = 0; i < numRead; i++) {
+         if (memcmp(buffer + i * blockSize, "EFI PART", 8) == 0) {
+            memcpy(&candidate.header, buffer + i * blockSize, sizeof(GPTHeader));
+            if (IsLittleEndian() == 0)
+               ReverseHeaderBytes(&candidate.header);
+            if (HeaderLooksValid(&candidate.header) &&
+                (candidate.header.currentLBA == sector + i) &&
+                ((candidate.header.currentLBA == 1) || (candidate.header.backupLBA == 1))) {
+               candidate.tableOK = 0;
+               found.push_back(candidate);
+            } // if
+         } // if
+      } // for
+      percent = (int) ((sector + numSectors - first) * 100 / total);
+      if (!beQuiet && (percent != lastPercent)) {
+         cout << "\rScanning: " << percent << "% (" << BytesToIeee(sector + numSectors - first, blockSize)
+              << " of " << BytesToIeee(total, blockSize) << ")" << flush;
+         lastPercent = percent;
+      } // if
+   } // for
+   if (!beQuiet)
+      cout << "\n";
+   myDisk.Arena().Rewind(mark);
+
+   for (i = 0; i < found.size(); i++) {
+      const GPTHeader & header = found[i].header;
+      if ((header.partitionEntriesLBA < diskSize) &&
+          (((uint64_t) header.numParts * GPT_SIZE + blockSize - 1) / blockSize <=
+           diskSize - header.partitionEntriesLBA) &&
+          myDisk.Seek(header.partitionEntriesLBA) &&
+          ReadPartitionArray(myDisk, header.numParts, NULL, &crc))
+         found[i].tableOK = (crc == header.partitionEntriesCRC);
+   } // for
+   myDisk.Arena().Release();
+   return 1;
+} // GPTData::ScanForHeaders()
+
+// Make header, as found by ScanForHeaders(), the basis of the GPT data:
+// load the partition table it points to and rebuild the other header from
+// it. If the backup data structures then aren't at the end of the disk (as
+// when a disk has been cloned to one of a different size), they're moved
+// there.
+// Returns 1 on success, 0 on failure (if the partition table couldn't be
+// read).
+int GPTData::UseFoundHeader(const struct GPTHeader & header) {
+   int allOK;
+
+   ForgetDiskImage();
+   if (header.currentLBA < header.backupLBA) { // a main header
+      mainHeader = header;
+      mainCrcOk = 1;
+      allOK = LoadMainTable();
+      RebuildSecondHeader();
+   } else {
+      secondHeader = header;
+      secondCrcOk = 1;
+      allOK = LoadSecondTableAsMain();
+      RebuildMainHeader();
+   } // if/else
+   if (allOK && (secondHeader.currentLBA != diskSize - UINT64_C(1))) {
+      cout << "The backup GPT data structures aren't at the end of the disk; moving them there.\n";
+      MoveSecondHeaderToEnd();
+   } // if
+   return allOK;
+} // GPTData::UseFoundHeader()
+
 // Load a single GPT header (main or backup) from the specified disk device and
 // sector. Applies byte-order corrections on big-endian platforms. Sets crcOk
 // value appropriately.
@@ -1096,12 +1660,29 @@ int GPTData::LoadHeader(struct GPTHeader *header, DiskIO & disk, uint64_t sector
 // indicated in header.
 // Returns 1 on success, 0 on failure. CRC errors do NOT count as failure.
 int GPTData::LoadPartitionTable(const struct GPTHeader & header, DiskIO & disk, uint64_t sector) {
-   uint32_t sizeOfParts, newCRC;
+   uint32_t newCRC;
+   GPTDiskTable *kept = NULL;
    int retval;
 
+   if ((&disk == &myDisk) && (sector == 0))
+      kept = FindDiskTable(header);
    if (header.sizeOfPartitionEntries != sizeof(GPTPart)) {
       cerr << "Error! GPT header contains invalid partition entry size!\n";
       retval = 0;
+   } else if ((kept != NULL) && SetGPTSize(header.numParts, 0)) {
+      // Already read; just make it the working table
+      GPTPart *parts = kept->partitions;
+      uint32_t *refs = kept->partsRefs;
+      (*refs)++;
+      ReleasePartitions();
+      partitions = parts;
+      partsRefs = refs;
+      mainPartsCrcOk = secondPartsCrcOk = (kept->crc == header.partitionEntriesCRC);
+      TableChanged();
+      if (!mainPartsCrcOk) {
+         cout << "Caution! After loading partitions, the CRC doesn't check out!\n";
+      } // if
+      retval = 1;
    } else if (disk.OpenForRead()) {
       if (sector == 0) {
          retval = disk.Seek(header.partitionEntriesLBA);
@@ -1111,18 +1692,20 @@ int GPTData::LoadPartitionTable(const struct GPTHeader & header, DiskIO & disk,
       if (retval == 1)
          retval = SetGPTSize(header.numParts, 0);
       if (retval == 1) {
-         sizeOfParts = header.numParts * header.sizeOfPartitionEntries;
-         if (disk.Read(partitions, sizeOfParts) != (int) sizeOfParts) {
+         UnsharePartitions();
+         if (!ReadPartitionArray(disk, header.numParts, partitions, &newCRC)) {
             cerr << "Warning! Read error " << errno << "! Misbehavior now likely!\n";
             retval = 0;
          } // if
-         newCRC = chksum_crc32((unsigned char*) partitions, sizeOfParts);
          mainPartsCrcOk = secondPartsCrcOk = (newCRC == header.partitionEntriesCRC);
          if (IsLittleEndian() == 0)
             ReversePartitionBytes();
+         TableChanged();
          if (!mainPartsCrcOk) {
             cout << "Caution! After loading partitions, the CRC doesn't check out!\n";
          } // if
+         if ((retval == 1) && (&disk == &myDisk) && (sector == 0))
+            KeepDiskTable((&header == &secondHeader), header.partitionEntriesLBA, newCRC);
       } else {
          cerr << "Error! Couldn't seek to partition table!\n";
       } // if/else
@@ -1134,30 +1717,36 @@ int GPTData::LoadPartitionTable(const struct GPTHeader & header, DiskIO & disk,
    return retval;
 } // GPTData::LoadPartitionsTable()
 
-// Check the partition table pointed to by header, but don't keep it
-// around.
+// Check the partition table pointed to by header against its CRC and
+// against the working table, which must have been read from the disk with
+// the other header. If the two tables are the same size, this one's kept
+// in memory (see KeepDiskTable()), so that the entries that differ can be
+// listed and the recovery menu can switch tables without rereading them;
+// otherwise it's read a chunk at a time and thrown away.
 // Returns 1 if the CRC is OK & this table matches the one already in memory,
 // 0 if not or if there was a read error.
 int GPTData::CheckTable(struct GPTHeader *header) {
-   uint32_t sizeOfParts, newCRC;
-   GPTPart *partsToCheck;
+   uint32_t newCRC, i;
    GPTHeader *otherHeader;
+   GPTPart *table = NULL;
    int allOK = 0;
 
-   // Load partition table into temporary storage to check
-   // its CRC and store the results, then discard this temporary
-   // storage, since we don't use it in any but recovery operations
    if (myDisk.Seek(header->partitionEntriesLBA)) {
-      partsToCheck = new GPTPart[header->numParts];
-      sizeOfParts = header->numParts * header->sizeOfPartitionEntries;
-      if (partsToCheck == NULL) {
-         cerr << "Could not allocate memory in GPTData::CheckTable()! Terminating!\n";
-         exit(1);
+      if (header->numParts == numParts) {
+         table = new GPTPart [numParts];
+         if (table == NULL) {
+            cerr << "Error! Could not allocate memory for partition table in GPTData::CheckTable()!\n"
+                 << "Terminating!\n";
+            exit(1);
+         } // if
       } // if
-      if (myDisk.Read(partsToCheck, sizeOfParts) != (int) sizeOfParts) {
+      if (!ReadPartitionArray(myDisk, header->numParts, table, &newCRC)) {
          cerr << "Warning! Error " << errno << " reading partition table for CRC check!\n";
       } else {
-         newCRC = chksum_crc32((unsigned char*) partsToCheck, sizeOfParts);
+         if ((table != NULL) && (IsLittleEndian() == 0)) {
+            for (i = 0; i < numParts; i++)
+               table[i].ReversePartBytes();
+         } // if
          allOK = (newCRC == header->partitionEntriesCRC);
          if (header == &mainHeader)
             otherHeader = &secondHeader;
@@ -1165,15 +1754,81 @@ int GPTData::CheckTable(struct GPTHeader *header) {
             otherHeader = &mainHeader;
          if (newCRC != otherHeader->partitionEntriesCRC) {
             cerr << "Warning! Main and backup partition tables differ! Use the 'c' and 'e' options\n"
-                 << "on the recovery & transformation menu to examine the two tables.\n\n";
+                 << "on the recovery & transformation menu to examine the two tables.\n";
+            if (table != NULL)
+               ListTableDifferences(table);
+            cerr << "\n";
             allOK = 0;
          } // if
+         if (table != NULL) {
+            KeepDiskTable((header == &secondHeader), header->partitionEntriesLBA, newCRC, table);
+            table = NULL;
+         } // if
       } // if/else
-      delete[] partsToCheck;
    } // if
+   delete[] table;
    return allOK;
 } // GPTData::CheckTable()
 
+// Read numEntries partition entries from disk's current position and
+// return their CRC in *crc. The entries are read PARTITION_CHUNK_SIZE bytes
+// at a time, in groups of up to one chunk per CRC thread; each group's
+// chunks are CRCed in parallel and the chunk CRCs are then combined in
+// order. If dest is NULL, the entries go into a few scratch buffers and are
+// thrown away, so only the CRC comes back; otherwise they're stored in dest
+// (in disk byte order). The scratch buffers and bookkeeping come from disk's
+// I/O arena.
+// Returns 1 on success, 0 on a read error.
+int GPTData::ReadPartitionArray(DiskIO & disk, uint32_t numEntries, GPTPart *dest, uint32_t *crc) {
+   uint64_t bytesLeft = (uint64_t) numEntries * GPT_SIZE, chunkSize = PARTITION_CHUNK_SIZE;
+   uint64_t numChunks, bufSize;
+   unsigned int i, inGroup, numBuffers;
+   unsigned char *next = (unsigned char*) dest, *scratch = NULL, **blocks;
+   size_t *lengths;
+   uint32_t *crcs;
+   int blockSize, allOK = 1;
+   IOArena & arena = disk.Arena();
+   IOArenaMark mark = arena.Mark();
+
+   // Chunks must be whole sectors, or DiskIO::Read() will skip data
+   blockSize = disk.GetBlockSize();
+   if (blockSize > 0)
+      chunkSize = ((chunkSize + blockSize - 1) / blockSize) * blockSize;
+   numChunks = (bytesLeft + chunkSize - 1) / chunkSize;
+   bufSize = min(chunkSize, bytesLeft);
+   numBuffers = chksum_crc32_max_threads();
+   if (numBuffers > numChunks)
+      numBuffers = (unsigned int) numChunks;
+   if (numBuffers == 0)
+      numBuffers = 1;
+   blocks = (unsigned char**) arena.Allocate(numBuffers * sizeof(unsigned char*));
+   lengths = (size_t*) arena.Allocate(numBuffers * sizeof(size_t));
+   crcs = (uint32_t*) arena.Allocate(numBuffers * sizeof(uint32_t));
+   if (dest == NULL)
+      scratch = (unsigned char*) arena.Allocate((size_t) (numBuffers * bufSize));
+
+   *crc = 0; // CRC of nothing
+   while (allOK && (bytesLeft > 0)) {
+      for (inGroup = 0; allOK && (inGroup < numBuffers) && (bytesLeft > 0); inGroup++) {
+         lengths[inGroup] = (size_t) min(chunkSize, bytesLeft);
+         if (dest == NULL) {
+            blocks[inGroup] = scratch + inGroup * bufSize;
+         } else {
+            blocks[inGroup] = next;
+            next += lengths[inGroup];
+         } // if/else
+         if (disk.Read(blocks[inGroup], (int) lengths[inGroup]) != (int) lengths[inGroup])
+            allOK = 0;
+         bytesLeft -= lengths[inGroup];
+      } // for
+      chksum_crc32_blocks(blocks, lengths, crcs, inGroup);
+      for (i = 0; i < inGroup; i++)
+         *crc = chksum_crc32_combine(*crc, crcs[i], lengths[i]);
+   } // while
+   arena.Rewind(mark);
+   return allOK;
+} // GPTData::ReadPartitionArray()
+
 // Writes GPT (and protective MBR) to disk. If quiet==1, moves the second
 // header later on the disk without asking for permission, if necessary, and
 // doesn't confirm the operation before writing. If quiet==0, asks permission
@@ -1269,26 +1924,16 @@ int GPTData::SaveGPTData(int quiet) {
    // Do it!
    if (allOK) {
       if (myDisk.OpenForWrite()) {
-         // As per UEFI specs, write the secondary table and GPT first....
-         allOK = SavePartitionTable(myDisk, secondHeader.partitionEntriesLBA);
-         if (!allOK) {
+         if (discardNew)
+            DiscardNewPartitions();
+         if (wipeNew)
+            WipeSignatures();
+         allOK = WriteStructures(&syncIt);
+         if (!syncIt) {
             cerr << "Unable to save backup partition table! Perhaps the 'e' option on the experts'\n"
                  << "menu will resolve this problem.\n";
-            syncIt = 0;
          } // if
 
-         // Now write the secondary GPT header...
-         allOK = allOK && SaveHeader(&secondHeader, myDisk, mainHeader.backupLBA);
-
-         // Now write the main partition tables...
-         allOK = allOK && SavePartitionTable(myDisk, mainHeader.partitionEntriesLBA);
-
-         // Now write the main GPT header...
-         allOK = allOK && SaveHeader(&mainHeader, myDisk, 1);
-
-         // To top it off, write the protective MBR...
-         allOK = allOK && protectiveMBR.WriteMBRData(&myDisk);
-
          // re-read the partition table
          // Note: Done even if some write operations failed, but not if all of them failed.
          // Done this way because I've received one problem report from a user one whose
@@ -1297,12 +1942,30 @@ int GPTData::SaveGPTData(int quiet) {
          // original partition table from its cache. OTOH, such restoration might be
          // desirable if the error occurs later; but that seems unlikely unless the initial
          // write fails....
-         if (syncIt)
-            myDisk.DiskSync();
+         // A partition that's only grown can be resized in place, even
+         // while the disk's in use; if the kernel won't do that, fall back
+         // on having it re-read the whole table.
+         if (syncIt) {
+            if (!IsUsedPartNum(grownPart) ||
+                !myDisk.ResizePartition(grownPart + 1, firstLBAs[grownPart],
+                                        lastLBAs[grownPart] - firstLBAs[grownPart] + 1))
+               myDisk.DiskSync();
+         } // if
 
          if (allOK) { // writes completed OK
+            // What's on the disk now is what's in memory, whatever state
+            // it was loaded in
+            state = gpt_valid;
+            mainCrcOk = secondCrcOk = mainPartsCrcOk = secondPartsCrcOk = 1;
+            grownPart = UINT32_MAX;
+            newExtents.clear();
+            RecordDiskImage();
+            KeepDiskTable(0, mainHeader.partitionEntriesLBA, mainHeader.partitionEntriesCRC);
+            KeepDiskTable(1, secondHeader.partitionEntriesLBA, secondHeader.partitionEntriesCRC);
             cout << "The operation has completed successfully.\n";
          } else {
+            ForgetDiskImage();
+            ForgetDiskTables();
             cerr << "Warning! An error was reported when writing the partition table! This error\n"
                  << "MIGHT be harmless, or the disk might be damaged! Checking it is advisable.\n";
          } // if/else
@@ -1313,12 +1976,300 @@ int GPTData::SaveGPTData(int quiet) {
               << errno << "! Aborting write!\n";
          allOK = 0;
       } // if/else
-   } else {
-      cout << "Aborting write of new partition table.\n";
-   } // if
+   } else {
+      cout << "Aborting write of new partition table.\n";
+   } // if
+
+   return (allOK);
+} // GPTData::SaveGPTData()
+
+// Write the backup partition table & header, the main partition table &
+// header, and the protective MBR to myDisk, which must already be open for
+// writing. The backup structures go first, as per the UEFI specs, and the
+// writing stops at the first failure. If what's on the disk is known (see
+// RecordDiskImage()), only the table sectors, headers, and MBR that have
+// changed are written, in the same order. Sets *backupOK to 1 if the first
+// write (of the backup partition table) succeeded, 0 if it didn't.
+// Returns 1 if all the writes succeeded, 0 if not.
+int GPTData::WriteStructures(int *backupOK) {
+   GPTPart *oldMain = NULL, *oldSecond = NULL, *table;
+   int allOK, newMainHeader = 1, newSecondHeader = 1, newMBR = 1;
+
+   if ((diskImage != NULL) && (diskImage->numParts == numParts)) {
+      if (diskImage->mainHeader.partitionEntriesLBA == mainHeader.partitionEntriesLBA)
+         oldMain = diskImage->partitions;
+      if (diskImage->secondHeader.partitionEntriesLBA == secondHeader.partitionEntriesLBA)
+         oldSecond = diskImage->partitions;
+   } // if
+   if (diskImage != NULL) {
+      newMainHeader = (memcmp(&mainHeader, &diskImage->mainHeader, sizeof(GPTHeader)) != 0);
+      newSecondHeader = (mainHeader.backupLBA != diskImage->mainHeader.backupLBA) ||
+                        (memcmp(&secondHeader, &diskImage->secondHeader, sizeof(GPTHeader)) != 0);
+      newMBR = (protectiveMBR.GetValidity() != gpt) ||
+               !protectiveMBR.SameContents(diskImage->protectiveMBR);
+   } // if
+
+   table = EncodeTable();
+   allOK = *backupOK = SaveChangedEntries(myDisk, secondHeader.partitionEntriesLBA, table, oldSecond);
+   if (newSecondHeader)
+      allOK = allOK && SaveHeader(&secondHeader, myDisk, mainHeader.backupLBA);
+   allOK = allOK && SaveChangedEntries(myDisk, mainHeader.partitionEntriesLBA, table, oldMain);
+   if (newMainHeader)
+      allOK = allOK && SaveHeader(&mainHeader, myDisk, 1);
+   if (newMBR)
+      allOK = allOK && protectiveMBR.WriteMBRData(&myDisk);
+   myDisk.Arena().Release();
+   return allOK;
+} // GPTData::WriteStructures()
+
+// Record the location of a partition that's just been created, for
+// GetNewExtents().
+void GPTData::NoteNewPartition(uint32_t partNum) {
+   Extent extent;
+
+   extent.firstLBA = partitions[partNum].GetFirstLBA();
+   extent.lastLBA = partitions[partNum].GetLastLBA();
+   extent.index = partNum;
+   newExtents.push_back(extent);
+} // GPTData::NoteNewPartition()
+
+// Fill extents with the partitions created since the table was loaded or
+// last saved, leaving out any that have since been deleted, moved, or
+// resized; each extent's index is its partition's number.
+void GPTData::GetNewExtents(vector<Extent> & extents) {
+   uint32_t i, p;
+   Extent extent;
+
+   extents.clear();
+   for (i = 0; i < newExtents.size(); i++) {
+      for (p = NextUsedPart(0); p < numParts; p = NextUsedPart(p + 1)) {
+         if ((firstLBAs[p] == newExtents[i].firstLBA) && (lastLBAs[p] == newExtents[i].lastLBA))
+            break;
+      } // for
+      if ((p < numParts) && (lastLBAs[p] >= firstLBAs[p])) {
+         extent.firstLBA = firstLBAs[p];
+         extent.lastLBA = lastLBAs[p];
+         extent.index = p;
+         extents.push_back(extent);
+      } // if
+   } // for
+} // GPTData::GetNewExtents()
+
+// Zero the parts of each partition created since the table was loaded or
+// last saved in which filesystems, RAID arrays, and volume managers keep
+// their signatures (see WIPE_HEAD_SIZE and WIPE_TAIL_SIZE), so that blkid
+// and udev don't take whatever used to be in that space for the new
+// partition's contents. Each partition gets one write of zeros at its
+// start and one at its end (just one, if the two run together); one that's
+// been deleted, moved, or resized since it was created is left alone.
+// myDisk must already be open for writing.
+// Returns the number of partitions wiped.
+int GPTData::WipeSignatures(void) {
+   unsigned char *zeros;
+   uint64_t length, head, headLength, tailLength, tailStart;
+   uint32_t i, p;
+   int numWiped = 0, allOK;
+   IOArenaMark mark;
+   vector<Extent> extents;
+
+   headLength = (WIPE_HEAD_SIZE + blockSize - 1) / blockSize;
+   tailLength = (WIPE_TAIL_SIZE + blockSize - 1) / blockSize;
+   mark = myDisk.Arena().Mark();
+   zeros = (unsigned char*) myDisk.Arena().Allocate((headLength + tailLength) * blockSize);
+   memset(zeros, 0, (headLength + tailLength) * blockSize);
+   GetNewExtents(extents);
+   for (i = 0; i < extents.size(); i++) {
+      p = extents[i].index;
+      length = lastLBAs[p] - firstLBAs[p] + 1;
+      head = min(headLength, length);
+      tailStart = (length > tailLength) ? (length - tailLength) : 0;
+      if (tailStart <= head) // the two run together
+         head = tailStart = length;
+      allOK = myDisk.Seek(firstLBAs[p]) &&
+              (myDisk.Write(zeros, (int) (head * blockSize)) == (int) (head * blockSize));
+      if (allOK && (tailStart < length))
+         allOK = myDisk.Seek(firstLBAs[p] + tailStart) &&
+                 (myDisk.Write(zeros, (int) ((length - tailStart) * blockSize)) ==
+                  (int) ((length - tailStart) * blockSize));
+      if (allOK)
+         numWiped++;
+      else
+         cerr << "Warning! Unable to wipe old signatures from partition " << p + 1 << "!\n";
+   } // for
+   myDisk.Arena().Rewind(mark);
+   if (numWiped > 0)
+      cout << "Wiped old signatures from " << numWiped << " new partition(s).\n";
+   return numWiped;
+} // GPTData::WipeSignatures()
+
+// Discard the sectors in extents (see DiskIO::DiscardSectors()), listing
+// each run of them. The extents are merged first, so that neighbouring
+// partitions or blocks of free space go to the disk as one request. If
+// dryRun is set, the runs are only listed. The first failure stops the
+// rest, since a disk that refuses one discard is apt to refuse them all.
+// Returns 1 if everything was discarded (or listed), 0 if not.
+int GPTData::DiscardExtents(vector<Extent> & extents, int dryRun) {
+   uint64_t total = 0;
+   size_t i, numDone = 0;
+   int allOK = 1;
+
+   MergeExtents(extents);
+   for (i = 0; (i < extents.size()) && allOK; i++) {
+      cout << (dryRun ? "Would discard" : "Discarding") << " sectors "
+           << extents[i].firstLBA << "-" << extents[i].lastLBA << " ("
+           << BytesToIeee(extents[i].lastLBA - extents[i].firstLBA + 1, blockSize) << ")\n";
+      if (!dryRun && !myDisk.DiscardSectors(extents[i].firstLBA,
+                                            extents[i].lastLBA - extents[i].firstLBA + 1)) {
+         cerr << "Warning! Unable to discard sectors on " << myDisk.GetName() << "! Errno is "
+              << errno << ".\n";
+         allOK = 0;
+      } else {
+         total += extents[i].lastLBA - extents[i].firstLBA + 1;
+         numDone++;
+      } // if/else
+   } // for
+   if (total > 0)
+      cout << (dryRun ? "Would discard " : "Discarded ") << BytesToIeee(total, blockSize)
+           << " in " << numDone << " request(s).\n";
+   return allOK;
+} // GPTData::DiscardExtents()
+
+// Write one of ReplicateGPTData()'s copies of the GPT data to its disk and
+// have the OS re-read its partition table. Several replicas may be doing
+// this at once, so it prints nothing; *synced is set to DiskSync()'s result
+// (0 if the write failed) and *err to errno if the disk couldn't be opened.
+// Returns 1 if the writes succeeded, 0 if any failed, or -1 if the disk
+// couldn't be opened for writing.
+int GPTData::WriteReplica(int *synced, int *err) {
+   int allOK = -1, backupOK = 0;
+
+   *synced = *err = 0;
+   if (myDisk.OpenForWrite()) {
+      allOK = WriteStructures(&backupOK);
+      if (backupOK)
+         *synced = myDisk.DiskSync(1);
+      myDisk.Close();
+   } else {
+      *err = errno;
+   } // if/else
+   return allOK;
+} // GPTData::WriteReplica()
+
+// Write this GPT data to all the devices in targets (the sgdisk -R option,
+// given a list of devices). The checks that don't depend on the target are
+// done just once; then each target gets a copy of the data with its backup
+// header and last usable sector moved to suit its size, and the copies are
+// written in parallel, up to MAX_REPLICATION_THREADS at a time, with one
+// line per target reported when they're all done. Note that, as with
+// SaveGPTData(), the GUIDs are copied verbatim.
+// Returns the number of targets that could not be written.
+int GPTData::ReplicateGPTData(const vector<string> & targets) {
+   size_t i, count = targets.size(), numDone = 0, numUnsynced = 0;
+   vector<GPTData*> replicas(count, (GPTData*) NULL);
+   vector<int> results(count, 0), synced(count, 0), errs(count, 0);
+   vector<string> problems(count);
+   uint64_t lastUsedBlock = 0;
+   ostringstream problem;
+
+   if ((CheckGPTSize() > 0) || (FindOverlaps() > 0) || (FindInsanePartitions() > 0)) {
+      cerr << "Aborting replication of the partition table!\n";
+      return (int) count;
+   } // if
+   FindHybridMismatches();
+   for (i = NextUsedPart(0); i < numParts; i = NextUsedPart((uint32_t) i + 1)) {
+      if (lastLBAs[i] > lastUsedBlock)
+         lastUsedBlock = lastLBAs[i];
+   } // for
+   // Build the partition-entry CRC tree now, so the copies inherit it.
+   PartitionsCRC();
+
+   // Fit a copy to each target. This is quick, so it's done serially.
+   for (i = 0; i < count; i++) {
+      problem.str("");
+      replicas[i] = new GPTData(*this);
+      replicas[i]->JustLooking(0);
+      // SetDisk() carries on regardless if the device can't be opened, so
+      // check that first.
+      if (!replicas[i]->myDisk.OpenForRead(targets[i])) {
+         problem << "unable to open";
+      } else {
+         replicas[i]->SetDisk(targets[i]);
+         if (replicas[i]->blockSize != blockSize) {
+            problem << "has " << replicas[i]->blockSize << "-byte sectors, not " << blockSize;
+         } else {
+            if ((replicas[i]->mainHeader.backupLBA != replicas[i]->diskSize - UINT64_C(1)) ||
+                (replicas[i]->mainHeader.lastUsableLBA >= replicas[i]->diskSize))
+               replicas[i]->MoveSecondHeaderToEnd();
+            if (replicas[i]->mainHeader.lastUsableLBA < lastUsedBlock)
+               problem << "too small (" << replicas[i]->diskSize << " sectors)";
+         } // if/else
+      } // if/else
+      problems[i] = problem.str();
+      if (problems[i] != "") {
+         results[i] = -2;
+      } else {
+         replicas[i]->RecomputeCRCs();
+      } // if/else
+   } // for
 
-   return (allOK);
-} // GPTData::SaveGPTData()
+#ifdef GPT_USE_THREADS
+   vector<thread> workers;
+   atomic<size_t> next(0);
+   auto writeNext = [&]() {
+      size_t j;
+
+      while ((j = next++) < count) {
+         if (results[j] == 0)
+            results[j] = replicas[j]->WriteReplica(&synced[j], &errs[j]);
+      } // while
+   };
+
+   try {
+      while ((workers.size() < MAX_REPLICATION_THREADS) && (workers.size() < count))
+         workers.push_back(thread(writeNext));
+   } catch (...) {
+      // Couldn't start another thread; make do with those already running
+   } // try/catch
+   writeNext();
+   for (i = 0; i < workers.size(); i++)
+      workers[i].join();
+#else
+   for (i = 0; i < count; i++) {
+      if (results[i] == 0)
+         results[i] = replicas[i]->WriteReplica(&synced[i], &errs[i]);
+   } // for
+#endif
+
+   for (i = 0; i < count; i++) {
+      cout << targets[i] << ": ";
+      switch (results[i]) {
+         case 1:
+            cout << "OK\n";
+            numDone++;
+            if (!synced[i])
+               numUnsynced++;
+            if (!replicas[i]->protectiveMBR.DoTheyFit())
+               cout << "   Warning! Partition(s) in the protective MBR are too big for this disk!\n";
+            break;
+         case -1:
+            cout << "unable to open for writing! Errno is " << errs[i] << "\n";
+            break;
+         case -2:
+            cout << problems[i] << "; skipped\n";
+            break;
+         default:
+            cout << "error writing the partition table! Checking the disk is advisable.\n";
+            break;
+      } // switch
+      delete replicas[i];
+   } // for
+   cout << "Replicated the partition table to " << numDone << " of " << count << " devices.\n";
+   if (numUnsynced > 0) {
+      cout << "The kernel may still be using the old partition table on " << numUnsynced
+           << " of them; reboot or run partprobe(8) to use the new one.\n";
+   } // if
+   return (int) (count - numDone);
+} // GPTData::ReplicateGPTData()
 
 // Save GPT data to a backup file. This function does much less error
 // checking than SaveGPTData(). It can therefore preserve many types of
@@ -1329,6 +2280,7 @@ int GPTData::SaveGPTData(int quiet) {
 int GPTData::SaveGPTBackup(const string & filename) {
    int allOK = 1;
    DiskIO backupFile;
+   GPTPart *table;
 
    if (backupFile.OpenForWrite(filename)) {
       // Recomputing the CRCs is likely to alter them, which could be bad
@@ -1349,8 +2301,11 @@ int GPTData::SaveGPTBackup(const string & filename) {
       if (allOK)
          allOK = SaveHeader(&secondHeader, backupFile, 2);
 
-      if (allOK)
-         allOK = SavePartitionTable(backupFile, 3);
+      if (allOK) {
+         table = EncodeTable();
+         allOK = SavePartitionTable(backupFile, 3, table);
+         myDisk.Arena().Release();
+      } // if
 
       if (allOK) { // writes completed OK
          cout << "The operation has completed successfully.\n";
@@ -1367,45 +2322,77 @@ int GPTData::SaveGPTBackup(const string & filename) {
 } // GPTData::SaveGPTBackup()
 
 // Write a GPT header (main or backup) to the specified sector. Used by both
-// the SaveGPTData() and SaveGPTBackup() functions.
-// Should be passed an architecture-appropriate header (DO NOT call
-// ReverseHeaderBytes() on the header before calling this function)
+// the SaveGPTData() and SaveGPTBackup() functions. The header is passed in
+// CPU byte order and is left untouched; it's converted to the on-disk form
+// in a copy.
 // Returns 1 on success, 0 on failure
-int GPTData::SaveHeader(struct GPTHeader *header, DiskIO & disk, uint64_t sector) {
-   int littleEndian, allOK = 1;
+int GPTData::SaveHeader(const struct GPTHeader *header, DiskIO & disk, uint64_t sector) {
+   struct GPTHeader diskHeader;
+   int allOK = 1;
 
-   littleEndian = IsLittleEndian();
-   if (!littleEndian)
-      ReverseHeaderBytes(header);
+   EncodeHeader(*header, &diskHeader);
    if (disk.Seek(sector)) {
-      if (disk.Write(header, 512) == -1)
+      if (disk.Write(&diskHeader, 512) == -1)
          allOK = 0;
    } else allOK = 0; // if (disk.Seek()...)
-   if (!littleEndian)
-      ReverseHeaderBytes(header);
    return allOK;
 } // GPTData::SaveHeader()
 
 // Save the partitions to the specified sector. Used by both the SaveGPTData()
-// and SaveGPTBackup() functions.
-// Should be passed an architecture-appropriate header (DO NOT call
-// ReverseHeaderBytes() on the header before calling this function)
+// and SaveGPTBackup() functions. table is the partition table in its on-disk
+// form, as returned by EncodeTable().
 // Returns 1 on success, 0 on failure
-int GPTData::SavePartitionTable(DiskIO & disk, uint64_t sector) {
-   int littleEndian, allOK = 1;
+int GPTData::SavePartitionTable(DiskIO & disk, uint64_t sector, GPTPart *table) {
+   int allOK = 1;
 
-   littleEndian = IsLittleEndian();
    if (disk.Seek(sector)) {
-      if (!littleEndian)
-         ReversePartitionBytes();
-      if (disk.Write(partitions, mainHeader.sizeOfPartitionEntries * numParts) == -1)
+      if (disk.Write(table, mainHeader.sizeOfPartitionEntries * numParts) == -1)
          allOK = 0;
-      if (!littleEndian)
-         ReversePartitionBytes();
    } else allOK = 0; // if (myDisk.Seek()...)
    return allOK;
 } // GPTData::SavePartitionTable()
 
+// Write the sectors of the partition table at sector whose entries differ
+// from those in oldParts, the copy of the table that's already there;
+// neighbouring changed sectors are written together. If oldParts is NULL,
+// writes the whole table. The data written comes from table, the on-disk
+// form of partitions (see EncodeTable()).
+// Returns 1 on success, 0 on failure.
+int GPTData::SaveChangedEntries(DiskIO & disk, uint64_t sector, GPTPart *table, GPTPart *oldParts) {
+   uint32_t perSector = blockSize / sizeof(GPTPart), first, last;
+   uint32_t *runs; // first entry, and one past the last, of each run
+   size_t i, numRuns = 0;
+   int allOK = 1;
+   IOArenaMark mark;
+
+   if ((oldParts == NULL) || (perSector == 0))
+      return SavePartitionTable(disk, sector, table);
+
+   mark = disk.Arena().Mark();
+   runs = (uint32_t*) disk.Arena().Allocate((numParts / perSector + 1) * 2 * sizeof(uint32_t));
+   if (oldParts != partitions) {
+      for (first = 0; first < numParts; first += perSector) {
+         last = min(first + perSector, numParts);
+         if (memcmp(&partitions[first], &oldParts[first], (last - first) * sizeof(GPTPart)) != 0) {
+            if ((numRuns > 0) && (runs[numRuns - 1] == first)) {
+               runs[numRuns - 1] = last;
+            } else {
+               runs[numRuns++] = first;
+               runs[numRuns++] = last;
+            } // if/else
+         } // if
+      } // for
+   } // if
+
+   for (i = 0; allOK && (i < numRuns); i += 2) {
+      if (!disk.Seek(sector + runs[i] / perSector) ||
+          (disk.Write(&table[runs[i]], (int) ((runs[i + 1] - runs[i]) * sizeof(GPTPart))) == -1))
+         allOK = 0;
+   } // for
+   disk.Arena().Rewind(mark);
+   return allOK;
+} // GPTData::SaveChangedEntries()
+
 // Load GPT data from a backup file created by SaveGPTBackup(). This function
 // does minimal error checking. It returns 1 if it completed successfully,
 // 0 if there was a problem. In the latter case, it creates a new empty
@@ -1474,6 +2461,7 @@ int GPTData::LoadGPTBackup(const string & filename) {
 } // GPTData::LoadGPTBackup()
 
 int GPTData::SaveMBR(void) {
+   ForgetDiskImage();
    return protectiveMBR.WriteMBRData(&myDisk);
 } // GPTData::SaveMBR()
 
@@ -1486,6 +2474,8 @@ int GPTData::DestroyGPT(void) {
    uint8_t* emptyTable;
 
    memset(blankSector, 0, sizeof(blankSector));
+   ForgetDiskImage();
+   ForgetDiskTables();
    ClearGPTData();
 
    if (myDisk.OpenForWrite()) {
@@ -1498,11 +2488,7 @@ int GPTData::DestroyGPT(void) {
       if (!myDisk.Seek(mainHeader.partitionEntriesLBA))
          allOK = 0;
       tableSize = numParts * mainHeader.sizeOfPartitionEntries;
-      emptyTable = new uint8_t[tableSize];
-      if (emptyTable == NULL) {
-         cerr << "Could not allocate memory in GPTData::DestroyGPT()! Terminating!\n";
-         exit(1);
-      } // if
+      emptyTable = (uint8_t*) myDisk.Arena().Allocate(tableSize);
       memset(emptyTable, 0, tableSize);
       if (allOK) {
          sum = myDisk.Write(emptyTable, tableSize);
@@ -1533,7 +2519,7 @@ int GPTData::DestroyGPT(void) {
       myDisk.Close();
       cout << "GPT data structures destroyed! You may now partition the disk using fdisk or\n"
            << "other utilities.\n";
-      delete[] emptyTable;
+      myDisk.Arena().Release();
    } else {
       cerr << "Problem opening '" << device << "' for writing! Program will now terminate.\n";
    } // if/else (fd != -1)
@@ -1547,6 +2533,7 @@ int GPTData::DestroyMBR(void) {
    uint8_t blankSector[512];
 
    memset(blankSector, 0, sizeof(blankSector));
+   ForgetDiskImage();
 
    allOK = myDisk.OpenForWrite() && myDisk.Seek(0) && (myDisk.Write(blankSector, 512) == 512);
 
@@ -1714,6 +2701,7 @@ void GPTData::XFormPartitions(void) {
    else
       numToConvert = numParts;
 
+   UnsharePartitions();
    for (i = 0; i < numToConvert; i++) {
       origType = protectiveMBR.GetType(i);
       // don't waste CPU time trying to convert extended, hybrid protective, or
@@ -1722,6 +2710,7 @@ void GPTData::XFormPartitions(void) {
           (origType != 0x00) && (origType != 0xEE))
          partitions[i] = protectiveMBR.AsGPT(i);
    } // for
+   TableChanged();
 
    // Convert MBR into protective MBR
    protectiveMBR.MakeProtectiveMBR();
@@ -1763,7 +2752,9 @@ int GPTData::XFormDisklabel(uint32_t partNum) {
       } // if/else
    } // if
    if (numDone > 0) { // converted partitions; delete carrier
+      UnsharePartitions();
       partitions[partNum].BlankPartition();
+      PartitionChanged(partNum);
    } // if
    return numDone;
 } // GPTData::XFormDisklabel(uint32_t i)
@@ -1772,11 +2763,13 @@ int GPTData::XFormDisklabel(uint32_t partNum) {
 int GPTData::XFormDisklabel(BSDData* disklabel) {
    int i, partNum = 0, numDone = 0;
 
+   UnsharePartitions();
    if (disklabel->IsDisklabel()) {
       for (i = 0; i < disklabel->GetNumParts(); i++) {
          partNum = FindFirstFreePart();
          if (partNum >= 0) {
             partitions[partNum] = disklabel->AsGPT(i);
+            PartitionChanged(partNum);
             if (partitions[partNum].IsUsed())
                numDone++;
          } // if
@@ -1879,16 +2872,17 @@ int GPTData::SetGPTSize(uint32_t numEntries, int fillGPTSectors) {
                   copyNum = numEntries;
                else
                   copyNum = numParts;
-               for (i = 0; i < copyNum; i++) {
-                  newParts[i] = partitions[i];
-               } // for
-               delete[] partitions;
+               memcpy(newParts, partitions, copyNum * sizeof(GPTPart));
+               ReleasePartitions();
                partitions = newParts;
+               partsRefs = new uint32_t(1);
             } // if
          } else { // No existing partition table; just create it
             partitions = newParts;
+            partsRefs = new uint32_t(1);
          } // if/else existing partitions
          numParts = numEntries;
+         TableChanged();
          mainHeader.firstUsableLBA = GetTableSizeInSectors() + mainHeader.partitionEntriesLBA;
          secondHeader.firstUsableLBA = mainHeader.firstUsableLBA;
          MoveSecondHeaderToEnd();
@@ -1942,9 +2936,11 @@ int GPTData::MoveSecondTable(uint64_t pteSector) {
 void GPTData::BlankPartitions(void) {
    uint32_t i;
 
+   UnsharePartitions();
    for (i = 0; i < numParts; i++) {
       partitions[i].BlankPartition();
    } // for
+   TableChanged();
 } // GPTData::BlankPartitions()
 
 // Delete a partition by number. Returns 1 if successful,
@@ -1963,7 +2959,9 @@ int GPTData::DeletePartition(uint32_t partNum) {
       protectiveMBR.DeleteByLocation(startSector, length);
 
       // Now delete the GPT partition
+      UnsharePartitions();
       partitions[partNum].BlankPartition();
+      PartitionChanged(partNum);
    } else {
       cerr << "Partition number " << partNum + 1 << " out of range!\n";
       retval = 0;
@@ -1985,10 +2983,13 @@ uint32_t GPTData::CreatePartition(uint32_t partNum, uint64_t startSector, uint64
       } // if
       if (IsFree(startSector) && (startSector <= endSector)) {
          if (FindLastInFree(startSector) >= endSector) {
+            UnsharePartitions();
             partitions[partNum].SetFirstLBA(startSector);
             partitions[partNum].SetLastLBA(endSector);
             partitions[partNum].SetType(DEFAULT_GPT_TYPE);
             partitions[partNum].RandomizeUniqueGUID();
+            PartitionChanged(partNum);
+            NoteNewPartition(partNum);
          } else retval = 0; // if free space until endSector
       } else retval = 0; // if startSector is free
    } else retval = 0; // if legal partition number
@@ -1996,10 +2997,53 @@ uint32_t GPTData::CreatePartition(uint32_t partNum, uint64_t startSector, uint64
 } // GPTData::CreatePartition(partNum, startSector, endSector)
 
 // Sort the GPT entries, eliminating gaps and making for a logical
-// ordering.
+// ordering: by starting sector, with empty entries (starting sector 0)
+// last, as GPTPart::operator<() has it. This is a radix sort, a byte at a
+// time, of the entry numbers by starting sector (less one, so that 0 wraps
+// around to sort last), which is stable, so entries that start at the same
+// sector stay in the same order. The entries themselves are copied just
+// once, into a new array, at the end.
 void GPTData::SortGPT(void) {
-   if (numParts > 0)
-      sort(partitions, partitions + numParts);
+   vector<uint64_t> keys(numParts);
+   vector<uint32_t> order(numParts), sorted(numParts);
+   uint32_t counts[256], i, total, count;
+   GPTPart *newParts;
+   int shift;
+
+   if (numParts > 0) {
+      for (i = 0; i < numParts; i++) {
+         keys[i] = partitions[i].GetFirstLBA() - 1;
+         order[i] = i;
+      } // for
+      for (shift = 0; shift < 64; shift += 8) {
+         memset(counts, 0, sizeof(counts));
+         for (i = 0; i < numParts; i++)
+            counts[(keys[i] >> shift) & 0xFF]++;
+         if (counts[(keys[0] >> shift) & 0xFF] == numParts)
+            continue; // every key has the same byte here; nothing to do
+         for (i = 0, total = 0; i < 256; i++) {
+            count = counts[i];
+            counts[i] = total;
+            total += count;
+         } // for
+         for (i = 0; i < numParts; i++)
+            sorted[counts[(keys[order[i]] >> shift) & 0xFF]++] = order[i];
+         order.swap(sorted);
+      } // for
+
+      newParts = new GPTPart [numParts];
+      if (newParts == NULL) {
+         cerr << "Error! Could not allocate memory for partitions in GPTData::SortGPT()!\n"
+              << "Terminating!\n";
+         exit(1);
+      } // if
+      for (i = 0; i < numParts; i++)
+         memcpy(&newParts[i], &partitions[order[i]], sizeof(GPTPart));
+      ReleasePartitions();
+      partitions = newParts;
+      partsRefs = new uint32_t(1);
+      TableChanged();
+   } // if
 } // GPTData::SortGPT()
 
 // Swap the contents of two partitions.
@@ -2013,9 +3057,12 @@ int GPTData::SwapPartitions(uint32_t partNum1, uint32_t partNum2) {
 
    if ((partNum1 < numParts) && (partNum2 < numParts)) {
       if (partNum1 != partNum2) {
+         UnsharePartitions();
          temp = partitions[partNum1];
          partitions[partNum1] = partitions[partNum2];
          partitions[partNum2] = temp;
+         PartitionChanged(partNum1);
+         PartitionChanged(partNum2);
       } // if
    } else allOK = 0; // partition numbers are valid
    return allOK;
@@ -2031,8 +3078,7 @@ int GPTData::ClearGPTData(void) {
    int goOn = 1, i;
 
    // Set up the partition table....
-   delete[] partitions;
-   partitions = NULL;
+   ReleasePartitions();
    SetGPTSize(NUM_GPT_ENTRIES);
 
    // Now initialize a bunch of stuff that's static....
@@ -2096,15 +3142,156 @@ void GPTData::MoveSecondHeaderToEnd() {
    // TODO: Whenever this gets called, it moves the backup table to be the same distance from the backup header as the primary one it from its header. This seems highly problematic, since MoveMainTable does not call this, but then further actions may or may not do so. Moving the primary table may thus imply moving the backup table, or it may leave it where it was. There is also no guarantee that the space where the backup table is moved to is actually available.
 } // GPTData::FixSecondHeaderLocation()
 
+// Extend the partition's end through the free space that follows it, up
+// to the last usable sector (or the last one that keeps the end aligned,
+// if alignEnd is true); its start is left alone, so that a filesystem in
+// it can then be grown in place. Used by sgdisk's --grow option after
+// MoveSecondHeaderToEnd() has claimed the space added to a grown disk.
+// If nothing else changes before the data are saved, SaveGPTData() tells
+// the kernel about the partition's new size rather than asking it to
+// re-read the whole table, which it won't do while the disk is in use.
+// Returns 1 if the partition grew, 0 if it couldn't (unused partition
+// or no free space after it).
+int GPTData::GrowPartition(uint32_t partNum, bool alignEnd) {
+   uint64_t next, newEnd;
+
+   if (!IsUsedPartNum(partNum))
+      return 0;
+   next = lastLBAs[partNum] + 1;
+   if (!IsFree(next))
+      return 0;
+   newEnd = FindLastInFree(next, alignEnd);
+   UnsharePartitions();
+   partitions[partNum].SetLastLBA(newEnd);
+   PartitionChanged(partNum);
+   grownPart = partNum;
+   return 1;
+} // GPTData::GrowPartition()
+
+// Move the partition, data and all, so that it starts at newStart. The new
+// location must be within the usable space and clear of every other
+// partition, but it may overlap the old one. The data are moved first (see
+// DataMover, which keeps its progress in checkpointFile, if that's not
+// empty, so that an interrupted move can be resumed by repeating it), and
+// only then is the partition's entry changed; the partition table, with
+// that change and any others made so far, is saved at once, since the
+// old table no longer describes the data.
+// Returns 1 on success, 0 on failure.
+int GPTData::MovePartition(uint32_t partNum, uint64_t newStart, const string & checkpointFile) {
+   uint64_t oldStart, newEnd;
+   uint32_t i;
+   DataMover mover(myDisk.GetName());
+
+   if (!IsUsedPartNum(partNum) || (lastLBAs[partNum] < firstLBAs[partNum])) {
+      cerr << "Partition " << partNum + 1 << " doesn't exist or is invalid; can't move it!\n";
+      return 0;
+   } // if
+   oldStart = firstLBAs[partNum];
+   newEnd = newStart + (lastLBAs[partNum] - oldStart);
+   if ((newStart < mainHeader.firstUsableLBA) || (newEnd > mainHeader.lastUsableLBA) ||
+       (newEnd < newStart)) {
+      cerr << "Partition " << partNum + 1 << " won't fit at sector " << newStart << "!\n";
+      return 0;
+   } // if
+   for (i = 0; i < numParts; i++) {
+      if ((i != partNum) && (firstLBAs[i] <= newEnd) && (lastLBAs[i] >= newStart)) {
+         cerr << "Partition " << partNum + 1 << " would overlap partition " << i + 1
+              << " at sector " << newStart << "!\n";
+         return 0;
+      } // if
+   } // for
+   if (justLooking) {
+      cout << "The justLooking flag is set. This probably means you can't write to the disk.\n";
+      return 0;
+   } // if
+   // Don't move anything if SaveGPTData() would then refuse to save the table
+   if ((CheckGPTSize() > 0) || (FindOverlaps() > 0) || (FindInsanePartitions() > 0)) {
+      cerr << "Not moving partition " << partNum + 1 << " until these problems are fixed!\n";
+      return 0;
+   } // if
+   if (newStart == oldStart)
+      return 1;
+
+   mover.SetCheckpointFile(checkpointFile);
+   mover.UseDirectIO();
+   if (!mover.Move(oldStart, newStart, newEnd - newStart + 1)) {
+      cerr << "Unable to move partition " << partNum + 1 << "'s data; the partition table "
+           << "hasn't been changed.\n";
+      return 0;
+   } // if
+   UnsharePartitions();
+   partitions[partNum].SetFirstLBA(newStart);
+   partitions[partNum].SetLastLBA(newEnd);
+   PartitionChanged(partNum);
+   if (!SaveGPTData(1)) {
+      cerr << "Warning! Partition " << partNum + 1 << "'s data have been moved to sector "
+           << newStart << ", but the partition table\ncouldn't be saved! Repeating the move ";
+      if (checkpointFile != "")
+         cerr << "with the same checkpoint file will try to save it again.\n";
+      else
+         cerr << "WILL DAMAGE THE DATA; edit the table by hand instead.\n";
+      return 0;
+   } // if
+   mover.RemoveCheckpoint();
+   return 1;
+} // GPTData::MovePartition()
+
+// Discard the unallocated space between the first and last usable sectors,
+// so that an SSD can reclaim it. This acts on the disk at once, so the
+// partition table in memory must match the one on the disk. Since anything
+// wrong with the table (a bad CRC, a damaged main table, overlapping or
+// out-of-range partitions) could make live data look free, nothing is
+// discarded unless the GPT data are valid and Verify() would find no
+// problems. If dryRun is set, the blocks of free space are only listed.
+// Returns 1 on success, 0 on failure.
+int GPTData::DiscardFreeSpace(int dryRun) {
+   vector<GPTProblem> problems;
+   vector<Extent> freeSpace;
+   int allOK;
+
+   if ((state != gpt_valid) || (FindProblems(problems, &freeSpace) > 0)) {
+      cerr << "The partition table has problems (use -v or 'v' to see them); not discarding\n"
+           << "free space!\n";
+      return 0;
+   } // if
+   if (freeSpace.empty()) {
+      cout << "No free space to discard.\n";
+      return 1;
+   } // if
+   if (!dryRun && !myDisk.OpenForWrite()) {
+      cerr << "Unable to open device '" << myDisk.GetName() << "' for writing! Errno is "
+           << errno << "!\n";
+      return 0;
+   } // if
+   allOK = DiscardExtents(freeSpace, dryRun);
+   if (!dryRun)
+      myDisk.Close();
+   return allOK;
+} // GPTData::DiscardFreeSpace()
+
+// Discard the contents of the partitions created since the table was loaded
+// or last saved (as GetNewExtents() finds them). SaveGPTData() calls this,
+// with the disk open for writing, if DiscardOnCreate() has been set; with
+// dryRun set, it lists what would be discarded.
+// Returns 1 on success, 0 on failure.
+int GPTData::DiscardNewPartitions(int dryRun) {
+   vector<Extent> extents;
+
+   GetNewExtents(extents);
+   return DiscardExtents(extents, dryRun);
+} // GPTData::DiscardNewPartitions()
+
 // Sets the partition's name to the specified UnicodeString without
 // user interaction.
 // Returns 1 on success, 0 on failure (invalid partition number).
 int GPTData::SetName(uint32_t partNum, const UnicodeString & theName) {
    int retval = 1;
 
-   if (IsUsedPartNum(partNum))
+   if (IsUsedPartNum(partNum)) {
+      UnsharePartitions();
       partitions[partNum].SetName(theName);
-   else
+      PartitionChanged(partNum);
+   } else
       retval = 0;
 
    return retval;
@@ -2113,6 +3300,7 @@ int GPTData::SetName(uint32_t partNum, const UnicodeString & theName) {
 // Set the disk GUID to the specified value. Note that the header CRCs must
 // be recomputed after calling this function.
 void GPTData::SetDiskGUID(GUIDData newGUID) {
+   grownPart = UINT32_MAX; // the OS has to re-read the table to see this
    mainHeader.diskGUID = newGUID;
    secondHeader.diskGUID = newGUID;
 } // SetDiskGUID()
@@ -2125,7 +3313,9 @@ int GPTData::SetPartitionGUID(uint32_t pn, GUIDData theGUID) {
 
    if (pn < numParts) {
       if (partitions[pn].IsUsed()) {
+         UnsharePartitions();
          partitions[pn].SetUniqueGUID(theGUID);
+         PartitionChanged(pn);
          retval = 1;
       } // if
    } // if
@@ -2139,9 +3329,11 @@ void GPTData::RandomizeGUIDs(void) {
 
    mainHeader.diskGUID.Randomize();
    secondHeader.diskGUID = mainHeader.diskGUID;
-   for (i = 0; i < numParts; i++)
-      if (partitions[i].IsUsed())
-         partitions[i].RandomizeUniqueGUID();
+   UnsharePartitions();
+   for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1)) {
+      partitions[i].RandomizeUniqueGUID();
+      PartitionChanged(i);
+   } // for
 } // GPTData::RandomizeGUIDs()
 
 // Change partition type code non-interactively. Returns 1 if
@@ -2150,7 +3342,9 @@ int GPTData::ChangePartType(uint32_t partNum, PartType theGUID) {
    int retval = 1;
 
    if (!IsFreePartNum(partNum)) {
+      UnsharePartitions();
       partitions[partNum].SetType(theGUID);
+      PartitionChanged(partNum);
    } else retval = 0;
    return retval;
 } // GPTData::ChangePartType()
@@ -2177,37 +3371,28 @@ void GPTData::RecomputeCHS(void) {
 // This function returns 1 if the alignment was altered, 0 if it
 // was unchanged.
 int GPTData::Align(uint64_t* sector) {
-   int retval = 0, sectorOK = 0;
-   uint64_t earlier, later, testSector;
+   int retval = 0, i;
+   uint64_t earlier, later;
 
    if ((*sector % sectorAlignment) != 0) {
       earlier = (*sector / sectorAlignment) * sectorAlignment;
       later = earlier + (uint64_t) sectorAlignment;
+      const vector<Extent> & freeSpace = FreeExtents();
 
-      // Check to see that every sector between the earlier one and the
-      // requested one is clear, and that it's not too early....
-      if (earlier >= mainHeader.firstUsableLBA) {
-         testSector = earlier;
-         do {
-            sectorOK = IsFree(testSector++);
-         } while ((sectorOK == 1) && (testSector < *sector));
-         if (sectorOK == 1) {
-            *sector = earlier;
-            retval = 1;
-         } // if
-      } // if firstUsableLBA check
-
-      // If couldn't move the sector earlier, try to move it later instead....
-      if ((sectorOK != 1) && (later <= mainHeader.lastUsableLBA)) {
-         testSector = later;
-         do {
-            sectorOK = IsFree(testSector--);
-         } while ((sectorOK == 1) && (testSector > *sector));
-         if (sectorOK == 1) {
+      // Move the sector earlier if every sector between the earlier one and
+      // the requested one is clear....
+      i = FindExtent(freeSpace, earlier);
+      if ((i >= 0) && (freeSpace[i].lastLBA >= *sector - 1)) {
+         *sector = earlier;
+         retval = 1;
+      } else {
+         // ...otherwise try to move it later instead
+         i = FindExtent(freeSpace, *sector + 1);
+         if ((i >= 0) && (freeSpace[i].lastLBA >= later)) {
             *sector = later;
             retval = 1;
          } // if
-      } // if
+      } // if/else
    } // if
    return retval;
 } // GPTData::Align()
@@ -2226,51 +3411,236 @@ int GPTData::Align(uint64_t* sector) {
 // position exists. Thus, the return value is the only way to
 // tell when no partitions exist.
 int GPTData::GetPartRange(uint32_t *low, uint32_t *high) {
-   uint32_t i;
-   int numFound = 0;
-
-   *low = numParts + 1; // code for "not found"
-   *high = 0;
-   for (i = 0; i < numParts; i++) {
-      if (partitions[i].IsUsed()) { // it exists
-         *high = i; // since we're counting up, set the high value
-         // Set the low value only if it's not yet found...
-         if (*low == (numParts + 1)) *low = i;
-            numFound++;
-      } // if
-   } // for
-
-   // Above will leave *low pointing to its "not found" value if no partitions
-   // are defined, so reset to 0 if this is the case....
-   if (*low == (numParts + 1))
-      *low = 0;
-   return numFound;
+   size_t w;
+
+   *low = *high = 0;
+   if (numUsed > 0) {
+      w = 0;
+      while (usedSlots[w] == 0)
+         w++;
+      *low = w * 64 + LowestSetBit(usedSlots[w]);
+      w = usedSlots.size() - 1;
+      while (usedSlots[w] == 0)
+         w--;
+      *high = w * 64 + HighestSetBit(usedSlots[w]);
+   } // if
+   return numUsed;
 } // GPTData::GetPartRange()
 
 // Returns the value of the first free partition, or -1 if none is
 // unused.
 int GPTData::FindFirstFreePart(void) {
-   int i = 0;
-
-   if (partitions != NULL) {
-      while ((i < (int) numParts) && (partitions[i].IsUsed()))
-         i++;
-      if (i >= (int) numParts)
-         i = -1;
-   } else i = -1;
+   size_t w = 0;
+   int i = -1;
+
+   if ((partitions != NULL) && (numUsed < numParts)) {
+      while (usedSlots[w] == UINT64_MAX)
+         w++;
+      i = (int) (w * 64 + LowestSetBit(~usedSlots[w]));
+   } // if
    return i;
 } // GPTData::FindFirstFreePart()
 
+// Returns the number of the first partition at or after start that's in
+// use, or numParts if there are none. Loops over the used partitions can
+// be written as:
+// for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1))
+uint32_t GPTData::NextUsedPart(uint32_t start) {
+   size_t w = start / 64;
+   uint64_t word;
+
+   if ((start >= numParts) || (w >= usedSlots.size()))
+      return numParts;
+   word = usedSlots[w] & (UINT64_MAX << (start % 64));
+   while (word == 0) {
+      if (++w >= usedSlots.size())
+         return numParts;
+      word = usedSlots[w];
+   } // while
+   return (uint32_t) (w * 64 + LowestSetBit(word));
+} // GPTData::NextUsedPart()
+
+// Returns the number of the lowest-numbered partition whose unique GUID is
+// guid, or numParts if there's no such partition.
+uint32_t GPTData::FindPartitionByGUID(const GUIDData & guid) {
+   uint32_t hash = guid.Hash(), mask, bucket, partNum, found = numParts;
+
+   if (guidIndex.empty())
+      return numParts;
+   mask = (uint32_t) guidIndex.size() - 1;
+   for (bucket = hash & mask; guidIndex[bucket].entry != 0; bucket = (bucket + 1) & mask) {
+      partNum = guidIndex[bucket].entry - 1;
+      if ((guidIndex[bucket].hash == hash) && (partNum < found) &&
+          (partitions[partNum].GetUniqueGUID() == guid))
+         found = partNum;
+   } // for
+   return found;
+} // GPTData::FindPartitionByGUID()
+
 // Returns the number of defined partitions.
 uint32_t GPTData::CountParts(void) {
-   uint32_t i, counted = 0;
+   return numUsed;
+} // GPTData::CountParts()
 
-   for (i = 0; i < numParts; i++) {
-      if (partitions[i].IsUsed())
-         counted++;
+// Update the bitmap of used partitions (and anything else that's derived
+// from the partition entries) after partNum has been altered.
+void GPTData::PartitionChanged(uint32_t partNum) {
+   uint64_t bit;
+   int wasUsed;
+
+   grownPart = UINT32_MAX; // GrowPartition() sets it again afterwards
+   freeExtentsStale = 1;
+   if ((usedSlots.size() != (numParts + 63) / 64) || (firstLBAs.size() != numParts) ||
+       (guidBuckets.size() != numParts)) {
+      TableChanged();
+   } else if ((partitions != NULL) && (partNum < numParts)) {
+      firstLBAs[partNum] = partitions[partNum].GetFirstLBA();
+      lastLBAs[partNum] = partitions[partNum].GetLastLBA();
+      bit = UINT64_C(1) << (partNum % 64);
+      wasUsed = ((usedSlots[partNum / 64] & bit) != 0);
+      if (partitions[partNum].IsUsed() && !wasUsed) {
+         usedSlots[partNum / 64] |= bit;
+         numUsed++;
+      } else if (!partitions[partNum].IsUsed() && wasUsed) {
+         usedSlots[partNum / 64] &= ~bit;
+         numUsed--;
+      } // if/else if
+      UnindexGUID(partNum);
+      if (partitions[partNum].IsUsed())
+         IndexGUID(partNum);
+      if (!entryCRCs.empty()) {
+         uint32_t node = crcLeaves + partNum, span = 1;
+
+         entryCRCs[node] = EntryCRC(partNum);
+         for (node /= 2; node > 0; node /= 2) {
+            CombineEntryCRCs(node, span);
+            span *= 2;
+         } // for
+      } // if
+   } // if/else if
+} // GPTData::PartitionChanged()
+
+// Rebuild the bitmap of used partitions (and anything else that's derived
+// from the partition entries) after the whole table has been loaded,
+// resized, or rearranged.
+void GPTData::TableChanged(void) {
+   GUIDBucket empty = {0, 0};
+   uint32_t i, indexSize = 1;
+
+   grownPart = UINT32_MAX;
+   freeExtentsStale = 1;
+   usedSlots.assign((numParts + 63) / 64, 0);
+   numUsed = 0;
+   if ((partitions != NULL) && (numParts > 0))
+      numUsed = GetUsedMask(partitions, numParts, &usedSlots[0]);
+   firstLBAs.resize(numParts);
+   lastLBAs.resize(numParts);
+   for (i = 0; (partitions != NULL) && (i < numParts); i++) {
+      firstLBAs[i] = partitions[i].GetFirstLBA();
+      lastLBAs[i] = partitions[i].GetLastLBA();
    } // for
-   return counted;
-} // GPTData::CountParts()
+   entryCRCs.clear(); // rebuilt by PartitionsCRC() when next needed
+
+   // Keep the GUID index no more than half full, so probes stay short
+   while (indexSize < numParts * 2)
+      indexSize *= 2;
+   guidIndex.assign(indexSize, empty);
+   guidBuckets.assign(numParts, UINT32_MAX);
+   for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1))
+      IndexGUID(i);
+} // GPTData::TableChanged()
+
+// Add partNum, which must be in use and not already indexed, to the index
+// of unique GUIDs.
+void GPTData::IndexGUID(uint32_t partNum) {
+   uint32_t mask = (uint32_t) guidIndex.size() - 1;
+   uint32_t hash = partitions[partNum].GetUniqueGUID().Hash();
+   uint32_t bucket = hash & mask;
+
+   while (guidIndex[bucket].entry != 0)
+      bucket = (bucket + 1) & mask;
+   guidIndex[bucket].entry = partNum + 1;
+   guidIndex[bucket].hash = hash;
+   guidBuckets[partNum] = bucket;
+} // GPTData::IndexGUID()
+
+// Remove partNum from the index of unique GUIDs, if it's there. Entries
+// further along the same run of buckets are moved back to fill the hole,
+// so that lookups can stop at the first empty bucket. This works from the
+// stored hashes, so it's safe even if partNum's GUID has already changed.
+void GPTData::UnindexGUID(uint32_t partNum) {
+   uint32_t mask = (uint32_t) guidIndex.size() - 1;
+   uint32_t hole = guidBuckets[partNum], bucket, home;
+
+   if (hole == UINT32_MAX)
+      return;
+   guidBuckets[partNum] = UINT32_MAX;
+   guidIndex[hole].entry = 0;
+   for (bucket = (hole + 1) & mask; guidIndex[bucket].entry != 0; bucket = (bucket + 1) & mask) {
+      // The entry can move back into the hole only if that doesn't put it
+      // ahead of its home bucket.
+      home = guidIndex[bucket].hash & mask;
+      if (((bucket - home) & mask) >= ((bucket - hole) & mask)) {
+         guidIndex[hole] = guidIndex[bucket];
+         guidBuckets[guidIndex[hole].entry - 1] = hole;
+         guidIndex[bucket].entry = 0;
+         hole = bucket;
+      } // if
+   } // for
+} // GPTData::UnindexGUID()
+
+// Compute the CRC of one partition entry, as it's stored on disk.
+uint32_t GPTData::EntryCRC(uint32_t partNum) {
+   GPTPart temp;
+
+   if (IsLittleEndian())
+      return chksum_crc32((unsigned char*) &partitions[partNum], GPT_SIZE);
+   EncodeEntries(partNum, 1, &temp);
+   return chksum_crc32((unsigned char*) &temp, GPT_SIZE);
+} // GPTData::EntryCRC()
+
+// Set the CRC in entryCRCs[node] from those of its two children, each of
+// which covers span partition entries (less, for the right-hand child, if
+// it runs off the end of the table).
+void GPTData::CombineEntryCRCs(uint32_t node, uint32_t span) {
+   uint32_t right = node * 2 + 1;
+   uint32_t firstEntry = (right - crcLeaves / span) * span; // first entry under right
+   uint64_t rightSize = 0;
+
+   if (firstEntry < numParts)
+      rightSize = (uint64_t) min(span, numParts - firstEntry) * GPT_SIZE;
+   if (rightSize > 0)
+      entryCRCs[node] = chksum_crc32_combine(entryCRCs[right - 1], entryCRCs[right], rightSize);
+   else
+      entryCRCs[node] = entryCRCs[right - 1];
+} // GPTData::CombineEntryCRCs()
+
+// Return the CRC of the whole partition array. The per-entry CRCs are kept
+// in a binary tree (leaf i of entryCRCs is at crcLeaves + i, and node n's
+// children are 2n and 2n + 1), with each inner node holding the CRC of
+// everything under it, so the root is the CRC of the whole array. After
+// PartitionChanged(), only one entry needs to be rehashed and O(log n) CRCs
+// combined; the tree is rebuilt from scratch only after TableChanged().
+// Must be called on platform-ordered data.
+uint32_t GPTData::PartitionsCRC(void) {
+   uint32_t i, node, span, levelStart;
+
+   if ((partitions == NULL) || (numParts == 0))
+      return 0;
+   if (entryCRCs.empty() || (numParts > crcLeaves) || (numParts <= crcLeaves / 2)) {
+      crcLeaves = 1;
+      while (crcLeaves < numParts)
+         crcLeaves *= 2;
+      entryCRCs.assign(crcLeaves * 2, 0);
+      for (i = 0; i < numParts; i++)
+         entryCRCs[crcLeaves + i] = EntryCRC(i);
+      for (levelStart = crcLeaves / 2, span = 1; levelStart > 0; levelStart /= 2, span *= 2) {
+         for (node = levelStart; node < levelStart * 2; node++)
+            CombineEntryCRCs(node, span);
+      } // for
+   } // if
+   return entryCRCs[1];
+} // GPTData::PartitionsCRC()
 
 /****************************************************
  *                                                  *
@@ -2299,10 +3669,9 @@ uint64_t GPTData::FindFirstAvailable(uint64_t start) {
    // cases where partitions are out of sequential order....
    do {
       firstMoved = 0;
-      for (i = 0; i < numParts; i++) {
-         if ((partitions[i].IsUsed()) && (first >= partitions[i].GetFirstLBA()) &&
-             (first <= partitions[i].GetLastLBA())) { // in existing part.
-            first = partitions[i].GetLastLBA() + 1;
+      for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1)) {
+         if ((first >= firstLBAs[i]) && (first <= lastLBAs[i])) { // in existing part.
+            first = lastLBAs[i] + 1;
             firstMoved = 1;
          } // if
       } // for
@@ -2318,9 +3687,9 @@ uint64_t GPTData::FindFirstUsedLBA(void) {
     uint32_t i;
     uint64_t firstFound = UINT64_MAX;
 
-    for (i = 0; i < numParts; i++) {
-        if ((partitions[i].IsUsed()) && (partitions[i].GetFirstLBA() < firstFound)) {
-            firstFound = partitions[i].GetFirstLBA();
+    for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1)) {
+        if (firstLBAs[i] < firstFound) {
+            firstFound = firstLBAs[i];
         } // if
     } // for
     return firstFound;
@@ -2332,9 +3701,9 @@ uint64_t GPTData::FindLastUsedLBA(void) {
    uint32_t i;
    uint64_t lastFound = 0;
 
-   for (i = 0; i < numParts; i++) {
-      if ((partitions[i].IsUsed()) && (partitions[i].GetFirstLBA() > lastFound)) {
-         lastFound = partitions[i].GetLastLBA();
+   for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1)) {
+      if (firstLBAs[i] > lastFound) {
+         lastFound = lastLBAs[i];
       } // if
    } // for
    return lastFound;
@@ -2378,9 +3747,8 @@ uint64_t GPTData::FindLastAvailable(void) {
    do {
       lastMoved = 0;
       for (i = 0; i < numParts; i++) {
-         if ((last >= partitions[i].GetFirstLBA()) &&
-             (last <= partitions[i].GetLastLBA())) { // in existing part.
-            last = partitions[i].GetFirstLBA() - 1;
+         if ((last >= firstLBAs[i]) && (last <= lastLBAs[i])) { // in existing part.
+            last = firstLBAs[i] - 1;
             lastMoved = 1;
          } // if
       } // for
@@ -2401,9 +3769,8 @@ uint64_t GPTData::FindLastInFree(uint64_t start, bool align) {
 
    nearestEnd = mainHeader.lastUsableLBA;
    for (i = 0; i < numParts; i++) {
-      if ((nearestEnd > partitions[i].GetFirstLBA()) &&
-          (partitions[i].GetFirstLBA() > start)) {
-         nearestEnd = partitions[i].GetFirstLBA() - 1;
+      if ((nearestEnd > firstLBAs[i]) && (firstLBAs[i] > start)) {
+         nearestEnd = firstLBAs[i] - 1;
       } // if
    } // for
    if (align) {
@@ -2454,8 +3821,7 @@ int GPTData::IsFree(uint64_t sector, uint32_t *partNum) {
    uint32_t i;
 
    for (i = 0; i < numParts; i++) {
-      if ((sector >= partitions[i].GetFirstLBA()) &&
-           (sector <= partitions[i].GetLastLBA())) {
+      if ((sector >= firstLBAs[i]) && (sector <= lastLBAs[i])) {
          isFree = 0;
          if (partNum != NULL)
             *partNum = i;
@@ -2470,16 +3836,202 @@ int GPTData::IsFree(uint64_t sector, uint32_t *partNum) {
    return (isFree);
 } // GPTData::IsFree()
 
+// Return the unallocated blocks of sectors between the first and last
+// usable LBAs, in order. As with IsFree(), every table entry's range counts
+// as allocated, whether or not its type code is set. The list is cached, so
+// this costs O(n log n) in the number of entries only after the table or its
+// usable LBAs have changed. The reference is good until the next change.
+const vector<Extent> & GPTData::FreeExtents(void) {
+   uint32_t i;
+   Extent extent;
+   vector<Extent> used;
+
+   if (freeExtentsStale || (freeExtentsFirst != mainHeader.firstUsableLBA) ||
+       (freeExtentsLast != mainHeader.lastUsableLBA)) {
+      for (i = 0; i < numParts; i++) {
+         if ((firstLBAs[i] <= lastLBAs[i]) && (lastLBAs[i] >= mainHeader.firstUsableLBA)) {
+            extent.firstLBA = firstLBAs[i];
+            extent.lastLBA = lastLBAs[i];
+            extent.index = i;
+            used.push_back(extent);
+         } // if
+      } // for
+      FindFreeExtents(used, mainHeader.firstUsableLBA, mainHeader.lastUsableLBA, freeExtents);
+      freeBySize.clear();
+      for (i = 0; i < freeExtents.size(); i++)
+         freeBySize.insert(make_pair(freeExtents[i].lastLBA - freeExtents[i].firstLBA + 1,
+                                     freeExtents[i].firstLBA));
+      freeExtentsFirst = mainHeader.firstUsableLBA;
+      freeExtentsLast = mainHeader.lastUsableLBA;
+      freeExtentsStale = 0;
+   } // if
+   return freeExtents;
+} // GPTData::FreeExtents()
+
+// Fill freeSpace with a copy of the blocks FreeExtents() returns.
+void GPTData::GetFreeExtents(vector<Extent> & freeSpace) {
+   freeSpace = FreeExtents();
+} // GPTData::GetFreeExtents()
+
+// Free space comes as a sorted vector of Extents (from GPTData) or as a map
+// from first to last LBA (from a Transaction); these let ChooseExtent()
+// work on either.
+static inline uint64_t BlockFirst(vector<Extent>::const_iterator it) {return it->firstLBA;}
+static inline uint64_t BlockLast(vector<Extent>::const_iterator it) {return it->lastLBA;}
+static inline uint64_t BlockFirst(map<uint64_t, uint64_t>::const_iterator it) {return it->first;}
+static inline uint64_t BlockLast(map<uint64_t, uint64_t>::const_iterator it) {return it->second;}
+
+static bool EndsBefore(const Extent & extent, uint64_t sector) {
+   return extent.lastLBA < sector;
+} // EndsBefore()
+
+// Return the first block that ends at or after sector (a binary search).
+static vector<Extent>::const_iterator FirstBlockFrom(const vector<Extent> & blocks,
+                                                     uint64_t sector) {
+   return lower_bound(blocks.begin(), blocks.end(), sector, EndsBefore);
+} // FirstBlockFrom()
+
+static map<uint64_t, uint64_t>::const_iterator FirstBlockFrom(const map<uint64_t, uint64_t> & blocks,
+                                                              uint64_t sector) {
+   map<uint64_t, uint64_t>::const_iterator it = blocks.upper_bound(sector), prev = it;
+
+   if ((it != blocks.begin()) && ((--prev)->second >= sector))
+      it = prev;
+   return it;
+} // FirstBlockFrom()
+
+// Place a partition in the free block from blockFirst to blockLast, which
+// must have room for size sectors; see AllocateExtent() for the rules.
+static void PlaceInBlock(uint64_t blockFirst, uint64_t blockLast, uint64_t size,
+                         uint32_t alignment, AllocPolicy policy, bool alignEnd,
+                         uint64_t *firstLBA, uint64_t *lastLBA) {
+   uint64_t start, end, aligned;
+
+   if ((policy == alloc_last) && (size > 0)) {
+      end = blockLast;
+      start = ((blockLast - size + 1) / alignment) * alignment;
+      if (start >= blockFirst)
+         end = start + size - 1;
+      else
+         start = blockLast - size + 1;
+   } else {
+      start = blockFirst;
+      if ((start % alignment) != 0) {
+         aligned = (start / alignment + 1) * alignment;
+         if (aligned <= blockLast)
+            start = aligned;
+      } // if
+      if ((size > 0) && (size > blockLast - start + 1))
+         start = blockFirst; // no room to align the start
+      if (size > 0) {
+         end = start + size - 1;
+      } else {
+         end = blockLast;
+         aligned = ((blockLast + 1) / alignment) * alignment;
+         if (alignEnd && (aligned > start))
+            end = aligned - 1;
+      } // if/else
+   } // if/else
+   *firstLBA = start;
+   *lastLBA = end;
+} // PlaceInBlock()
+
+// Choose space for a new partition from blocks, the sorted blocks of free
+// space; this is the work behind AllocateExtent() (which explains the other
+// arguments), shared by GPTData and Transaction. bySize, if it's not NULL,
+// indexes the same blocks by size. alignment must be non-zero.
+// A binary search finds the first block at or after searchFrom. First-fit
+// and last then stop at the first block that fits, counting from their end
+// of the list. Best-fit and largest take O(log n) time with bySize, but
+// compare every block after searchFrom without it, or when searchFrom cuts
+// into the list.
+// Returns 1 and sets *firstLBA and *lastLBA if space was found, 0 if not.
+template <class Blocks>
+static int ChooseExtent(const Blocks & blocks, const FreeSizeIndex *bySize, uint64_t size,
+                        uint32_t alignment, AllocPolicy policy, uint64_t *firstLBA,
+                        uint64_t *lastLBA, bool alignEnd, uint64_t searchFrom) {
+   typename Blocks::const_iterator from = FirstBlockFrom(blocks, searchFrom), it;
+   FreeSizeIndex::const_iterator best;
+   int found = 0;
+   uint64_t blockFirst = 0, blockLast = 0, first, chosenSize = 0;
+
+   if (policy == alloc_first_fit) {
+      for (it = from; (it != blocks.end()) && (!found); it++) {
+         blockFirst = max(BlockFirst(it), searchFrom);
+         blockLast = BlockLast(it);
+         found = ((size == 0) || (size <= blockLast - blockFirst + 1));
+      } // for
+   } else if (policy == alloc_last) {
+      for (it = blocks.end(); (it != from) && (!found); ) {
+         it--;
+         blockFirst = max(BlockFirst(it), searchFrom);
+         blockLast = BlockLast(it);
+         found = ((size == 0) || (size <= blockLast - blockFirst + 1));
+      } // for
+   } else if ((bySize != NULL) && (from == blocks.begin()) &&
+              ((from == blocks.end()) || (BlockFirst(from) >= searchFrom))) {
+      // Nothing's cut off by searchFrom, so the index can be used; ties go
+      // to the earlier block, as in the loop below
+      best = bySize->end();
+      if ((policy == alloc_largest) && (!bySize->empty()))
+         best = bySize->lower_bound(make_pair(bySize->rbegin()->first, (uint64_t) 0));
+      else if (policy == alloc_best_fit)
+         best = bySize->lower_bound(make_pair(size, (uint64_t) 0));
+      if ((best != bySize->end()) && (best->first >= size)) {
+         blockFirst = best->second;
+         blockLast = best->second + best->first - 1;
+         found = 1;
+      } // if
+   } else {
+      for (it = from; it != blocks.end(); it++) {
+         first = max(BlockFirst(it), searchFrom);
+         if ((size > 0) && (size > BlockLast(it) - first + 1))
+            continue;
+         if ((!found) ||
+             ((policy == alloc_largest) && (BlockLast(it) - first + 1 > chosenSize)) ||
+             ((policy == alloc_best_fit) && (BlockLast(it) - first + 1 < chosenSize))) {
+            blockFirst = first;
+            blockLast = BlockLast(it);
+            chosenSize = blockLast - blockFirst + 1;
+            found = 1;
+         } // if
+      } // for
+   } // if/else
+   if (found)
+      PlaceInBlock(blockFirst, blockLast, size, alignment, policy, alignEnd, firstLBA, lastLBA);
+   return found;
+} // ChooseExtent()
+
+// Find space for a new partition of size sectors, starting on a multiple of
+// alignment (sectorAlignment if alignment is 0) when the free block has room
+// for that. The block is chosen according to policy; alloc_largest and
+// alloc_best_fit compare the sizes of whole free blocks, with ties going to
+// the earlier block. If size is 0, the partition fills the rest of the
+// chosen block, and if alignEnd is true, its end is pulled back so that
+// the following sector is aligned, when that's possible. Only space at or
+// after searchFrom is considered. alloc_last places a sized partition at
+// the end of its block rather than the start.
+// Returns 1 and sets *firstLBA and *lastLBA if space was found, 0 if not.
+int GPTData::AllocateExtent(uint64_t size, uint32_t alignment, AllocPolicy policy,
+                            uint64_t *firstLBA, uint64_t *lastLBA, bool alignEnd,
+                            uint64_t searchFrom) {
+   if (alignment == 0)
+      alignment = sectorAlignment;
+   FreeExtents(); // brings freeBySize up to date, too
+   return ChooseExtent(freeExtents, &freeBySize, size, alignment, policy, firstLBA, lastLBA,
+                       alignEnd, searchFrom);
+} // GPTData::AllocateExtent()
+
 // Returns 1 if partNum is unused AND if it's a legal value.
 int GPTData::IsFreePartNum(uint32_t partNum) {
    return ((partNum < numParts) && (partitions != NULL) &&
-           (!partitions[partNum].IsUsed()));
+           ((usedSlots[partNum / 64] & (UINT64_C(1) << (partNum % 64))) == 0));
 } // GPTData::IsFreePartNum()
 
 // Returns 1 if partNum is in use.
 int GPTData::IsUsedPartNum(uint32_t partNum) {
    return ((partNum < numParts) && (partitions != NULL) &&
-           (partitions[partNum].IsUsed()));
+           ((usedSlots[partNum / 64] & (UINT64_C(1) << (partNum % 64))) != 0));
 } // GPTData::IsUsedPartNum()
 
 /***********************************************************
@@ -2528,18 +4080,16 @@ uint32_t GPTData::ComputeAlignment(void) {
    if (blockSize > 0)
       align = DEFAULT_ALIGNMENT * SECTOR_SIZE / blockSize;
    exponent = (uint32_t) log2(align);
-   for (i = 0; i < numParts; i++) {
-      if (partitions[i].IsUsed()) {
-         found = 0;
-         while (!found) {
-            align = UINT64_C(1) << exponent;
-            if ((partitions[i].GetFirstLBA() % align) == 0) {
-               found = 1;
-            } else {
-               exponent--;
-            } // if/else
-         } // while
-      } // if
+   for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1)) {
+      found = 0;
+      while (!found) {
+         align = UINT64_C(1) << exponent;
+         if ((firstLBAs[i] % align) == 0) {
+            found = 1;
+         } else {
+            exponent--;
+         } // if/else
+      } // while
    } // for
    if ((align < MIN_AF_ALIGNMENT) && (diskSize >= SMALLEST_ADVANCED_FORMAT))
       align = MIN_AF_ALIGNMENT;
@@ -2570,10 +4120,44 @@ void GPTData::ReverseHeaderBytes(struct GPTHeader* header) {
    ReverseBytes(header->reserved2, GPT_RESERVED);
 } // GPTData::ReverseHeaderBytes()
 
+// Copy header into diskHeader in its on-disk (little-endian) form.
+void GPTData::EncodeHeader(const struct GPTHeader & header, struct GPTHeader *diskHeader) {
+   *diskHeader = header;
+   if (!IsLittleEndian())
+      ReverseHeaderBytes(diskHeader);
+} // GPTData::EncodeHeader()
+
+// Copy count partition entries, starting with entry first, into diskParts
+// in their on-disk (little-endian) form.
+void GPTData::EncodeEntries(uint32_t first, uint32_t count, GPTPart *diskParts) {
+   uint32_t i;
+
+   for (i = 0; i < count; i++) {
+      diskParts[i] = partitions[first + i];
+      if (!IsLittleEndian())
+         diskParts[i].ReversePartBytes();
+   } // for
+} // GPTData::EncodeEntries()
+
+// Returns the whole partition table in its on-disk form, ready to be
+// written. On little-endian CPUs that's partitions itself; elsewhere it's a
+// converted copy in myDisk's I/O arena, which lasts until the save that
+// wanted it releases the arena.
+GPTPart* GPTData::EncodeTable(void) {
+   GPTPart *table;
+
+   if (IsLittleEndian())
+      return partitions;
+   table = (GPTPart*) myDisk.Arena().Allocate(numParts * sizeof(GPTPart));
+   EncodeEntries(0, numParts, table);
+   return table;
+} // GPTData::EncodeTable()
+
 // Reverse byte order for all partitions.
 void GPTData::ReversePartitionBytes() {
    uint32_t i;
 
+   UnsharePartitions();
    for (i = 0; i < numParts; i++) {
       partitions[i].ReversePartBytes();
    } // for
@@ -2627,7 +4211,9 @@ int GPTData::ManageAttributes(int partNum, const string & command, const string
       } else {
          theAttr = partitions[partNum].GetAttributes();
          if (theAttr.OperateOnAttributes(partNum, command, bits)) {
+            UnsharePartitions();
             partitions[partNum].SetAttributes(theAttr.GetAttributes());
+            PartitionChanged(partNum);
             retval = 1;
          } else {
             retval = -1;
@@ -2650,6 +4236,680 @@ void GPTData::GetAttribute(const uint32_t partNum, const string& attributeBits)
       partitions[partNum].GetAttributes().OperateOnAttributes(partNum, "get", attributeBits);
 } // GPTData::GetAttribute
 
+/*************************************************************
+ *                                                           *
+ * Snapshots of the table, for undo & redo in interactive    *
+ * sessions and for saving only what's changed since loading *
+ *                                                           *
+ *************************************************************/
+
+// Record the table's current state as one that Undo() can return to. Call
+// before each command that might change the table; if the command turns
+// out to change nothing, the snapshot is dropped again when the next undo
+// point is saved (or by CloseUndoPoint()), so it doesn't take up an undo
+// step.
+void GPTData::SaveUndoPoint(void) {
+   CloseUndoPoint();
+   undoStates.push_back(TakeSnapshot());
+   if (undoStates.size() > MAX_UNDO_LEVELS) {
+      DeleteSnapshot(undoStates.front());
+      undoStates.erase(undoStates.begin());
+   } // if
+   undoPointOpen = 1;
+} // GPTData::SaveUndoPoint()
+
+// Finish the undo point saved by the last SaveUndoPoint() call: drop it if
+// the table hasn't changed since then; otherwise the table has moved on, so
+// anything that was undone can no longer be redone.
+void GPTData::CloseUndoPoint(void) {
+   uint32_t i;
+
+   if (undoPointOpen) {
+      if (MatchesSnapshot(undoStates.back())) {
+         DeleteSnapshot(undoStates.back());
+         undoStates.pop_back();
+      } else {
+         for (i = 0; i < redoStates.size(); i++)
+            DeleteSnapshot(redoStates[i]);
+         redoStates.clear();
+      } // if/else
+      undoPointOpen = 0;
+   } // if
+} // GPTData::CloseUndoPoint()
+
+// Return the table to the state it was in before the most recent change.
+// Nothing is read from or written to the disk. Returns 1 if a change was
+// undone, 0 if there was nothing to undo.
+int GPTData::Undo(void) {
+   CloseUndoPoint();
+   if (undoStates.empty())
+      return 0;
+   redoStates.push_back(TakeSnapshot());
+   RestoreSnapshot(undoStates.back());
+   DeleteSnapshot(undoStates.back());
+   undoStates.pop_back();
+   return 1;
+} // GPTData::Undo()
+
+// Reapply the change most recently undone. Returns 1 if a change was
+// redone, 0 if there was nothing to redo.
+int GPTData::Redo(void) {
+   CloseUndoPoint();
+   if (redoStates.empty())
+      return 0;
+   undoStates.push_back(TakeSnapshot());
+   RestoreSnapshot(redoStates.back());
+   DeleteSnapshot(redoStates.back());
+   redoStates.pop_back();
+   return 1;
+} // GPTData::Redo()
+
+// Returns a new snapshot of the table, sharing its partition array.
+GPTSnapshot* GPTData::TakeSnapshot(void) {
+   GPTSnapshot *snap;
+
+   snap = new GPTSnapshot;
+   if (snap == NULL) {
+      cerr << "Error! Could not allocate memory in GPTData::TakeSnapshot()! Terminating!\n";
+      exit(1);
+   } // if
+   snap->mainHeader = mainHeader;
+   snap->secondHeader = secondHeader;
+   snap->partitions = partitions;
+   snap->partsRefs = partsRefs;
+   if (partsRefs != NULL)
+      (*partsRefs)++;
+   snap->numParts = numParts;
+   snap->protectiveMBR.CopyContents(protectiveMBR);
+   snap->state = state;
+   snap->mainCrcOk = mainCrcOk;
+   snap->secondCrcOk = secondCrcOk;
+   snap->mainPartsCrcOk = mainPartsCrcOk;
+   snap->secondPartsCrcOk = secondPartsCrcOk;
+   return snap;
+} // GPTData::TakeSnapshot()
+
+// Put the table back the way it was when snap was taken. The snapshot is
+// left intact; the table shares its partition array.
+void GPTData::RestoreSnapshot(GPTSnapshot *snap) {
+   if (snap->partsRefs != NULL)
+      (*snap->partsRefs)++;
+   ReleasePartitions();
+   partitions = snap->partitions;
+   partsRefs = snap->partsRefs;
+   numParts = snap->numParts;
+   mainHeader = snap->mainHeader;
+   secondHeader = snap->secondHeader;
+   protectiveMBR.CopyContents(snap->protectiveMBR);
+   state = snap->state;
+   mainCrcOk = snap->mainCrcOk;
+   secondCrcOk = snap->secondCrcOk;
+   mainPartsCrcOk = snap->mainPartsCrcOk;
+   secondPartsCrcOk = snap->secondPartsCrcOk;
+   TableChanged();
+} // GPTData::RestoreSnapshot()
+
+// Returns 1 if two headers match in everything but their CRCs, which are
+// brought up to date whenever the table is checked or saved.
+static int SameHeaderData(struct GPTHeader a, struct GPTHeader b) {
+   a.headerCRC = b.headerCRC = 0;
+   a.partitionEntriesCRC = b.partitionEntriesCRC = 0;
+   return (memcmp(&a, &b, sizeof(GPTHeader)) == 0);
+} // SameHeaderData()
+
+// Returns 1 if the table is the same as it was when snap was taken, 0 if
+// it's changed. Since changing an entry unshares the partition array (see
+// UnsharePartitions()), the entries need comparing only if the array has
+// been replaced.
+int GPTData::MatchesSnapshot(GPTSnapshot *snap) {
+   int same;
+
+   same = (numParts == snap->numParts) && (state == snap->state) &&
+          SameHeaderData(mainHeader, snap->mainHeader) &&
+          SameHeaderData(secondHeader, snap->secondHeader) &&
+          protectiveMBR.SameContents(snap->protectiveMBR);
+   if (same && (partitions != snap->partitions))
+      same = (memcmp(partitions, snap->partitions, numParts * sizeof(GPTPart)) == 0);
+   return same;
+} // GPTData::MatchesSnapshot()
+
+// Free snap, and its partition array if nothing else shares it.
+void GPTData::DeleteSnapshot(GPTSnapshot *snap) {
+   ReleaseSharedArray(snap->partitions, snap->partsRefs);
+   delete snap;
+} // GPTData::DeleteSnapshot()
+
+// Forget all undo and redo states.
+void GPTData::ClearUndoHistory(void) {
+   uint32_t i;
+
+   for (i = 0; i < undoStates.size(); i++)
+      DeleteSnapshot(undoStates[i]);
+   for (i = 0; i < redoStates.size(); i++)
+      DeleteSnapshot(redoStates[i]);
+   undoStates.clear();
+   redoStates.clear();
+   undoPointOpen = 0;
+} // GPTData::ClearUndoHistory()
+
+// Note that the table in memory is what's on the disk, so that the next
+// save can skip anything that hasn't changed since.
+void GPTData::RecordDiskImage(void) {
+   ForgetDiskImage();
+   diskImage = TakeSnapshot();
+} // GPTData::RecordDiskImage()
+
+// Forget what's on the disk, after writing something to it other than with
+// SaveGPTData() or if it's not known what a write left there.
+void GPTData::ForgetDiskImage(void) {
+   if (diskImage != NULL) {
+      DeleteSnapshot(diskImage);
+      diskImage = NULL;
+   } // if
+} // GPTData::ForgetDiskImage()
+
+// Remember the main (which == 0) or backup (which == 1) partition table as
+// it's been read from, or written to, the disk at lba. If table is NULL,
+// that's the working table, which is then shared; otherwise table is a
+// numParts-entry array in host byte order that this object takes over.
+void GPTData::KeepDiskTable(int which, uint64_t lba, uint32_t crc, GPTPart *table) {
+   GPTDiskTable *kept = &diskTables[which];
+
+   ReleaseSharedArray(kept->partitions, kept->partsRefs);
+   if ((table != NULL) && (memcmp(table, partitions, numParts * sizeof(GPTPart)) == 0)) {
+      delete[] table;
+      table = NULL;
+   } // if
+   if (table == NULL) {
+      kept->partitions = partitions;
+      kept->partsRefs = partsRefs;
+      if (partsRefs != NULL)
+         (*partsRefs)++;
+   } else {
+      kept->partitions = table;
+      kept->partsRefs = new uint32_t(1);
+   } // if/else
+   kept->numParts = numParts;
+   kept->lba = lba;
+   kept->crc = crc;
+} // GPTData::KeepDiskTable()
+
+// Forget the partition tables read from the disk.
+void GPTData::ForgetDiskTables(void) {
+   int i;
+
+   for (i = 0; i < 2; i++) {
+      ReleaseSharedArray(diskTables[i].partitions, diskTables[i].partsRefs);
+      diskTables[i].partitions = NULL;
+      diskTables[i].partsRefs = NULL;
+   } // for
+} // GPTData::ForgetDiskTables()
+
+// Return the partition table that header points to, if it's been kept in
+// memory, or NULL if it hasn't.
+GPTDiskTable* GPTData::FindDiskTable(const struct GPTHeader & header) {
+   int i;
+
+   for (i = 0; i < 2; i++) {
+      if ((diskTables[i].partitions != NULL) && (diskTables[i].numParts == header.numParts) &&
+          (diskTables[i].lba == header.partitionEntriesLBA))
+         return &diskTables[i];
+   } // for
+   return NULL;
+} // GPTData::FindDiskTable()
+
+// List the numbers of the partition entries in which table (which has
+// numParts entries) differs from the working table.
+void GPTData::ListTableDifferences(GPTPart *table) {
+   const uint32_t maxListed = 32;
+   uint32_t i, numDiffs = 0;
+
+   for (i = 0; i < numParts; i++) {
+      if (memcmp(&table[i], &partitions[i], sizeof(GPTPart)) != 0) {
+         if (numDiffs == 0)
+            cerr << "Partition table entries that differ:";
+         if (numDiffs < maxListed)
+            cerr << " " << i + 1;
+         numDiffs++;
+      } // if
+   } // for
+   if (numDiffs > maxListed)
+      cerr << " (and " << numDiffs - maxListed << " more)";
+   if (numDiffs > 0)
+      cerr << "\n";
+} // GPTData::ListTableDifferences()
+
+/***************************************************
+ *                                                 *
+ * GPTData::Transaction: batches of partition edits *
+ *                                                 *
+ ***************************************************/
+
+GPTData::Transaction::Transaction(GPTData & theGPT) : gpt(theGPT) {
+   Abort();
+} // GPTData::Transaction constructor
+
+// Throw away any edits made so far, and start again from the GPTData's
+// current state.
+void GPTData::Transaction::Abort(void) {
+   const vector<Extent> & blocks = gpt.FreeExtents();
+   size_t i;
+   uint64_t first, last, covered = 0;
+
+   staged.clear();
+   deleted.clear();
+   created.clear();
+   usedSlots = gpt.usedSlots;
+   freeSpace.clear();
+   freeBySize = gpt.freeBySize;
+   for (i = 0; i < blocks.size(); i++) {
+      freeSpace.insert(freeSpace.end(), make_pair(blocks[i].firstLBA, blocks[i].lastLBA));
+      covered += blocks[i].lastLBA - blocks[i].firstLBA + 1;
+   } // for
+
+   // If the entries' usable sectors plus the free ones add up to more than
+   // the usable space, some entries overlap, and Release() must take care.
+   for (i = 0; i < gpt.numParts; i++) {
+      first = max(gpt.firstLBAs[i], gpt.mainHeader.firstUsableLBA);
+      last = min(gpt.lastLBAs[i], gpt.mainHeader.lastUsableLBA);
+      if (first <= last)
+         covered += last - first + 1;
+   } // for
+   overlapping = (covered != gpt.mainHeader.lastUsableLBA - gpt.mainHeader.firstUsableLBA + 1);
+} // GPTData::Transaction::Abort()
+
+// Apply the edits to the GPTData. If any partitions were created, the
+// resulting table is then checked, just once, for new partitions that are
+// out of bounds or that overlap others, and if there are any, all of the
+// edits are undone. (Problems that the table already had are left for
+// Verify() to report.) Either way, the Transaction is left empty, ready
+// for another batch.
+// Returns 1 if the edits were kept, 0 if they were undone.
+int GPTData::Transaction::Commit(void) {
+   map<uint32_t, GPTPart>::iterator it;
+   vector<GPTPart> original;
+   size_t i;
+   int allOK = 1;
+
+   if (!staged.empty()) {
+      gpt.UnsharePartitions();
+      original.reserve(staged.size());
+      for (it = staged.begin(); it != staged.end(); it++) {
+         original.push_back(gpt.partitions[it->first]);
+         gpt.partitions[it->first] = it->second;
+         gpt.PartitionChanged(it->first);
+      } // for
+      if (!created.empty() && (CheckCreated() > 0)) {
+         cerr << "Discarding a batch of " << staged.size() << " partition edits!\n";
+         for (it = staged.begin(), i = 0; it != staged.end(); it++, i++) {
+            gpt.partitions[it->first] = original[i];
+            gpt.PartitionChanged(it->first);
+         } // for
+         allOK = 0;
+      } else {
+         // As GPTData::DeletePartition() does, delete any matching MBR
+         // partitions, too.
+         for (i = 0; i < deleted.size(); i++)
+            gpt.protectiveMBR.DeleteByLocation(deleted[i].firstLBA,
+                                               deleted[i].lastLBA - deleted[i].firstLBA + 1);
+         for (set<uint32_t>::iterator c = created.begin(); c != created.end(); c++)
+            gpt.NoteNewPartition(*c);
+      } // if/else
+   } // if
+   Abort();
+   return allOK;
+} // GPTData::Transaction::Commit()
+
+// Check the partitions created by this Transaction, once its edits have
+// been applied, for overlaps with other partitions and for sanity. Only
+// the problems that involve the new partitions are reported.
+// Returns the number of problems found.
+int GPTData::Transaction::CheckCreated(void) {
+   set<uint32_t>::iterator it;
+   uint32_t i;
+   size_t k;
+   int problems = 0;
+   Extent extent;
+   vector<Extent> extents;
+   vector<ExtentOverlap> overlaps;
+
+   for (it = created.begin(); it != created.end(); it++) {
+      i = *it;
+      if (gpt.IsUsedPartNum(i) && ((gpt.firstLBAs[i] > gpt.lastLBAs[i]) ||
+          (gpt.firstLBAs[i] < gpt.mainHeader.firstUsableLBA) ||
+          (gpt.lastLBAs[i] > gpt.mainHeader.lastUsableLBA))) {
+         cout << "\nProblem: partition " << i + 1 << " is out of bounds.\n";
+         problems++;
+      } // if
+   } // for
+   for (i = gpt.NextUsedPart(0); i < gpt.numParts; i = gpt.NextUsedPart(i + 1)) {
+      if (gpt.firstLBAs[i] <= gpt.lastLBAs[i]) {
+         extent.firstLBA = gpt.firstLBAs[i];
+         extent.lastLBA = gpt.lastLBAs[i];
+         extent.index = i;
+         extents.push_back(extent);
+      } // if
+   } // for
+   FindExtentOverlaps(extents, overlaps);
+   for (k = 0; k < overlaps.size(); k++) {
+      if (created.count(overlaps[k].low) || created.count(overlaps[k].high)) {
+         cout << "\nProblem: partitions " << overlaps[k].high + 1 << " and "
+              << overlaps[k].low + 1 << " overlap\n";
+         problems++;
+      } // if
+   } // for
+   return problems;
+} // GPTData::Transaction::CheckCreated()
+
+// Returns the partNum entry as it stands with the edits made so far.
+const GPTPart & GPTData::Transaction::Current(uint32_t partNum) {
+   map<uint32_t, GPTPart>::iterator it = staged.find(partNum);
+
+   if (it != staged.end())
+      return it->second;
+   return gpt.partitions[partNum];
+} // GPTData::Transaction::Current()
+
+// Returns a modifiable copy of the partNum entry, to be stored in the
+// GPTData by Commit().
+GPTPart & GPTData::Transaction::Staged(uint32_t partNum) {
+   map<uint32_t, GPTPart>::iterator it = staged.find(partNum);
+
+   if (it == staged.end())
+      it = staged.insert(make_pair(partNum, gpt.partitions[partNum])).first;
+   return it->second;
+} // GPTData::Transaction::Staged()
+
+// Bring the usedSlots bit for partNum up to date after an edit to the
+// staged copy of the entry.
+void GPTData::Transaction::UpdateSlot(uint32_t partNum) {
+   uint64_t bit = UINT64_C(1) << (partNum % 64);
+
+   if (Staged(partNum).IsUsed())
+      usedSlots[partNum / 64] |= bit;
+   else
+      usedSlots[partNum / 64] &= ~bit;
+} // GPTData::Transaction::UpdateSlot()
+
+// Returns 1 and sets *blockLast to the end of the free block that holds
+// sector, or returns 0 if sector isn't free.
+int GPTData::Transaction::FreeBlockAt(uint64_t sector, uint64_t *blockLast) {
+   map<uint64_t, uint64_t>::iterator it = freeSpace.upper_bound(sector);
+
+   if (it == freeSpace.begin())
+      return 0;
+   it--;
+   if (it->second < sector)
+      return 0;
+   *blockLast = it->second;
+   return 1;
+} // GPTData::Transaction::FreeBlockAt()
+
+// Mark first through last, which must lie within one free block, as used.
+void GPTData::Transaction::Claim(uint64_t first, uint64_t last) {
+   map<uint64_t, uint64_t>::iterator it = freeSpace.upper_bound(first);
+   uint64_t blockFirst, blockLast;
+
+   it--;
+   blockFirst = it->first;
+   blockLast = it->second;
+   EraseBlock(it);
+   if (blockFirst < first)
+      InsertBlock(blockFirst, first - 1);
+   if (last < blockLast)
+      InsertBlock(last + 1, blockLast);
+} // GPTData::Transaction::Claim()
+
+// Mark the usable sectors from first through last, which a deleted
+// partition held, as free, apart from any that other entries still hold.
+void GPTData::Transaction::Release(uint64_t first, uint64_t last) {
+   vector<Extent> others, pieces;
+   Extent extent;
+   uint32_t i;
+   size_t k;
+
+   if (first < gpt.mainHeader.firstUsableLBA)
+      first = gpt.mainHeader.firstUsableLBA;
+   if (last > gpt.mainHeader.lastUsableLBA)
+      last = gpt.mainHeader.lastUsableLBA;
+   if (first > last)
+      return;
+   if (!overlapping) {
+      AddFreeBlock(first, last);
+   } else {
+      for (i = 0; i < gpt.numParts; i++) {
+         extent.firstLBA = Current(i).GetFirstLBA();
+         extent.lastLBA = Current(i).GetLastLBA();
+         extent.index = i;
+         if ((extent.firstLBA <= extent.lastLBA) && (extent.firstLBA <= last) &&
+             (extent.lastLBA >= first))
+            others.push_back(extent);
+      } // for
+      FindFreeExtents(others, first, last, pieces);
+      for (k = 0; k < pieces.size(); k++)
+         AddFreeBlock(pieces[k].firstLBA, pieces[k].lastLBA);
+   } // if/else
+} // GPTData::Transaction::Release()
+
+// Add first through last to the free space, merging them with any free
+// blocks that they touch.
+void GPTData::Transaction::AddFreeBlock(uint64_t first, uint64_t last) {
+   map<uint64_t, uint64_t>::iterator it, prev;
+
+   it = freeSpace.upper_bound(first);
+   if (it != freeSpace.begin()) {
+      prev = it;
+      prev--;
+      if (prev->second + 1 >= first) {
+         first = prev->first;
+         last = max(last, prev->second);
+         EraseBlock(prev);
+      } // if
+   } // if
+   it = freeSpace.lower_bound(first);
+   while ((it != freeSpace.end()) && (it->first <= last + 1)) {
+      last = max(last, it->second);
+      EraseBlock(it++);
+   } // while
+   InsertBlock(first, last);
+} // GPTData::Transaction::AddFreeBlock()
+
+// Add the free block from first through last, which mustn't touch any
+// other, to freeSpace and freeBySize.
+void GPTData::Transaction::InsertBlock(uint64_t first, uint64_t last) {
+   freeSpace[first] = last;
+   freeBySize.insert(make_pair(last - first + 1, first));
+} // GPTData::Transaction::InsertBlock()
+
+// Remove a free block from freeSpace and freeBySize.
+void GPTData::Transaction::EraseBlock(map<uint64_t, uint64_t>::iterator it) {
+   freeBySize.erase(make_pair(it->second - it->first + 1, it->first));
+   freeSpace.erase(it);
+} // GPTData::Transaction::EraseBlock()
+
+int GPTData::Transaction::IsFreePartNum(uint32_t partNum) {
+   return ((partNum < gpt.numParts) && (gpt.partitions != NULL) &&
+           ((usedSlots[partNum / 64] & (UINT64_C(1) << (partNum % 64))) == 0));
+} // GPTData::Transaction::IsFreePartNum()
+
+int GPTData::Transaction::IsUsedPartNum(uint32_t partNum) {
+   return ((partNum < gpt.numParts) && (gpt.partitions != NULL) &&
+           ((usedSlots[partNum / 64] & (UINT64_C(1) << (partNum % 64))) != 0));
+} // GPTData::Transaction::IsUsedPartNum()
+
+// Returns the first unused entry, or -1 if there are none.
+int GPTData::Transaction::FindFirstFreePart(void) {
+   size_t w;
+   uint32_t i;
+
+   for (w = 0; (gpt.partitions != NULL) && (w < usedSlots.size()); w++) {
+      if (usedSlots[w] != UINT64_MAX) {
+         i = (uint32_t) (w * 64) + LowestSetBit(~usedSlots[w]);
+         return (i < gpt.numParts) ? (int) i : -1;
+      } // if
+   } // for
+   return -1;
+} // GPTData::Transaction::FindFirstFreePart()
+
+// Returns the number of the lowest-numbered partition whose unique GUID is
+// guid once the edits are applied, or the table size if there's none.
+uint32_t GPTData::Transaction::FindPartitionByGUID(const GUIDData & guid) {
+   map<uint32_t, GPTPart>::iterator it;
+   uint32_t found = gpt.FindPartitionByGUID(guid);
+
+   if (staged.find(found) != staged.end()) {
+      // The edits moved or deleted the GUID the index knows of, so look
+      // through every entry
+      for (found = 0; found < gpt.numParts; found++) {
+         if (IsUsedPartNum(found) && (Current(found).GetUniqueGUID() == guid))
+            break;
+      } // for
+   } else {
+      // An edited entry below the index's match may have taken the GUID
+      for (it = staged.begin(); (it != staged.end()) && (it->first < found); it++) {
+         if (IsUsedPartNum(it->first) && (it->second.GetUniqueGUID() == guid)) {
+            found = it->first;
+            break;
+         } // if
+      } // for
+   } // if/else
+   return found;
+} // GPTData::Transaction::FindPartitionByGUID()
+
+int GPTData::Transaction::IsFree(uint64_t sector) {
+   uint64_t blockLast;
+
+   return FreeBlockAt(sector, &blockLast);
+} // GPTData::Transaction::IsFree()
+
+int GPTData::Transaction::Align(uint64_t *sector) {
+   int retval = 0;
+   uint64_t earlier, later, blockLast;
+
+   if ((*sector % gpt.sectorAlignment) != 0) {
+      earlier = (*sector / gpt.sectorAlignment) * gpt.sectorAlignment;
+      later = earlier + (uint64_t) gpt.sectorAlignment;
+      if (FreeBlockAt(earlier, &blockLast) && (blockLast >= *sector - 1)) {
+         *sector = earlier;
+         retval = 1;
+      } else if (FreeBlockAt(*sector + 1, &blockLast) && (blockLast >= later)) {
+         *sector = later;
+         retval = 1;
+      } // if/else
+   } // if
+   return retval;
+} // GPTData::Transaction::Align()
+
+int GPTData::Transaction::AllocateExtent(uint64_t size, uint32_t alignment, AllocPolicy policy,
+                                         uint64_t *firstLBA, uint64_t *lastLBA, bool alignEnd,
+                                         uint64_t searchFrom) {
+   if (alignment == 0)
+      alignment = gpt.sectorAlignment;
+   return ChooseExtent(freeSpace, &freeBySize, size, alignment, policy, firstLBA, lastLBA,
+                       alignEnd, searchFrom);
+} // GPTData::Transaction::AllocateExtent()
+
+uint32_t GPTData::Transaction::CreatePartition(uint32_t partNum, uint64_t startSector,
+                                               uint64_t endSector) {
+   int retval = 1;
+   uint64_t origSector = startSector, blockLast;
+
+   if (IsFreePartNum(partNum)) {
+      if (Align(&startSector)) {
+         cout << "Information: Moved requested sector from " << origSector << " to "
+              << startSector << " in\norder to align on " << gpt.sectorAlignment
+              << "-sector boundaries.\n";
+      } // if
+      if (FreeBlockAt(startSector, &blockLast) && (startSector <= endSector) &&
+          (blockLast >= endSector)) {
+         GPTPart & part = Staged(partNum);
+         part.SetFirstLBA(startSector);
+         part.SetLastLBA(endSector);
+         part.SetType(DEFAULT_GPT_TYPE);
+         part.RandomizeUniqueGUID();
+         UpdateSlot(partNum);
+         Claim(startSector, endSector);
+         created.insert(partNum);
+      } else retval = 0; // if free space from startSector to endSector
+   } else retval = 0; // if legal partition number
+   return retval;
+} // GPTData::Transaction::CreatePartition()
+
+// As with GPTData::DeletePartition(), any entry between the lowest- and
+// highest-numbered used ones may be deleted, even if it's not in use.
+int GPTData::Transaction::DeletePartition(uint32_t partNum) {
+   uint32_t low = UINT32_MAX, high = 0;
+   size_t w;
+   Extent where;
+   int retval = 1;
+
+   for (w = 0; w < usedSlots.size(); w++) {
+      if (usedSlots[w] != 0) {
+         if (low == UINT32_MAX)
+            low = (uint32_t) (w * 64) + LowestSetBit(usedSlots[w]);
+         high = (uint32_t) (w * 64) + HighestSetBit(usedSlots[w]);
+      } // if
+   } // for
+   if ((low != UINT32_MAX) && (partNum >= low) && (partNum <= high)) {
+      GPTPart & part = Staged(partNum);
+      where.firstLBA = part.GetFirstLBA();
+      where.lastLBA = part.GetLastLBA();
+      where.index = partNum;
+      part.BlankPartition();
+      UpdateSlot(partNum);
+      created.erase(partNum);
+      if (where.firstLBA <= where.lastLBA) {
+         deleted.push_back(where);
+         Release(where.firstLBA, where.lastLBA);
+      } // if
+   } else {
+      cerr << "Partition number " << partNum + 1 << " out of range!\n";
+      retval = 0;
+   } // if/else
+   return retval;
+} // GPTData::Transaction::DeletePartition()
+
+int GPTData::Transaction::ChangePartType(uint32_t partNum, PartType theGUID) {
+   int retval = 1;
+
+   if ((partNum < gpt.numParts) && !IsFreePartNum(partNum)) {
+      Staged(partNum).SetType(theGUID);
+      UpdateSlot(partNum);
+   } else retval = 0;
+   return retval;
+} // GPTData::Transaction::ChangePartType()
+
+int GPTData::Transaction::SetName(uint32_t partNum, const UnicodeString & theName) {
+   int retval = 1;
+
+   if (IsUsedPartNum(partNum))
+      Staged(partNum).SetName(theName);
+   else
+      retval = 0;
+   return retval;
+} // GPTData::Transaction::SetName()
+
+int GPTData::Transaction::SwapPartitions(uint32_t partNum1, uint32_t partNum2) {
+   GPTPart temp;
+   size_t wasCreated1;
+   int allOK = 1;
+
+   if ((partNum1 < gpt.numParts) && (partNum2 < gpt.numParts)) {
+      if (partNum1 != partNum2) {
+         temp = Current(partNum1);
+         Staged(partNum1) = Current(partNum2);
+         Staged(partNum2) = temp;
+         UpdateSlot(partNum1);
+         UpdateSlot(partNum2);
+         wasCreated1 = created.erase(partNum1);
+         if (created.erase(partNum2))
+            created.insert(partNum1);
+         if (wasCreated1)
+            created.insert(partNum2);
+      } // if
+   } else allOK = 0;
+   return allOK;
+} // GPTData::Transaction::SwapPartitions()
 
 /******************************************
  *                                        *
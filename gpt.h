@@ -9,11 +9,14 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <map>
+#include <set>
 #include "gptpart.h"
 #include "support.h"
 #include "mbr.h"
 #include "bsd.h"
 #include "gptpart.h"
+#include "extents.h"
 
 // Default values for sector alignment
 #define DEFAULT_ALIGNMENT 2048
@@ -24,6 +27,26 @@
 // smallest Advanced Format drive I know of is 320GB in size
 #define SMALLEST_ADVANCED_FORMAT UINT64_C(585937500)
 
+// Partition arrays are read from disk this many bytes at a time
+#define PARTITION_CHUNK_SIZE (256 * 1024)
+
+// Most devices that ReplicateGPTData() writes to at once
+#define MAX_REPLICATION_THREADS 16
+
+// Number of changes an interactive session can undo
+#define MAX_UNDO_LEVELS 100
+
+// The old filesystem, RAID, and volume-manager signatures that blkid might
+// find in a new partition lie within its first WIPE_HEAD_SIZE bytes (boot
+// sectors, ext2/3/4, XFS, LVM, md 1.1 and 1.2, swap, the superblocks at
+// 64 KiB, and ZFS's first two labels) or its last WIPE_TAIL_SIZE bytes
+// (md 0.90 and 1.0 and ZFS's last two labels)
+#define WIPE_HEAD_SIZE (1024 * 1024)
+#define WIPE_TAIL_SIZE (1024 * 1024)
+
+// ScanForHeaders() reads the disk this many bytes at a time
+#define HEADER_SCAN_CHUNK_SIZE (8 * 1024 * 1024)
+
 /****************************************
  *                                      *
  * GPTData class and related structures *
@@ -36,6 +59,36 @@ enum GPTValidity {gpt_valid, gpt_corrupt, gpt_invalid};
 // Which set of partition data to use
 enum WhichToUse {use_gpt, use_mbr, use_bsd, use_new, use_abort};
 
+// How AllocateExtent() picks a block of free space: the first (lowest) one
+// that fits, the smallest one that fits, the largest one, or the last
+// (highest) one that fits
+enum AllocPolicy {alloc_first_fit, alloc_best_fit, alloc_largest, alloc_last};
+
+// The sizes and first LBAs of blocks of free space, ordered by size (and
+// then by position), so that AllocateExtent() can find the smallest or
+// largest block that fits without comparing them all
+typedef std::set<std::pair<uint64_t, uint64_t> > FreeSizeIndex;
+
+// The things GPTData::FindProblems() looks for, in the order in which
+// they're reported
+enum ProblemCode {
+   problem_main_header_crc, problem_main_table_crc, problem_second_header_crc,
+   problem_second_table_crc, problem_main_self_pointer, problem_second_self_pointer,
+   problem_current_lba_mismatch, problem_backup_lba_mismatch, problem_first_usable_mismatch,
+   problem_last_usable_mismatch, problem_disk_guid_mismatch, problem_num_parts_mismatch,
+   problem_entry_size_mismatch, problem_disk_too_small, problem_main_table_past_first_usable,
+   problem_main_table_too_early, problem_second_table_overlaps_header, problem_main_table_gap,
+   problem_second_table_gap, problem_first_usable_gap, problem_table_too_small,
+   problem_last_usable_too_big, problem_overlap, problem_ends_before_start,
+   problem_too_big, problem_duplicate_guid, problem_hybrid_mismatch, problem_mbr_overlap,
+   problem_mbr_multiple_ee, problem_mbr_ee_not_on_1, problem_ee_active,
+   problem_main_table_overlaps_part, problem_second_table_overlaps_part,
+   problem_mbr_too_big, problem_start_unaligned, problem_end_unaligned
+};
+
+// Problems count against a disk; warnings are just worth knowing about
+enum ProblemSeverity {severity_problem, severity_warning};
+
 // Header (first 512 bytes) of GPT table
 #pragma pack(1)
 struct GPTHeader {
@@ -57,11 +110,77 @@ struct GPTHeader {
 }; // struct GPTHeader
 #pragma pack ()
 
+// The table as it stood at one point, kept so that changes can be undone
+// or so that saving can skip what's already on the disk. The partition
+// array is shared with the live table until one of them changes it (see
+// GPTData::UnsharePartitions()), so taking a snapshot copies only the
+// headers and the protective MBR.
+struct GPTSnapshot {
+   struct GPTHeader mainHeader;
+   struct GPTHeader secondHeader;
+   GPTPart *partitions;
+   uint32_t *partsRefs;
+   uint32_t numParts;
+   MBRData protectiveMBR;
+   GPTValidity state;
+   int mainCrcOk;
+   int secondCrcOk;
+   int mainPartsCrcOk;
+   int secondPartsCrcOk;
+}; // struct GPTSnapshot
+
+// A partition table as it is on the disk, kept after it's been read so that
+// the main and backup tables can be compared entry by entry, and either one
+// made the working table, without rereading them. The array is shared with
+// the live table in the same way as GPTSnapshot's.
+struct GPTDiskTable {
+   GPTPart *partitions; // NULL if the table hasn't been read
+   uint32_t *partsRefs;
+   uint32_t numParts;
+   uint64_t lba; // where on the disk the table is
+   uint32_t crc;
+}; // struct GPTDiskTable
+
+// A GPT header found by ScanForHeaders()
+struct FoundGPTHeader {
+   struct GPTHeader header; // in CPU byte order
+   int tableOK; // 1 if the partition table it points to matches its CRC
+}; // struct FoundGPTHeader
+
+// One bucket in GPTData's hash index of partitions' unique GUIDs
+struct GUIDBucket {
+   uint32_t entry; // partition number + 1, or 0 if the bucket is empty
+   uint32_t hash; // the partition's GUIDData::Hash()
+}; // struct GUIDBucket
+
+// One problem found by GPTData::FindProblems(). What part1, part2, and the
+// values hold depends on the code; see GPTData::ShowProblems().
+struct GPTProblem {
+   ProblemCode code;
+   ProblemSeverity severity;
+   uint32_t part1; // partitions involved (numbered from 0)
+   uint32_t part2;
+   uint64_t value1; // sectors, sizes, or other numbers involved
+   uint64_t value2;
+   uint64_t value3;
+}; // struct GPTProblem
+
+// The partition problems found by GPTData::SweepPartitions(), kept apart
+// by kind so that they can be reported in the usual order
+struct PartitionSweep {
+   std::vector<GPTProblem> overlaps;
+   std::vector<GPTProblem> insane;
+   std::vector<GPTProblem> size;
+   std::vector<GPTProblem> alignment;
+   std::vector<Extent> extents; // the sane partitions, sorted by first sector
+}; // struct PartitionSweep
+
 // Data in GPT format
 class GPTData {
 protected:
    struct GPTHeader mainHeader;
    GPTPart *partitions;
+   uint32_t *partsRefs; // # of GPTData objects sharing partitions (copy-on-write)
    uint32_t numParts; // # of partitions the table can hold
    struct GPTHeader secondHeader;
    MBRData protectiveMBR;
@@ -81,12 +200,89 @@ protected:
    uint32_t sectorAlignment; // Start partitions at multiples of sectorAlignment
    int beQuiet;
    WhichToUse whichWasUsed;
+   int tablesPending; // 1 if LoadHeadersOnly() deferred reading the table, -1 if that failed
+   std::vector<uint64_t> usedSlots; // bitmap of in-use entries in partitions
+   uint32_t numUsed; // number of bits set in usedSlots
+   std::vector<uint32_t> entryCRCs; // tree of partition-entry CRCs; empty if stale
+   // Each entry's first & last LBAs, packed together so that scans over the
+   // partitions' locations don't drag the rest of each entry through the
+   // cache; kept in step with partitions, like usedSlots.
+   std::vector<uint64_t> firstLBAs;
+   std::vector<uint64_t> lastLBAs;
+   // The free blocks between the usable LBAs, sorted; rebuilt by
+   // FreeExtents() only when PartitionChanged() or TableChanged() has marked
+   // it stale or the usable LBAs have moved since it was built.
+   std::vector<Extent> freeExtents;
+   FreeSizeIndex freeBySize; // freeExtents, by size
+   int freeExtentsStale;
+   uint64_t freeExtentsFirst, freeExtentsLast; // the usable LBAs it covers
+   uint32_t crcLeaves; // number of leaves in entryCRCs (a power of 2)
+   // Hash index (open addressing, with linear probing) of the used entries'
+   // unique GUIDs, and the bucket each entry's in (UINT32_MAX if none); kept
+   // in step with partitions, like usedSlots.
+   std::vector<GUIDBucket> guidIndex;
+   std::vector<uint32_t> guidBuckets;
+   std::vector<GPTSnapshot*> undoStates; // states to return to, oldest first
+   std::vector<GPTSnapshot*> redoStates; // states undone, most recent last
+   int undoPointOpen; // 1 if undoStates.back() is from the current command
+   GPTSnapshot *diskImage; // what's on the disk now, if known; NULL if not
+   GPTDiskTable diskTables[2]; // the main & backup tables as read from disk
+   uint32_t grownPart; // partition GrowPartition() grew, if nothing else has changed; else UINT32_MAX
+   std::vector<Extent> newExtents; // partitions created since the last load or save
+   int wipeNew; // 1 if SaveGPTData() is to wipe old signatures from new partitions
+   int discardNew; // 1 if SaveGPTData() is to discard the contents of new partitions
 
    int LoadHeader(struct GPTHeader *header, DiskIO & disk, uint64_t sector, int *crcOk);
    int LoadPartitionTable(const struct GPTHeader & header, DiskIO & disk, uint64_t sector = 0);
    int CheckTable(struct GPTHeader *header);
-   int SaveHeader(struct GPTHeader *header, DiskIO & disk, uint64_t sector);
-   int SavePartitionTable(DiskIO & disk, uint64_t sector);
+   int QuickLoadHeader(struct GPTHeader *header, uint64_t sector);
+   int HeaderLooksValid(struct GPTHeader *header);
+   int ReadPartitionArray(DiskIO & disk, uint32_t numEntries, GPTPart *dest, uint32_t *crc);
+   int SaveHeader(const struct GPTHeader *header, DiskIO & disk, uint64_t sector);
+   int SavePartitionTable(DiskIO & disk, uint64_t sector, GPTPart *table);
+   int SaveChangedEntries(DiskIO & disk, uint64_t sector, GPTPart *table, GPTPart *oldParts);
+   // Conversions to the on-disk (little-endian) form, which leave the data
+   // in memory alone
+   void EncodeHeader(const struct GPTHeader & header, struct GPTHeader *diskHeader);
+   void EncodeEntries(uint32_t first, uint32_t count, GPTPart *diskParts);
+   GPTPart* EncodeTable(void);
+   uint32_t HeaderCRC(const struct GPTHeader & header, uint32_t hSize);
+   int WriteStructures(int *backupOK);
+   int WriteReplica(int *synced, int *err);
+   void CopySettings(const GPTData & orig);
+   // Copies share one partition array until one of them changes it; call
+   // UnsharePartitions() before altering any entry.
+   void UnsharePartitions(void);
+   void ReleasePartitions(void);
+   // Keep derived data (usedSlots, etc.) in step with partitions; call
+   // PartitionChanged() after changing one entry and TableChanged() after
+   // loading, resizing, or rearranging the whole array.
+   void PartitionChanged(uint32_t partNum);
+   void TableChanged(void);
+   uint32_t EntryCRC(uint32_t partNum);
+   void CombineEntryCRCs(uint32_t node, uint32_t span);
+   uint32_t PartitionsCRC(void);
+   void IndexGUID(uint32_t partNum);
+   void UnindexGUID(uint32_t partNum);
+   GPTSnapshot* TakeSnapshot(void);
+   void RestoreSnapshot(GPTSnapshot *snap);
+   int MatchesSnapshot(GPTSnapshot *snap);
+   void DeleteSnapshot(GPTSnapshot *snap);
+   void ClearUndoHistory(void);
+   void RecordDiskImage(void);
+   void ForgetDiskImage(void);
+   void KeepDiskTable(int which, uint64_t lba, uint32_t crc, GPTPart *table = NULL);
+   void NoteNewPartition(uint32_t partNum);
+   void GetNewExtents(std::vector<Extent> & extents);
+   int WipeSignatures(void);
+   int DiscardExtents(std::vector<Extent> & extents, int dryRun);
+   void ForgetDiskTables(void);
+   GPTDiskTable* FindDiskTable(const struct GPTHeader & header);
+   void ListTableDifferences(GPTPart *table);
+   void SweepPartitions(PartitionSweep & sweep);
+   void GetHybridMismatches(std::vector<GPTProblem> & problems);
+   void GetDuplicateGUIDs(std::vector<GPTProblem> & problems);
+   void CorrectProblems(const std::vector<GPTProblem> & problems);
 public:
    // Basic necessary functions....
    GPTData(void);
@@ -94,9 +290,15 @@ public:
    GPTData(std::string deviceFilename);
    virtual ~GPTData(void);
    GPTData & operator=(const GPTData & orig);
+#if __cplusplus >= 201103L
+   GPTData(GPTData && orig);
+   GPTData & operator=(GPTData && orig);
+#endif
 
    // Verify (or update) data integrity
    int Verify(void);
+   int FindProblems(std::vector<GPTProblem> & problems, std::vector<Extent> *freeSpace = NULL);
+   void ShowProblems(const std::vector<GPTProblem> & problems);
    int CheckGPTSize(void);
    int CheckHeaderValidity(void);
    int CheckHeaderCRC(struct GPTHeader* header, int warn = 0);
@@ -107,24 +309,37 @@ public:
    int FindHybridMismatches(void);
    int FindOverlaps(void);
    int FindInsanePartitions(void);
+   int FindDuplicateGUIDs(void);
 
    // Load or save data from/to disk
    int SetDisk(const std::string & deviceFilename);
    DiskIO* GetDisk(void) {return &myDisk;}
    int LoadMBR(const std::string & f) {return protectiveMBR.ReadMBRData(f);}
-   int WriteProtectiveMBR(void) {return protectiveMBR.WriteMBRData(&myDisk);}
+   int WriteProtectiveMBR(void) {ForgetDiskImage(); return protectiveMBR.WriteMBRData(&myDisk);}
    void PartitionScan(void);
    int LoadPartitions(const std::string & deviceFilename);
+   int LoadHeadersOnly(const std::string & deviceFilename);
+   int LoadTablesOnDemand(void);
    int ForceLoadGPTData(void);
    int LoadMainTable(void);
    int LoadSecondTableAsMain(void);
+   int ScanForHeaders(std::vector<FoundGPTHeader> & found, uint64_t first, uint64_t last);
+   int UseFoundHeader(const struct GPTHeader & header);
    int SaveGPTData(int quiet = 0);
+   int ReplicateGPTData(const std::vector<std::string> & targets);
    int SaveGPTBackup(const std::string & filename);
    int LoadGPTBackup(const std::string & filename);
    int SaveMBR(void);
    int DestroyGPT(void);
    int DestroyMBR(void);
 
+   // Undo & redo for interactive sessions; call SaveUndoPoint() before each
+   // command that might change the table
+   void SaveUndoPoint(void);
+   void CloseUndoPoint(void);
+   int Undo(void);
+   int Redo(void);
+
    // Display data....
    void ShowAPMState(void);
    void ShowGPTState(void);
@@ -150,6 +365,10 @@ public:
    int SwapPartitions(uint32_t partNum1, uint32_t partNum2);
    int ClearGPTData(void);
    void MoveSecondHeaderToEnd();
+   int GrowPartition(uint32_t partNum, bool alignEnd = false);
+   int MovePartition(uint32_t partNum, uint64_t newStart, const std::string & checkpointFile = "");
+   int DiscardFreeSpace(int dryRun = 0);
+   int DiscardNewPartitions(int dryRun = 0);
    int SetName(uint32_t partNum, const UnicodeString & theName);
    void SetDiskGUID(GUIDData newGUID);
    int SetPartitionGUID(uint32_t pn, GUIDData theGUID);
@@ -164,6 +383,8 @@ public:
    WhichToUse GetState(void) {return whichWasUsed;}
    int GetPartRange(uint32_t* low, uint32_t* high);
    int FindFirstFreePart(void);
+   uint32_t NextUsedPart(uint32_t start);
+   uint32_t FindPartitionByGUID(const GUIDData & guid);
    uint32_t GetNumParts(void) {return mainHeader.numParts;}
    uint64_t GetTableSizeInSectors(void) {return (((numParts * GPT_SIZE) / blockSize) +
                                                  (((numParts * GPT_SIZE) % blockSize) != 0)); }
@@ -188,6 +409,11 @@ public:
    uint64_t FindLastInFree(uint64_t start, bool align = false);
    uint64_t FindFreeBlocks(uint32_t *numSegments, uint64_t *largestSegment);
    int IsFree(uint64_t sector, uint32_t *partNum = NULL);
+   const std::vector<Extent> & FreeExtents(void);
+   void GetFreeExtents(std::vector<Extent> & freeSpace);
+   int AllocateExtent(uint64_t size, uint32_t alignment, AllocPolicy policy,
+                      uint64_t *firstLBA, uint64_t *lastLBA, bool alignEnd = false,
+                      uint64_t searchFrom = 0);
    int IsFreePartNum(uint32_t partNum);
    int IsUsedPartNum(uint32_t partNum);
 
@@ -197,6 +423,10 @@ public:
    uint32_t GetAlignment(void) {return sectorAlignment;}
    void JustLooking(int i = 1) {justLooking = i;}
    void BeQuiet(int i = 1) {beQuiet = i;}
+   void WipeNewPartitions(int i = 1) {wipeNew = i;}
+   int GetWipeNewPartitions(void) {return wipeNew;}
+   void DiscardOnCreate(int i = 1) {discardNew = i;}
+   int GetDiscardOnCreate(void) {return discardNew;}
    WhichToUse WhichWasUsed(void) {return whichWasUsed;}
 
    // Endianness functions
@@ -208,6 +438,58 @@ public:
    void ShowAttributes(const uint32_t partNum);
    void GetAttribute(const uint32_t partNum, const std::string& attributeBits);
 
+   // A batch of partition edits. Each edit is checked as it's made against
+   // the Transaction's own record of the free space and used entries, which
+   // is updated as it goes, rather than against the whole table; nothing
+   // touches the GPTData until Commit(), which checks the new partitions
+   // once and then keeps either all of the edits or none of them. An edit
+   // that fails (returning 0) is simply left out of the batch.
+   class Transaction {
+   protected:
+      GPTData & gpt;
+      std::map<uint32_t, GPTPart> staged; // new contents of altered entries
+      std::vector<uint64_t> usedSlots; // as GPTData::usedSlots, with edits applied
+      std::map<uint64_t, uint64_t> freeSpace; // free blocks' first -> last LBAs
+      FreeSizeIndex freeBySize; // freeSpace, by size
+      std::vector<Extent> deleted; // locations of deleted partitions, for the MBR
+      std::set<uint32_t> created; // entries holding newly-created partitions
+      int overlapping; // 1 if the table's entries overlap one another
+
+      const GPTPart & Current(uint32_t partNum);
+      GPTPart & Staged(uint32_t partNum);
+      void UpdateSlot(uint32_t partNum);
+      int FreeBlockAt(uint64_t sector, uint64_t *blockLast);
+      void Claim(uint64_t first, uint64_t last);
+      void Release(uint64_t first, uint64_t last);
+      void AddFreeBlock(uint64_t first, uint64_t last);
+      void InsertBlock(uint64_t first, uint64_t last);
+      void EraseBlock(std::map<uint64_t, uint64_t>::iterator it);
+      int CheckCreated(void);
+   public:
+      Transaction(GPTData & theGPT);
+      void Abort(void);
+      int Commit(void);
+      int IsEmpty(void) {return staged.empty();}
+
+      // Queries, as the GPTData functions of the same names, but seeing
+      // the edits made so far
+      int IsFreePartNum(uint32_t partNum);
+      int IsUsedPartNum(uint32_t partNum);
+      int FindFirstFreePart(void);
+      uint32_t FindPartitionByGUID(const GUIDData & guid);
+      int IsFree(uint64_t sector);
+      int Align(uint64_t *sector);
+      int AllocateExtent(uint64_t size, uint32_t alignment, AllocPolicy policy,
+                         uint64_t *firstLBA, uint64_t *lastLBA, bool alignEnd = false,
+                         uint64_t searchFrom = 0);
+
+      // Edits, as the GPTData functions of the same names
+      uint32_t CreatePartition(uint32_t partNum, uint64_t startSector, uint64_t endSector);
+      int DeletePartition(uint32_t partNum);
+      int ChangePartType(uint32_t partNum, PartType theGUID);
+      int SetName(uint32_t partNum, const UnicodeString & theName);
+      int SwapPartitions(uint32_t partNum1, uint32_t partNum2);
+   }; // class GPTData::Transaction
 }; // class GPTData
 
 // Function prototypes....
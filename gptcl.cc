@@ -30,10 +30,10 @@ using namespace std;
 
 GPTDataCL::GPTDataCL(void) {
    attributeOperation = backupFile = partName = hybrids = newPartInfo = NULL;
-   mbrParts = twoParts = outDevice = typeCode = partGUID = diskGUID = NULL;
+   mbrParts = twoParts = outDevice = typeCode = partGUID = diskGUID = moveInfo = discardWhat = NULL;
    alignment = DEFAULT_ALIGNMENT;
    alignEnd = false;
-   deletePartNum = infoPartNum = largestPartNum = bsdPartNum = 0;
+   deletePartNum = infoPartNum = largestPartNum = bsdPartNum = growPartNum = 0;
    tableSize = GPT_SIZE;
 } // GPTDataCL constructor
 
@@ -67,7 +67,7 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
    GPTData secondDevice;
    int opt, numOptions = 0, saveData = 0, neverSaveData = 0;
    int partNum = 0, newPartNum = -1, saveNonGPT = 1, retval = 0, pretend = 0;
-   int byteSwapPartNum = 0;
+   int byteSwapPartNum = 0, queriesOnly = 1, discardFree = 0;
    uint64_t low, high, startSector, endSector, sSize, mainTableLBA, secondTableLBA;
    uint64_t temp; // temporary variable; free to use in any case
    char *device;
@@ -96,9 +96,11 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
       {"align-end", 'I', POPT_ARG_NONE, NULL, 'I', "align partition end points", ""},
       {"move-main-table", 'j', POPT_ARG_INT, &mainTableLBA, 'j', "change the start sector of the main partition table", "sector"},
       {"move-backup-table", 'k', POPT_ARG_INT, &secondTableLBA, 'k', "change the start sector of the second/backup partition table", "sector"},
+      {"discard", 'K', POPT_ARG_STRING, &discardWhat, 'K', "discard (TRIM) free space or new partitions", "free|new|all"},
       {"load-backup", 'l', POPT_ARG_STRING, &backupFile, 'l', "load GPT backup from file", "file"},
       {"list-types", 'L', POPT_ARG_NONE, NULL, 'L', "list known partition types", ""},
       {"gpttombr", 'm', POPT_ARG_STRING, &mbrParts, 'm', "convert GPT to MBR", "partnum[:partnum...]"},
+      {"move", 'M', POPT_ARG_STRING, &moveInfo, 'M', "move partition and its data", "partnum:start[:checkpoint_file]"},
       {"new", 'n', POPT_ARG_STRING, &newPartInfo, 'n', "create new partition", "partnum:start:end"},
       {"largest-new", 'N', POPT_ARG_INT, &largestPartNum, 'N', "create largest possible new partition", "partnum"},
       {"clear", 'o', POPT_ARG_NONE, NULL, 'o', "clear partition table", ""},
@@ -106,7 +108,7 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
       {"print", 'p', POPT_ARG_NONE, NULL, 'p', "print partition table", ""},
       {"pretend", 'P', POPT_ARG_NONE, NULL, 'P', "make changes in memory, but don't write them", ""},
       {"transpose", 'r', POPT_ARG_STRING, &twoParts, 'r', "transpose two partitions", "partnum:partnum"},
-      {"replicate", 'R', POPT_ARG_STRING, &outDevice, 'R', "replicate partition table", "device_filename"},
+      {"replicate", 'R', POPT_ARG_STRING, &outDevice, 'R', "replicate partition table", "device_filename[,...]"},
       {"sort", 's', POPT_ARG_NONE, NULL, 's', "sort partition table entries", ""},
       {"resize-table", 'S', POPT_ARG_INT, &tableSize, 'S', "resize partition table", "numparts"},
       {"typecode", 't', POPT_ARG_STRING, &typeCode, 't', "change partition type code", "partnum:{hexcode|GUID}"},
@@ -115,6 +117,8 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
       {"disk-guid", 'U', POPT_ARG_STRING, &diskGUID, 'U', "set disk GUID", "guid"},
       {"verify", 'v', POPT_ARG_NONE, NULL, 'v', "check partition table integrity", ""},
       {"version", 'V', POPT_ARG_NONE, NULL, 'V', "display version information", ""},
+      {"wipe-signatures", 'W', POPT_ARG_NONE, NULL, 'W', "wipe old filesystem signatures from new partitions", ""},
+      {"grow", 'X', POPT_ARG_INT, &growPartNum, 'X', "grow partition into space added to end of disk", "partnum"},
       {"zap", 'z', POPT_ARG_NONE, NULL, 'z', "zap (destroy) GPT (but not MBR) data structures", ""},
       {"zap-all", 'Z', POPT_ARG_NONE, NULL, 'Z', "zap (destroy) GPT and MBR data structures", ""},
       POPT_AUTOHELP { NULL, 0, 0, NULL, 0 }
@@ -140,6 +144,10 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
             cmd = GetString(attributeOperation, 1);
             if (cmd == "list")
                Attributes::ListAttributes();
+            else
+               queriesOnly = 0;
+            break;
+         case 'a': case 'D': case 'E': case 'f': case 'F': case 'I':
             break;
          case 'L':
             typeHelper.ShowAllTypes(0);
@@ -150,7 +158,11 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
          case 'V':
             cout << "GPT fdisk (sgdisk) version " << GPTFDISK_VERSION << "\n\n";
             break;
+         case 'W':
+            WipeNewPartitions();
+            break;
          default:
+            queriesOnly = 0;
             break;
       } // switch
       numOptions++;
@@ -164,17 +176,33 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
       poptResetContext(poptCon);
       JustLooking(); // reset as necessary
       BeQuiet(); // Tell called functions to be less verbose & interactive
-      if (LoadPartitions((string) device)) {
+      // If the only options are queries about alignment & free space, skip
+      // the backup table and (until it's needed) the main table, too.
+      if (queriesOnly ? LoadHeadersOnly((string) device) : LoadPartitions((string) device)) {
          if ((WhichWasUsed() == use_mbr) || (WhichWasUsed() == use_bsd))
             saveNonGPT = 0; // flag so we don't overwrite unless directed to do so
          sSize = GetBlockSize();
+         Transaction edits(*this);
+         int editsStale = 0;
          while ((opt = poptGetNextOpt(poptCon)) > 0) {
+            // Runs of partition creations, deletions, transpositions, type
+            // code changes, and renamings are gathered into one Transaction,
+            // which is committed before any other option is dealt with.
+            if ((opt == 'c') || (opt == 'd') || (opt == 'n') || (opt == 'N') ||
+                (opt == 'r') || (opt == 't')) {
+               if (editsStale)
+                  edits.Abort();
+               editsStale = 0;
+            } else {
+               if (!edits.Commit())
+                  neverSaveData = 1;
+               editsStale = 1;
+            } // if/else
             switch (opt) {
                case 'A': {
                   if (cmd != "list") {
-                     partNum = (int) GetInt(attributeOperation, 1) - 1;
-                     if (partNum < 0)
-                        partNum = newPartNum;
+                     partNum = DecodePartNum(attributeOperation, newPartNum, edits,
+                                             neverSaveData);
                      if ((partNum >= 0) && (partNum < (int) GetNumParts())) {
                         switch (ManageAttributes(partNum, GetString(attributeOperation, 2),
                            GetString(attributeOperation, 3))) {
@@ -198,11 +226,17 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                   break;
                } // case 'A':
                case 'a':
-                  SetAlignment(alignment);
+                  // Load now, or loading would later reset the alignment
+                  if (LoadTablesOnDemand())
+                     SetAlignment(alignment);
+                  else
+                     retval = 2;
                   break;
                case 'B':
                   if (IsUsedPartNum(byteSwapPartNum - 1)) {
+                     UnsharePartitions();
                      partitions[byteSwapPartNum - 1].ReverseNameBytes();
+                     PartitionChanged(byteSwapPartNum - 1);
                      cout << "Changed partition " << byteSwapPartNum << "'s name to "
                           << partitions[byteSwapPartNum - 1].GetDescription() << "\n";
                      JustLooking(0);
@@ -215,12 +249,10 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                   break;
                case 'c':
                   JustLooking(0);
-                  partNum = (int) GetInt(partName, 1) - 1;
-                  if (partNum < 0)
-                     partNum = newPartNum;
+                  partNum = DecodePartNum(partName, newPartNum, edits, neverSaveData);
                   if ((partNum >= 0) && (partNum < (int) GetNumParts())) {
                      name = GetString(partName, 2);
-                     if (SetName(partNum, (UnicodeString) name.c_str())) {
+                     if (edits.SetName(partNum, (UnicodeString) name.c_str())) {
                         saveData = 1;
                      } else {
                         cerr << "Unable to set partition " << partNum + 1
@@ -237,13 +269,16 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                   break;
                case 'd':
                   JustLooking(0);
-                  if (DeletePartition(deletePartNum - 1) == 0) {
+                  if (edits.DeletePartition(deletePartNum - 1) == 0) {
                      cerr << "Error " << errno << " deleting partition!\n";
                      neverSaveData = 1;
                   } else saveData = 1;
                                                       break;
                case 'D':
-                  cout << GetAlignment() << "\n";
+                  if (LoadTablesOnDemand())
+                     cout << GetAlignment() << "\n";
+                  else
+                     retval = 2;
                   break;
                case 'e':
                   JustLooking(0);
@@ -251,15 +286,25 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                   saveData = 1;
                   break;
                case 'E':
-                  cout << FindLastInFree(FindFirstInLargest()) << "\n";
+                  if (LoadTablesOnDemand())
+                     cout << FindLastInFree(FindFirstInLargest()) << "\n";
+                  else
+                     retval = 2;
                   break;
                case 'f':
-                  cout << FindFirstInLargest() << "\n";
+                  if (LoadTablesOnDemand())
+                     cout << FindFirstInLargest() << "\n";
+                  else
+                     retval = 2;
                   break;
                case 'F':
-                  temp = FindFirstInLargest();
-                  Align(&temp);
-                  cout << temp << "\n";
+                  if (LoadTablesOnDemand()) {
+                     if (!AllocateExtent(0, sectorAlignment, alloc_largest, &temp, &high))
+                        temp = 0;
+                     cout << temp << "\n";
+                  } else {
+                     retval = 2;
+                  } // if/else
                   break;
                case 'g':
                   JustLooking(0);
@@ -298,6 +343,18 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                      neverSaveData = 1;
                   } // if/else
                   break;
+               case 'K':
+                  cmd = GetString(discardWhat, 1);
+                  if ((cmd == "new") || (cmd == "all"))
+                     DiscardOnCreate();
+                  if ((cmd == "free") || (cmd == "all"))
+                     discardFree = 1;
+                  if ((cmd != "new") && (cmd != "free") && (cmd != "all")) {
+                     cerr << "Unknown discard option: '" << cmd << "'; use free, new, or all\n";
+                     neverSaveData = 1;
+                  } // if
+                  free(discardWhat);
+                  break;
                case 'l':
                   LoadBackupFile(backupFile, saveData, neverSaveData);
                   free(backupFile);
@@ -318,17 +375,27 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                      saveData = 0;
                   } // if
                   break;
+               case 'M':
+                  JustLooking(0);
+                  partNum = DecodePartNum(moveInfo, newPartNum, edits, neverSaveData);
+                  if (pretend) {
+                     cout << "Not moving partition " << partNum + 1 << ", since -P was given.\n";
+                  } else if (!MovePartition((uint32_t) partNum, GetInt(moveInfo, 2),
+                                            GetString(moveInfo, 3))) {
+                     neverSaveData = 1;
+                  } // if/else if
+                  free(moveInfo);
+                  break;
                case 'n':
                   JustLooking(0);
                   newPartNum = (int) GetInt(newPartInfo, 1) - 1;
                   if (newPartNum < 0)
-                     newPartNum = FindFirstFreePart();
-                  low = FindFirstInLargest();
-                  Align(&low);
-                  high = FindLastInFree(low, alignEnd);
+                     newPartNum = edits.FindFirstFreePart();
+                  if (!edits.AllocateExtent(0, sectorAlignment, alloc_largest, &low, &high, alignEnd))
+                     low = high = 0;
                   startSector = IeeeToInt(GetString(newPartInfo, 2), sSize, low, high, sectorAlignment, low);
                   endSector = IeeeToInt(GetString(newPartInfo, 3), sSize, startSector, high, sectorAlignment, high);
-                  if (CreatePartition(newPartNum, startSector, endSector)) {
+                  if (edits.CreatePartition(newPartNum, startSector, endSector)) {
                      saveData = 1;
                   } else {
                      cerr << "Could not create partition " << newPartNum + 1 << " from "
@@ -339,14 +406,14 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                   break;
                case 'N':
                   JustLooking(0);
-                  startSector = FindFirstInLargest();
-                  Align(&startSector);
-                  endSector = FindLastInFree(startSector, alignEnd);
+                  if (!edits.AllocateExtent(0, sectorAlignment, alloc_largest, &startSector,
+                                            &endSector, alignEnd))
+                     startSector = endSector = 0;
                   if (largestPartNum <= 0) {
-                     largestPartNum = FindFirstFreePart() + 1;
+                     largestPartNum = edits.FindFirstFreePart() + 1;
                      newPartNum = largestPartNum - 1;
                   }
-                  if (CreatePartition(largestPartNum - 1, startSector, endSector)) {
+                  if (edits.CreatePartition(largestPartNum - 1, startSector, endSector)) {
                      saveData = 1;
                   } else {
                      cerr << "Could not create partition " << largestPartNum << " from "
@@ -373,17 +440,22 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                   uint64_t p1, p2;
                   p1 = GetInt(twoParts, 1) - 1;
                   p2 = GetInt(twoParts, 2) - 1;
-                  if (SwapPartitions((uint32_t) p1, (uint32_t) p2) == 0) {
+                  if (edits.SwapPartitions((uint32_t) p1, (uint32_t) p2) == 0) {
                      neverSaveData = 1;
                      cerr << "Cannot swap partitions " << p1 + 1 << " and " << p2 + 1 << "\n";
                   } else saveData = 1;
                                                       break;
                case 'R':
-                  secondDevice = *this;
-                  secondDevice.SetDisk(outDevice);
-                  secondDevice.JustLooking(0);
-                  if (!secondDevice.SaveGPTData(1))
-                     retval = 8;
+                  if (strchr(outDevice, ',') != NULL) {
+                     if (ReplicateGPTData(SplitDeviceList(outDevice)) > 0)
+                        retval = 8;
+                  } else {
+                     secondDevice = *this;
+                     secondDevice.SetDisk(outDevice);
+                     secondDevice.JustLooking(0);
+                     if (!secondDevice.SaveGPTData(1))
+                        retval = 8;
+                  } // if/else
                   break;
                case 's':
                   JustLooking(0);
@@ -399,13 +471,11 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                   break;
                case 't':
                   JustLooking(0);
-                  partNum = (int) GetInt(typeCode, 1) - 1;
-                  if (partNum < 0)
-                     partNum = newPartNum;
+                  partNum = DecodePartNum(typeCode, newPartNum, edits, neverSaveData);
                   if ((partNum >= 0) && (partNum < (int) GetNumParts())) {
                      typeHelper = GetString(typeCode, 2);
                      if ((typeHelper != PartType::unusedPartType) &&
-                         (ChangePartType(partNum, typeHelper))) {
+                         (edits.ChangePartType(partNum, typeHelper))) {
                         saveData = 1;
                         } else {
                            cerr << "Could not change partition " << partNum + 1
@@ -423,9 +493,7 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                case 'u':
                   JustLooking(0);
                   saveData = 1;
-                  partNum = (int) GetInt(partGUID, 1) - 1;
-                  if (partNum < 0)
-                     partNum = newPartNum;
+                  partNum = DecodePartNum(partGUID, newPartNum, edits, neverSaveData);
                   if ((partNum >= 0) && (partNum < (int) GetNumParts())) {
                      SetPartitionGUID(partNum, GetString(partGUID, 2).c_str());
                   }
@@ -438,6 +506,26 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                case 'v':
                   Verify();
                   break;
+               case 'W':
+                  break;
+               case 'X':
+                  JustLooking(0);
+                  MoveSecondHeaderToEnd();
+                  if (growPartNum <= 0) {
+                     uint32_t lastPart = UINT32_MAX;
+                     IsFree(FindLastUsedLBA(), &lastPart);
+                     growPartNum = (int) lastPart + 1;
+                  } // if
+                  if (IsUsedPartNum(growPartNum - 1)) {
+                     if (!GrowPartition(growPartNum - 1, alignEnd))
+                        cout << "No free space follows partition " << growPartNum
+                             << "; not growing it.\n";
+                     saveData = 1;
+                  } else {
+                     cerr << "No partition to grow!\n";
+                     neverSaveData = 1;
+                  } // if/else
+                  break;
                case 'z':
                   if (!pretend) {
                      DestroyGPT();
@@ -458,6 +546,8 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
                   break;
                } // switch
          } // while
+         if (!edits.Commit())
+            neverSaveData = 1;
       } else { // if loaded OK
          poptResetContext(poptCon);
          // Do a few types of operations even if there are problems....
@@ -503,6 +593,21 @@ int GPTDataCL::DoOptions(int argc, char* argv[]) {
          if (!SaveGPTData(1))
             retval = 4;
       }
+      // With -P, list what would have been discarded from new partitions;
+      // otherwise SaveGPTData() has already discarded them.
+      if (pretend && GetDiscardOnCreate() && !neverSaveData)
+         DiscardNewPartitions(1);
+      // Free space is discarded only once the table that defines it is on
+      // the disk, and never on a disk that had no GPT to begin with (which
+      // would be all free space, whatever it really holds).
+      if (discardFree && !neverSaveData && saveNonGPT && (retval == 0)) {
+         if (!saveData && (WhichWasUsed() != use_gpt)) {
+            cerr << "No GPT data found; not discarding free space.\n";
+            retval = 4;
+         } else if (!DiscardFreeSpace(pretend)) {
+            retval = 4;
+         } // if/else if
+      } // if
       if (saveData && (!saveNonGPT)) {
          cout << "Non-GPT disk; not saving changes. Use -g to override.\n";
          retval = 3;
@@ -571,6 +676,34 @@ int GPTDataCL::BuildMBR(char* argument, int isHybrid) {
    return allOK;
 } // GPTDataCL::BuildMBR()
 
+// Return the partition number (from 0) given by the first field of
+// argument. That's either a partition number (from 1, with 0 meaning the
+// most recently created partition, newPartNum) or a partition's unique
+// GUID, which is looked up in the table as edits leave it.
+// Returns -1, and sets neverSaveData, if no partition has the GUID.
+int GPTDataCL::DecodePartNum(const string & argument, int newPartNum, Transaction & edits,
+                             int & neverSaveData) {
+   string field = GetString(argument, 1);
+   uint32_t found;
+   int partNum;
+
+   if (field.length() >= 32) {
+      found = edits.FindPartitionByGUID((GUIDData) field);
+      if (found < numParts) {
+         partNum = (int) found;
+      } else {
+         cerr << "Error: No partition has the unique GUID " << field << "\n";
+         partNum = -1;
+         neverSaveData = 1;
+      } // if/else
+   } else {
+      partNum = (int) GetInt(argument, 1) - 1;
+      if (partNum < 0)
+         partNum = newPartNum;
+   } // if/else
+   return partNum;
+} // GPTDataCL::DecodePartNum()
+
 // Returns the number of colons in argument string, ignoring the
 // first character (thus, a leading colon is ignored, as GetString()
 // does).
@@ -618,3 +751,21 @@ string GetString(string argument, int itemNum) {
 
    return retVal;
 } // GetString()
+
+// Split a comma-separated list of device filenames (as given to -R) into
+// its parts, skipping empty entries.
+vector<string> SplitDeviceList(const string & argument) {
+   vector<string> devices;
+   size_t startPos = 0, endPos;
+
+   do {
+      endPos = argument.find(',', startPos);
+      if (endPos == string::npos)
+         endPos = argument.length();
+      if (endPos > startPos)
+         devices.push_back(argument.substr(startPos, endPos - startPos));
+      startPos = endPos + 1;
+   } while (startPos < argument.length());
+
+   return devices;
+} // SplitDeviceList()
@@ -30,13 +30,15 @@ class GPTDataCL : public GPTData {
       // Following are variables associated with popt parameters....
       char *attributeOperation, *backupFile, *partName, *hybrids;
       char *newPartInfo, *mbrParts, *twoParts, *outDevice, *typeCode;
-      char *partGUID, *diskGUID;
-      int alignment, deletePartNum, infoPartNum, largestPartNum, bsdPartNum;
+      char *partGUID, *diskGUID, *moveInfo, *discardWhat;
+      int alignment, deletePartNum, infoPartNum, largestPartNum, bsdPartNum, growPartNum;
       bool alignEnd;
       uint32_t tableSize;
       poptContext poptCon;
 
       int BuildMBR(char* argument, int isHybrid);
+      int DecodePartNum(const std::string & argument, int newPartNum, Transaction & edits,
+                        int & neverSaveData);
    public:
       GPTDataCL(void);
       GPTDataCL(std::string filename);
@@ -48,5 +50,6 @@ class GPTDataCL : public GPTData {
 int CountColons(char* argument);
 uint64_t GetInt(const std::string & argument, int itemNum);
 std::string GetString(std::string argument, int itemNum);
+std::vector<std::string> SplitDeviceList(const std::string & argument);
 
 #endif
@@ -94,15 +94,12 @@ int GPTDataCurses::MakeSpacesFromParts(void) {
    Space *tempSpace;
 
    EmptySpaces();
-   for (i = 0; i < numParts; i++) {
-      if (partitions[i].IsUsed()) {
-         tempSpace = new Space;
-         tempSpace->firstLBA = partitions[i].GetFirstLBA();
-         tempSpace->lastLBA = partitions[i].GetLastLBA();
-         tempSpace->origPart = &partitions[i];
-         tempSpace->partNum = (int) i;
-         LinkToEnd(tempSpace);
-      } // if
+   for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1)) {
+      tempSpace = new Space;
+      tempSpace->firstLBA = partitions[i].GetFirstLBA();
+      tempSpace->lastLBA = partitions[i].GetLastLBA();
+      tempSpace->partNum = (int) i;
+      LinkToEnd(tempSpace);
    } // for
    return numSpaces;
 } // GPTDataCurses::MakeSpacesFromParts()
@@ -114,7 +111,6 @@ void GPTDataCurses::AddEmptySpace(uint64_t firstLBA, uint64_t lastLBA) {
    tempSpace = new Space;
    tempSpace->firstLBA = firstLBA;
    tempSpace->lastLBA = lastLBA;
-   tempSpace->origPart = &emptySpace;
    tempSpace->partNum = -1;
    LinkToEnd(tempSpace);
    SortSpaces();
@@ -248,13 +244,13 @@ Space* GPTDataCurses::ShowSpace(int spaceNum, int lineNum) {
          move(lineNum, 12);
          printw("%s", BytesToIeee((space->lastLBA - space->firstLBA + 1), blockSize).c_str());
          move(lineNum, 24);
-         printw("%s", space->origPart->GetTypeName().c_str());
+         printw("%s", partitions[space->partNum].GetTypeName().c_str());
          move(lineNum, 50);
          #ifdef USE_UTF16
-         space->origPart->GetDescription().extract(0, 39, temp, 39);
+         partitions[space->partNum].GetDescription().extract(0, 39, temp, 39);
          printw(temp);
          #else
-         printw("%s", space->origPart->GetDescription().c_str());
+         printw("%s", partitions[space->partNum].GetDescription().c_str());
          #endif
       } // if/else
    } // if
@@ -366,7 +362,9 @@ void GPTDataCurses::ChangeName(int partNum) {
       printw("Enter new partition name, or <Enter> to use the current name:\n");
       echo();
       getnstr(temp, NAME_SIZE );
+      UnsharePartitions();
       partitions[partNum].SetName((string) temp);
+      PartitionChanged(partNum);
       noecho();
    } // if
 } // GPTDataCurses::ChangeName()
@@ -390,9 +388,11 @@ void GPTDataCurses::ChangeType(int partNum) {
          if (temp[0] == '\0')
             tempType = partitions[partNum].GetType().GetHexType();
          tempType = temp;
+         UnsharePartitions();
          partitions[partNum].SetType(tempType);
       } // if
-   } while ((temp[0] == 'L') || (temp[0] == 'l') || (partitions[partNum].GetType() == (GUIDData) "0x0000"));
+   } while ((temp[0] == 'L') || (temp[0] == 'l') || (partitions[partNum].GetType().IsZero()));
+   PartitionChanged(partNum);
    noecho();
 } // GPTDataCurses::ChangeType
 
@@ -430,23 +430,22 @@ void GPTDataCurses::Verify(void) {
 
 // Create a new partition in the space pointed to by currentSpace.
 void GPTDataCurses::MakeNewPart(void) {
-   uint64_t size, newFirstLBA = 0, newLastLBA = 0, lastAligned;
+   uint64_t size, newFirstLBA = 0, newLastLBA = 0, defFirstLBA, lastAligned;
    int partNum;
    char inLine[80];
 
    move(LINES - 4, 0);
    clrtobot();
-   lastAligned = currentSpace->lastLBA + 1;
-   Align(&lastAligned);
-   lastAligned--;
-   // Discard end-alignment attempt if it's giving us an invalid end point....
-   if (!IsFree(lastAligned))
-       lastAligned = currentSpace->lastLBA;
+   // Get aligned default start and end points within the current free space....
+   if (!AllocateExtent(0, sectorAlignment, alloc_first_fit, &defFirstLBA, &lastAligned,
+                       true, currentSpace->firstLBA)) {
+      defFirstLBA = currentSpace->firstLBA;
+      lastAligned = currentSpace->lastLBA;
+   } // if
    while ((newFirstLBA < currentSpace->firstLBA) || (newFirstLBA > currentSpace->lastLBA)) {
       move(LINES - 4, 0);
       clrtoeol();
-      newFirstLBA = currentSpace->firstLBA;
-      Align(&newFirstLBA);
+      newFirstLBA = defFirstLBA;
       printw("First sector (%llu-%llu, default = %llu): ", (long long unsigned int) newFirstLBA,
              (long long unsigned int) currentSpace->lastLBA, (long long unsigned int) newFirstLBA);
       echo();
@@ -538,6 +537,28 @@ void GPTDataCurses::LoadBackup(void) {
    IdentifySpaces();
 } // GPTDataCurses::LoadBackup()
 
+// Undo the most recent change to the partition table
+void GPTDataCurses::UndoChange(void) {
+   if (!Undo())
+      Report("No changes to undo!");
+   IdentifySpaces();
+   if (currentSpaceNum >= numSpaces) {
+      currentSpaceNum = numSpaces - 1;
+      currentSpace = lastSpace;
+   } // if
+} // GPTDataCurses::UndoChange()
+
+// Reapply the change most recently undone
+void GPTDataCurses::RedoChange(void) {
+   if (!Redo())
+      Report("No undone changes to redo!");
+   IdentifySpaces();
+   if (currentSpaceNum >= numSpaces) {
+      currentSpaceNum = numSpaces - 1;
+      currentSpace = lastSpace;
+   } // if
+} // GPTDataCurses::RedoChange()
+
 // Display some basic help information
 void GPTDataCurses::ShowHelp(void) {
    int i = 0;
@@ -695,6 +716,7 @@ void GPTDataCurses::AcceptInput() {
 int GPTDataCurses::Dispatch(char operation) {
    int exitNow = 0;
 
+   SaveUndoPoint();
    switch (operation) {
       case 'a': case 'A':
          SetAlignment();
@@ -729,10 +751,16 @@ int GPTDataCurses::Dispatch(char operation) {
       case 'q': case 'Q':
          exitNow = 1;
          break;
+      case 'r': case 'R':
+         RedoChange();
+         break;
       case 't': case 'T':
          if (ValidPartNum(currentSpace->partNum))
             ChangeType(currentSpace->partNum);
          break;
+      case 'u': case 'U':
+         UndoChange();
+         break;
       case 'v': case 'V':
          Verify();
          break;
@@ -767,12 +795,16 @@ void GPTDataCurses::DrawMenu(void) {
 } // DrawMenu
 
 int GPTDataCurses::MainMenu(void) {
+   vector<GPTProblem> problems;
+
    if (((LINES - RESERVED_TOP - RESERVED_BOTTOM) < 2) || (COLS < 80)) {
       Report("Display is too small; it must be at least 80 x 14 characters!");
    } else {
-      if (GPTData::Verify() > 0)
+      // Check quietly; the details would only scribble on the screen
+      if (FindProblems(problems) > 0)
          Report("Warning! Problems found on disk! Use the Verify function to learn more.\n"
                 "Using gdisk or some other program may be necessary to repair the problems.");
+      CorrectProblems(problems);
       IdentifySpaces();
       currentSpaceNum = 0;
       DrawMenu();
@@ -43,14 +43,16 @@ static struct MenuItem menuMain[] = {
    { 'm', " naMe ", "Change the partition's name" },
    { 'n', " New  ", "Create new partition from free space" },
    { 'q', " Quit ", "Quit program without writing partition table" },
+   { 'r', " Redo ", "Redo the last change undone" },
    { 't', " Type ", "Change the filesystem type code GUID" },
+   { 'u', " Undo ", "Undo the last change to the partition table" },
    { 'v', "Verify", "Verify the integrity of the disk's data structures" },
    { 'w', "Write ", "Write partition table to disk (this might destroy data)" },
    { 0, "", "" }
 };
 
-#define EMPTY_SPACE_OPTIONS "abhlnqvw"
-#define PARTITION_OPTIONS "abdhilmqtvw"
+#define EMPTY_SPACE_OPTIONS "abhlnqruvw"
+#define PARTITION_OPTIONS "abdhilmqrtuvw"
 
 // Constants for how to highlight a selected menu item
 #define USE_CURSES 1
@@ -65,8 +67,8 @@ static struct MenuItem menuMain[] = {
 struct Space {
    uint64_t firstLBA;
    uint64_t lastLBA;
-   GPTPart *origPart;
-   int partNum;
+   int partNum; // -1 for free space; names & types are read from partitions[partNum]
+               // when drawn, since that array is replaced when it's unshared
    Space *nextSpace;
    Space *prevSpace;
 };
@@ -74,7 +76,6 @@ struct Space {
 class GPTDataCurses : public GPTData {
 protected:
    static int numInstances;
-   GPTPart emptySpace;
    Space *firstSpace;
    Space *lastSpace;
    Space *currentSpace;
@@ -111,6 +112,8 @@ public:
    void SaveData(void);
    void Backup(void);
    void LoadBackup(void);
+   void UndoChange(void);
+   void RedoChange(void);
    void ShowHelp(void);
    // User input and menuing functions
    void SetDisplayType(int dt) {displayType = dt;}
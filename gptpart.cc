@@ -18,6 +18,14 @@
 #include <string.h>
 #include <stdio.h>
 #include <iostream>
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include "gptpart.h"
 #include "attributes.h"
 #ifdef USE_UTF16
@@ -28,6 +36,11 @@
 
 using namespace std;
 
+#if __cplusplus >= 201103L
+static_assert(std::is_trivially_copyable<GPTPart>::value,
+              "GPTPart must be trivially copyable; partition tables are copied with memcpy()");
+#endif
+
 GPTPart::GPTPart(void) {
    partitionType.Zero();
    uniqueGUID.Zero();
@@ -37,17 +50,6 @@ GPTPart::GPTPart(void) {
    memset(name, 0, NAME_SIZE * sizeof(name[0]) );
 } // Default constructor
 
-GPTPart::GPTPart(const GPTPart & orig) {
-   partitionType = orig.partitionType;
-   uniqueGUID = orig.uniqueGUID;
-   firstLBA = orig.firstLBA;
-   lastLBA = orig.lastLBA;
-   attributes = orig.attributes;
-   memcpy(name, orig.name, NAME_SIZE * sizeof( name[ 0 ] ) );
-} // Copy constructor
-
-GPTPart::~GPTPart(void) {
-} // destructor
 
 // Return the gdisk-specific two-byte hex code for the partition
 uint16_t GPTPart::GetHexType(void) const {
@@ -142,7 +144,7 @@ string GPTPart::GetDescription(void) {
 
 // Return 1 if the partition is in use
 int GPTPart::IsUsed(void) {
-   return (partitionType != GUIDData("0x00"));
+   return !partitionType.IsZero();
 } // GPTPart::IsUsed()
 
 // Returns MBR_SIZED_GOOD, MBR_SIZED_IFFY, or MBR_SIZED_BAD; see comments
@@ -269,16 +271,6 @@ void GPTPart::SetDefaultDescription(void) {
    SetName(partitionType.TypeName());
 } // GPTPart::SetDefaultDescription()
 
-GPTPart & GPTPart::operator=(const GPTPart & orig) {
-   partitionType = orig.partitionType;
-   uniqueGUID = orig.uniqueGUID;
-   firstLBA = orig.firstLBA;
-   lastLBA = orig.lastLBA;
-   attributes = orig.attributes;
-   memcpy(name, orig.name, NAME_SIZE * sizeof( name[ 0 ] ) );
-   return *this;
-} // assignment operator
-
 // Compare the values, and return a bool result.
 // Because this is intended for sorting and a firstLBA value of 0 denotes
 // a partition that's not in use and so that should be sorted upwards,
@@ -460,3 +452,44 @@ void GPTPart::ChangeType(void) {
       SetDefaultDescription();
    } // if
 } // GPTPart::ChangeType()
+
+/****************************************
+ * Non-class support functions          *
+ ****************************************/
+
+// Scan an array of numParts packed partition entries (as loaded from disk)
+// in one pass, setting the bit in usedMask for each entry whose type GUID
+// (the first 16 bytes of the entry) isn't all zeroes. usedMask must hold
+// (numParts + 63) / 64 words. Each type GUID is tested with one 16-byte
+// vector compare where SSE2 or NEON is available.
+// Returns the number of used entries.
+uint32_t GetUsedMask(const GPTPart *parts, uint32_t numParts, uint64_t *usedMask) {
+   const unsigned char *entry = (const unsigned char *) parts;
+   uint32_t i, used, numUsed = 0;
+   uint64_t word = 0;
+#if defined(__SSE2__)
+   const __m128i zero = _mm_setzero_si128();
+#elif !(defined(__aarch64__) && defined(__ARM_NEON))
+   uint64_t halves[2];
+#endif
+
+   for (i = 0; i < numParts; i++) {
+#if defined(__SSE2__)
+      used = (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) entry),
+                                               zero)) != 0xFFFF);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+      used = (vmaxvq_u8(vld1q_u8(entry)) != 0);
+#else
+      memcpy(halves, entry, sizeof(halves));
+      used = ((halves[0] | halves[1]) != 0);
+#endif
+      word |= (uint64_t) used << (i % 64);
+      numUsed += used;
+      if (((i % 64) == 63) || (i == numParts - 1)) {
+         usedMask[i / 64] = word;
+         word = 0;
+      } // if
+      entry += sizeof(GPTPart);
+   } // for
+   return numUsed;
+} // GetUsedMask()
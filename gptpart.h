@@ -50,9 +50,10 @@ class GPTPart {
       Attributes attributes;
       uint16_t name[NAME_SIZE];
    public:
+      // GPTPart has no copy constructor, assignment operator, or destructor
+      // of its own, nor do its members, so a table of them can be copied,
+      // compared, and moved around with memcpy() and memcmp().
       GPTPart(void);
-      GPTPart(const GPTPart &);
-      ~GPTPart(void);
 
       // Simple data retrieval:
       PartType & GetType(void) {return partitionType;}
@@ -85,7 +86,6 @@ class GPTPart {
       void SetDefaultDescription(void);
 
       // Additional functions
-      GPTPart & operator=(const GPTPart & orig);
       bool operator<(const GPTPart &other) const;
       void ShowSummary(int partNum, uint32_t blockSize); // display summary information (1-line)
       void ShowDetails(uint32_t blockSize); // display detailed information (multi-line)
@@ -98,4 +98,7 @@ class GPTPart {
       void ChangeType(void); // Change the type code
 }; // struct GPTPart
 
+// Bulk test of a whole table for used entries
+uint32_t GetUsedMask(const GPTPart *parts, uint32_t numParts, uint64_t *usedMask);
+
 #endif
@@ -219,6 +219,59 @@ void GPTDataTextUI::MoveSecondTable(void) {
     } // if
 } // GPTDataTextUI::MoveSecondTable()
 
+// Scan all or part of the disk for GPT headers that weren't where they were
+// expected to be, as when a disk has been cloned to a bigger one or its
+// first sectors have been overwritten, and offer to rebuild the GPT data
+// from one of them.
+void GPTDataTextUI::FindLostHeaders(void) {
+   vector<FoundGPTHeader> found;
+   uint64_t first, last, oldSize;
+   size_t i, choice;
+   ostringstream prompt1, prompt2, prompt3;
+
+   prompt1 << "First sector to scan (0-" << diskSize - 1 << ", default = 0): ";
+   first = GetNumber(0, diskSize - 1, 0, prompt1.str());
+   prompt2 << "Last sector to scan (" << first << "-" << diskSize - 1 << ", default = "
+           << diskSize - 1 << "): ";
+   last = GetNumber(first, diskSize - 1, diskSize - 1, prompt2.str());
+   if (!ScanForHeaders(found, first, last)) {
+      cerr << "Unable to read the disk!\n";
+   } else if (found.empty()) {
+      cout << "No GPT headers found.\n";
+   } else {
+      cout << "\nFound " << found.size() << " GPT header(s); this disk has " << diskSize
+           << " sectors:\n";
+      for (i = 0; i < found.size(); i++) {
+         const GPTHeader & header = found[i].header;
+         if (header.currentLBA < header.backupLBA) {
+            cout << i + 1 << ": main header at sector " << header.currentLBA;
+            oldSize = header.backupLBA + 1;
+         } else {
+            cout << i + 1 << ": backup header at sector " << header.currentLBA;
+            oldSize = header.currentLBA + 1;
+         } // if/else
+         cout << ", for a disk of " << oldSize << " sectors (" << BytesToIeee(oldSize, blockSize)
+              << ");\n   disk GUID " << header.diskGUID << ", " << header.numParts
+              << " entries, partition table "
+              << (found[i].tableOK ? "OK" : "DAMAGED or missing") << "\n";
+      } // for
+      prompt3 << "Header to rebuild the GPT data from (1-" << found.size()
+              << ", or 0 to leave them alone; default = 0): ";
+      choice = (size_t) GetNumber(0, found.size(), 0, prompt3.str());
+      if (choice > 0) {
+         if (!found[choice - 1].tableOK) {
+            cout << "Warning! That header's partition table doesn't match its CRC! Proceed? ";
+            if (GetYN() != 'Y')
+               return;
+         } // if
+         if (UseFoundHeader(found[choice - 1].header))
+            cout << "GPT data rebuilt; use 'v' to check them and 'w' to save them.\n";
+         else
+            cerr << "Unable to load the partition table that header points to!\n";
+      } // if
+   } // if/else
+} // GPTDataTextUI::FindLostHeaders()
+
 // Interactively create a partition
 void GPTDataTextUI::CreatePartition(void) {
    uint64_t firstBlock, firstInLargest, lastBlock, sector, origSector, lastAligned;
@@ -231,11 +284,10 @@ void GPTDataTextUI::CreatePartition(void) {
       firstFreePart++;
    } // while
 
-   if (((firstBlock = FindFirstAvailable()) != 0) &&
-       (firstFreePart < numParts)) {
+   // The default first sector is the (aligned) start of the largest free block
+   if (((firstBlock = FindFirstAvailable()) != 0) && (firstFreePart < numParts) &&
+       AllocateExtent(0, sectorAlignment, alloc_largest, &firstInLargest, &lastAligned)) {
       lastBlock = FindLastAvailable();
-      firstInLargest = FindFirstInLargest();
-      Align(&firstInLargest);
 
       // Get partition number....
       prompt1 << "Partition number (" << firstFreePart + 1 << "-" << numParts
@@ -274,8 +326,10 @@ void GPTDataTextUI::CreatePartition(void) {
       lastBlock = sector;
 
       GPTData::CreatePartition(partNum, firstBlock, lastBlock);
+      UnsharePartitions();
       partitions[partNum].ChangeType();
       partitions[partNum].SetDefaultDescription();
+      PartitionChanged(partNum);
    } else {
       if (firstFreePart >= numParts)
          cout << "No table partition entries left\n";
@@ -306,7 +360,9 @@ void GPTDataTextUI::ChangePartType(void) {
 
    if (GetPartRange(&low, &high) > 0) {
       partNum = GetPartNum();
+      UnsharePartitions();
       partitions[partNum].ChangeType();
+      PartitionChanged(partNum);
    } else {
       cout << "No partitions\n";
    } // if/else
@@ -336,7 +392,9 @@ void GPTDataTextUI::ChangeUniqueGuid(void) {
 // Partition attributes seem to be rarely used, but I want a way to
 // adjust them for completeness....
 void GPTDataTextUI::SetAttributes(uint32_t partNum) {
+   UnsharePartitions();
    partitions[partNum].SetAttributes();
+   PartitionChanged(partNum);
 } // GPTDataTextUI::SetAttributes()
 
 // Prompts the user for a partition name and sets the partition's
@@ -354,7 +412,9 @@ int GPTDataTextUI::SetName(uint32_t partNum) {
 #else
       theName = ReadString();
 #endif
+      UnsharePartitions();
       partitions[partNum].SetName(theName);
+      PartitionChanged(partNum);
    } else {
       cerr << "Invalid partition number (" << partNum << ")\n";
       retval = 0;
@@ -370,6 +430,7 @@ void GPTDataTextUI::ReverseName(uint32_t partNum) {
    int swapBytes;
 
    cout << "Current name is: " << partitions[partNum].GetDescription() << "\n";
+   UnsharePartitions();
    partitions[partNum].ReverseNameBytes();
    cout << "Byte-swapped name is: " << partitions[partNum].GetDescription() << "\n";
    cout << "Do you want to byte-swap the name? ";
@@ -377,6 +438,7 @@ void GPTDataTextUI::ReverseName(uint32_t partNum) {
    // Already swapped for display, so undo if necessary....
    if (!swapBytes)
       partitions[partNum].ReverseNameBytes();
+   PartitionChanged(partNum);
 } // GPTDataTextUI::ReverseName()
 
 // Ask user for two partition numbers and swap them in the table. Note that
@@ -555,16 +617,14 @@ int GPTDataTextUI::XFormToMBR(void) {
    uint32_t i;
 
    protectiveMBR.EmptyMBR(0);
-   for (i = 0; i < numParts; i++) {
-      if (partitions[i].IsUsed()) {
-         if (partitions[i].IsSizedForMBR() == MBR_SIZED_IFFY)
-            WarnAboutIffyMBRPart(i + 1);
-         // Note: MakePart() checks for oversized partitions, so don't
-         // bother checking other IsSizedForMBR() return values....
-         protectiveMBR.MakePart(i, partitions[i].GetFirstLBA(),
-                                partitions[i].GetLengthLBA(),
-                                partitions[i].GetHexType() / 0x0100, 0);
-      } // if
+   for (i = NextUsedPart(0); i < numParts; i = NextUsedPart(i + 1)) {
+      if (partitions[i].IsSizedForMBR() == MBR_SIZED_IFFY)
+         WarnAboutIffyMBRPart(i + 1);
+      // Note: MakePart() checks for oversized partitions, so don't
+      // bother checking other IsSizedForMBR() return values....
+      protectiveMBR.MakePart(i, partitions[i].GetFirstLBA(),
+                             partitions[i].GetLengthLBA(),
+                             partitions[i].GetHexType() / 0x0100, 0);
    } // for
    protectiveMBR.MakeItLegal();
    return protectiveMBR.DoMenu();
@@ -626,6 +686,7 @@ void GPTDataTextUI::MainMenu(string filename) {
    uint32_t temp1, temp2;
 
    do {
+      SaveUndoPoint();
       cout << "\nCommand (? for help): ";
       switch (ReadString()[0]) {
          case '\0':
@@ -678,6 +739,10 @@ void GPTDataTextUI::MainMenu(string filename) {
          case 't': case 'T':
             ChangePartType();
             break;
+         case 'u': case 'U':
+            if (!Undo())
+               cout << "No changes to undo\n";
+            break;
          case 'v': case 'V':
             Verify();
             break;
@@ -689,6 +754,10 @@ void GPTDataTextUI::MainMenu(string filename) {
             ExpertsMenu(filename);
             goOn = 0;
             break;
+         case 'y': case 'Y':
+            if (!Redo())
+               cout << "No undone changes to redo\n";
+            break;
          default:
             ShowCommands();
             break;
@@ -709,9 +778,11 @@ void GPTDataTextUI::ShowCommands(void) {
    cout << "r\trecovery and transformation options (experts only)\n";
    cout << "s\tsort partitions\n";
    cout << "t\tchange a partition's type code\n";
+   cout << "u\tundo the last change\n";
    cout << "v\tverify disk\n";
    cout << "w\twrite table to disk and exit\n";
    cout << "x\textra functionality (experts only)\n";
+   cout << "y\tredo the last change undone\n";
    cout << "?\tprint this menu\n";
 } // GPTDataTextUI::ShowCommands()
 
@@ -722,6 +793,7 @@ void GPTDataTextUI::RecoveryMenu(string filename) {
    int goOn = 1, temp1;
 
    do {
+      SaveUndoPoint();
       cout << "\nRecovery/transformation command (? for help): ";
       switch (ReadString()[0]) {
          case '\0':
@@ -794,6 +866,9 @@ void GPTDataTextUI::RecoveryMenu(string filename) {
          case 'q': case 'Q':
             goOn = 0;
             break;
+         case 's': case 'S':
+            FindLostHeaders();
+            break;
          case 't': case 'T':
             XFormDisklabel();
             break;
@@ -830,6 +905,7 @@ void GPTDataTextUI::ShowRecoveryCommands(void) {
    cout << "o\tprint protective MBR data\n";
    cout << "p\tprint the partition table\n";
    cout << "q\tquit without saving changes\n";
+   cout << "s\tscan the disk for lost GPT headers\n";
    cout << "t\ttransform BSD disklabel partition\n";
    cout << "v\tverify disk\n";
    cout << "w\twrite table to disk and exit\n";
@@ -848,6 +924,7 @@ void GPTDataTextUI::ExpertsMenu(string filename) {
    ostringstream prompt;
 
    do {
+      SaveUndoPoint();
       cout << "\nExpert command (? for help): ";
       switch (ReadString()[0]) {
          case '\0':
@@ -948,6 +1025,14 @@ void GPTDataTextUI::ExpertsMenu(string filename) {
                goOn = 0;
             } // if
             break;
+         case 'x': case 'X':
+            WipeNewPartitions(!GetWipeNewPartitions());
+            if (GetWipeNewPartitions())
+               cout << "Old filesystem signatures will be wiped from new partitions when the table\n"
+                    << "is written.\n";
+            else
+               cout << "Old filesystem signatures will be left in new partitions.\n";
+            break;
          case 'z': case 'Z':
             if (DestroyGPTwPrompt() == 1) {
                goOn = 0;
@@ -984,6 +1069,7 @@ void GPTDataTextUI::ShowExpertCommands(void) {
    cout << "u\treplicate partition table on new device\n";
    cout << "v\tverify disk\n";
    cout << "w\twrite table to disk and exit\n";
+   cout << "x\ttoggle wiping of old filesystem signatures from new partitions\n";
    cout << "z\tzap (destroy) GPT data structures and exit\n";
    cout << "?\tprint this menu\n";
 } // GPTDataTextUI::ShowExpertCommands()
@@ -42,6 +42,7 @@ class GPTDataTextUI : public GPTData {
       void ResizePartitionTable(void);
       void MoveMainTable(void);
       void MoveSecondTable(void);
+      void FindLostHeaders(void);
       void CreatePartition(void);
       void DeletePartition(void);
       void ChangePartType(void);
@@ -24,20 +24,12 @@
 
 using namespace std;
 
-bool GUIDData::firstInstance = 1;
+bool GUIDData::randSeeded = 0;
 
 GUIDData::GUIDData(void) {
-   if (firstInstance) {
-      srand((unsigned int) time(0));
-      firstInstance = 0;
-   } // if
    Zero();
 } // constructor
 
-GUIDData::GUIDData(const GUIDData & orig) {
-   memcpy(uuidData, orig.uuidData, sizeof(uuidData));
-} // copy constructor
-
 GUIDData::GUIDData(const string & orig) {
    operator=(orig);
 } // copy (from string) constructor
@@ -46,14 +38,6 @@ GUIDData::GUIDData(const char * orig) {
    operator=(orig);
 } // copy (from char*) constructor
 
-GUIDData::~GUIDData(void) {
-} // destructor
-
-GUIDData & GUIDData::operator=(const GUIDData & orig) {
-   memcpy(uuidData, orig.uuidData, sizeof(uuidData));
-   return *this;
-} // GUIDData::operator=(const GUIDData & orig)
-
 // Assign the GUID from a string input value. A GUID is normally formatted
 // with four dashes as element separators, for a total length of 36
 // characters. If the input string is this long or longer, this function
@@ -159,6 +143,10 @@ void GUIDData::Randomize(void) {
    if (!uuidGenerated) {
       cerr << "Warning! Unable to generate a proper UUID! Creating an improper one as a last\n"
            << "resort! Windows 7 may crash if you save this partition table!\a\n";
+      if (!randSeeded) {
+         srand((unsigned int) time(0));
+         randSeeded = 1;
+      } // if
       for (i = 0; i < 16; i++)
          uuidData[i] = (unsigned char) (256.0 * (rand() / (RAND_MAX + 1.0)));
    } // if
@@ -174,6 +162,29 @@ int GUIDData::operator!=(const GUIDData & orig) const {
    return !operator==(orig);
 } // GUIDData::operator!=
 
+// Returns 1 if the GUID is all zeroes (as in an unused partition's type
+// code), 0 if not. This is much quicker than comparing to GUIDData("0x00"),
+// which must parse a string.
+int GUIDData::IsZero(void) const {
+   uint64_t halves[2];
+
+   memcpy(halves, uuidData, sizeof(halves));
+   return ((halves[0] | halves[1]) == 0);
+} // GUIDData::IsZero()
+
+// Return a hash of the GUID, for use in hash tables. All the bits are
+// mixed, so any of them may be used as a table index, even for GUIDs that
+// differ only in a byte or two.
+uint32_t GUIDData::Hash(void) const {
+   uint64_t halves[2], h;
+
+   memcpy(halves, uuidData, sizeof(halves));
+   h = (halves[0] * UINT64_C(0x9E3779B97F4A7C15)) ^ halves[1];
+   h = (h ^ (h >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+   h = (h ^ (h >> 27)) * UINT64_C(0x94D049BB133111EB);
+   return (uint32_t) (h ^ (h >> 31));
+} // GUIDData::Hash()
+
 // Return the GUID as a string, suitable for display to the user.
 string GUIDData::AsString(void) const {
    char theString[40];
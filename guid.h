@@ -34,19 +34,19 @@ typedef uuid_t my_uuid_t;
 // it will be necessary to modify various GPT classes to compensate.
 class GUIDData {
    private:
-      static bool firstInstance;
+      static bool randSeeded;
    protected:
       my_uuid_t uuidData;
       std::string DeleteSpaces(std::string s);
    public:
+      // Copying and destruction are left to the compiler, so that a GUID
+      // (and the partition entries that hold them) can be copied with
+      // memcpy().
       GUIDData(void);
-      GUIDData(const GUIDData & orig);
       GUIDData(const std::string & orig);
       GUIDData(const char * orig);
-      ~GUIDData(void);
 
       // Data assignment operators....
-      GUIDData & operator=(const GUIDData & orig);
       GUIDData & operator=(const std::string & orig);
       GUIDData & operator=(const char * orig);
       void Zero(void);
@@ -55,6 +55,8 @@ class GUIDData {
       // Data tests....
       int operator==(const GUIDData & orig) const;
       int operator!=(const GUIDData & orig) const;
+      int IsZero(void) const;
+      uint32_t Hash(void) const;
 
       // Data retrieval....
       std::string AsString(void) const;
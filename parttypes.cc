@@ -16,7 +16,6 @@
 
 using namespace std;
 
-int PartType::numInstances = 0;
 AType* PartType::allTypes = NULL;
 AType* PartType::lastType = NULL;
 const PartType PartType::unusedPartType = (GUIDData) "00000000-0000-0000-0000-000000000000";
@@ -25,51 +24,29 @@ const PartType PartType::unusedPartType = (GUIDData) "00000000-0000-0000-0000-00
 #define NUM_COLUMNS 2
 #define DESC_LENGTH (SCREEN_WIDTH - (6 * NUM_COLUMNS)) / NUM_COLUMNS
 
-// Constructor. Its main task is to initialize the data list, but only
-// if this is the first instance, since it's a static linked list.
-// Partition type codes are MBR type codes multiplied by 0x0100, with
-// additional related codes taking on following numbers. For instance,
-// the FreeBSD disklabel code in MBR is 0xa5; here, it's 0xa500, with
-// additional FreeBSD codes being 0xa501, 0xa502, and so on. This gives
-// related codes similar numbers and (given appropriate entry positions
-// in the linked list) keeps them together in the listings generated
-// by typing "L" at the main gdisk menu.
 PartType::PartType(void) : GUIDData() {
-   numInstances++;
-   if (numInstances == 1) {
-      AddAllTypes();
-   } // if
 } // default constructor
 
-PartType::PartType(const PartType & orig) : GUIDData(orig) {
-   numInstances++;
-   if (numInstances == 1) { // should never happen; just being paranoid
-      AddAllTypes();
-   } // if
-} // PartType copy constructor
-
 PartType::PartType(const GUIDData & orig) : GUIDData(orig) {
-   numInstances++;
-   if (numInstances == 1) {
-      AddAllTypes();
-   } // if
-} // PartType copy constructor
-
-PartType::~PartType(void) {
-   AType* tempType;
+} // PartType(const GUIDData &) constructor
 
-   numInstances--;
-   if (numInstances == 0) {
-      while (allTypes != NULL) {
-         tempType = allTypes;
-         allTypes = allTypes->next;
-         delete tempType;
-      } // while
-   } // if
-} // destructor
+// Return the list of partition types, building it if this is the first
+// time it's been needed.
+AType* PartType::Types(void) {
+   if (allTypes == NULL)
+      AddAllTypes();
+   return allTypes;
+} // PartType::Types()
 
 // Add all partition type codes to the internal linked-list structure.
-// Used by constructors.
+// Used by Types().
+// Partition type codes are MBR type codes multiplied by 0x0100, with
+// additional related codes taking on following numbers. For instance,
+// the FreeBSD disklabel code in MBR is 0xa5; here, it's 0xa500, with
+// additional FreeBSD codes being 0xa501, 0xa502, and so on. This gives
+// related codes similar numbers and (given appropriate entry positions
+// in the linked list) keeps them together in the listings generated
+// by typing "L" at the main gdisk menu.
 // See http://www.win.tue.nl/~aeb/partitions/partition_types-1.html
 // for a list of MBR partition type codes.
 void PartType::AddAllTypes(void) {
@@ -585,7 +562,7 @@ PartType & PartType::operator=(const char * orig) {
 
 // Assign a GUID based on my custom 2-byte (16-bit) MBR hex ID variant
 PartType & PartType::operator=(uint16_t ID) {
-   AType* theItem = allTypes;
+   AType* theItem = Types();
    int found = 0;
 
    // Now search the type list for a match to the ID....
@@ -612,7 +589,7 @@ PartType & PartType::operator=(uint16_t ID) {
 
 // Return the English description of the partition type (e.g., "Linux filesystem")
 string PartType::TypeName(void) const {
-   AType* theItem = allTypes;
+   AType* theItem = Types();
    int found = 0;
    string typeName;
 
@@ -633,7 +610,7 @@ string PartType::TypeName(void) const {
 #ifdef USE_UTF16
 // Return the Unicode description of the partition type (e.g., "Linux filesystem")
 UnicodeString PartType::UTypeName(void) const {
-   AType* theItem = allTypes;
+   AType* theItem = Types();
    int found = 0;
    UnicodeString typeName;
 
@@ -658,7 +635,7 @@ UnicodeString PartType::UTypeName(void) const {
 // there are multiple possibilities, but opens the algorithm up to the
 // potential for problems should the data in the list be bad.
 uint16_t PartType::GetHexType() const {
-   AType* theItem = allTypes;
+   AType* theItem = Types();
    int found = 0;
    uint16_t theID = 0xFFFF;
 
@@ -688,7 +665,7 @@ uint16_t PartType::GetHexType() const {
 void PartType::ShowAllTypes(int maxLines) const {
    int colCount = 1, lineCount = 1;
    size_t i;
-   AType* thisType = allTypes;
+   AType* thisType = Types();
    string line, matchString = "";
    size_t found;
 
@@ -729,7 +706,7 @@ void PartType::ShowAllTypes(int maxLines) const {
 
 // Returns 1 if code is a valid extended MBR code, 0 if it's not
 int PartType::Valid(uint16_t code) const {
-   AType* thisType = allTypes;
+   AType* thisType = Types();
    int found = 0;
 
    while ((thisType != NULL) && (!found)) {
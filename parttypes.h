@@ -29,21 +29,22 @@ struct AType {
 
 class PartType : public GUIDData {
 protected:
-   static int numInstances;
+   // The list of types is built when it's first needed and kept for the
+   // life of the program; a PartType is otherwise just a GUID, and is
+   // copied and destroyed like one.
    static AType* allTypes; // Linked list holding all the data
    static AType* lastType; // Pointer to last entry in the list
-   void AddAllTypes(void);
+   static void AddAllTypes(void);
+   static AType* Types(void);
 public:
    // PartType with GUID "00000000-0000-0000-0000-000000000000"
    static const PartType unusedPartType;
 
    PartType(void);
-   PartType(const PartType & orig);
    PartType(const GUIDData & orig);
-   ~PartType(void);
 
    // Set up type information
-   int AddType(uint16_t mbrType, const char * guidData, const char * name, int toDisplay = 1);
+   static int AddType(uint16_t mbrType, const char * guidData, const char * name, int toDisplay = 1);
 
    // New assignment operators....
    PartType & operator=(const std::string & orig);